@@ -13,6 +13,7 @@ BuildRequires:  cmake
 BuildRequires:  extra-cmake-modules >= 5.75.0
 BuildRequires:  pkgconfig(Qt5Core)
 BuildRequires:  pkgconfig(Qt5DBus)
+BuildRequires:  pkgconfig(Qt5Network)
 BuildRequires:  pkgconfig(KF5CalendarCore)
 BuildRequires:  pkgconfig(sqlite3)
 BuildRequires:  pkgconfig(timed-qt5) >= 2.88
@@ -70,7 +71,12 @@ install -m 644 -p %{SOURCE1} %{buildroot}%{_datadir}/mapplauncherd/privileges.d/
 %{_libdir}/pkgconfig/*.pc
 
 %files tests
+/opt/tests/mkcal/tst_alarms
+/opt/tests/mkcal/tst_bench
+/opt/tests/mkcal/tst_contention
 /opt/tests/mkcal/tst_load
+/opt/tests/mkcal/tst_maintenance
 /opt/tests/mkcal/tst_perf
 /opt/tests/mkcal/tst_storage
+/opt/tests/mkcal/tst_tracer
 /opt/tests/mkcal/tests.xml
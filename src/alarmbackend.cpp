@@ -0,0 +1,260 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "alarmbackend_p.h"
+#include "logging_p.h"
+
+using namespace mKCal;
+
+#ifdef TIMED_SUPPORT
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+# include <timed-qt6/interface.h>
+# include <timed-qt6/event-declarations.h>
+# include <timed-qt6/exception.h>
+#else
+# include <timed-qt5/interface.h>
+# include <timed-qt5/event-declarations.h>
+# include <timed-qt5/exception.h>
+#endif
+# include <QtDBus/QDBusReply>
+using namespace Maemo;
+
+class TimedAlarmBackend : public AlarmBackend
+{
+public:
+    bool query(const QMap<QString, QVariant> &query, QList<uint> *cookies) override
+    {
+        Timed::Interface timed;
+        if (!timed.isValid()) {
+            qCWarning(lcMkcal) << "cannot query alarms,"
+                               << "timed interface is not valid" << timed.lastError();
+            return false;
+        }
+        QDBusReply<QList<QVariant> > reply = timed.query_sync(query);
+        if (!reply.isValid()) {
+            qCWarning(lcMkcal) << "cannot get alarm cookies" << timed.lastError();
+            return false;
+        }
+        for (const QVariant &variant : reply.value()) {
+            cookies->append(variant.toUInt());
+        }
+        return true;
+    }
+
+    bool attributes(const QList<uint> &cookies,
+                    QMap<uint, QMap<QString, QString>> *attributes) override
+    {
+        Timed::Interface timed;
+        if (!timed.isValid()) {
+            qCWarning(lcMkcal) << "cannot get alarm attributes,"
+                               << "timed interface is not valid" << timed.lastError();
+            return false;
+        }
+        QDBusReply<QMap<uint, QMap<QString,QString> >> reply = timed.get_attributes_by_cookies_sync(cookies);
+        if (!reply.isValid()) {
+            qCWarning(lcMkcal) << "cannot get alarm attributes" << timed.lastError();
+            return false;
+        }
+        *attributes = reply.value();
+        return true;
+    }
+
+    bool cancel(const QList<uint> &cookies) override
+    {
+        Timed::Interface timed;
+        if (!timed.isValid()) {
+            qCWarning(lcMkcal) << "cannot clear alarms,"
+                               << "timed interface is not valid" << timed.lastError();
+            return false;
+        }
+        QDBusReply<QList<uint>> reply = timed.cancel_events_sync(cookies);
+        if (!reply.isValid() || !reply.value().isEmpty()) {
+            qCWarning(lcMkcal) << "cannot remove alarms" << cookies;
+            return false;
+        }
+        return true;
+    }
+
+    bool add(const EventList &events, QList<uint> *cookies) override
+    {
+        Timed::Interface timed;
+        if (!timed.isValid()) {
+            qCWarning(lcMkcal) << "cannot set alarm for incidence: "
+                               << "alarm interface is not valid" << timed.lastError();
+            return false;
+        }
+        Timed::Event::List list;
+        for (const Event &event : events) {
+            Timed::Event &e = list.append();
+            e.setUserModeFlag();
+            e.setMaximalTimeoutSnoozeCounter(2);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+            e.setTicker(event.ticker.toUTC().toSecsSinceEpoch());
+#else
+            e.setTicker(event.ticker.toUTC().toTime_t());
+#endif
+            for (QMap<QString, QString>::ConstIterator it = event.attributes.constBegin();
+                 it != event.attributes.constEnd(); it++) {
+                e.setAttribute(it.key(), it.value());
+            }
+            for (const Action &action : event.actions) {
+                Timed::Event::Action &a = e.addAction();
+                a.runCommand(action.command);
+                if (action.when == Action::WhenServed) {
+                    a.whenServed();
+                } else {
+                    a.whenFinalized();
+                }
+            }
+            if (event.reminder) {
+                e.setReminderFlag();
+                e.setAlignedSnoozeFlag();
+            }
+        }
+        QDBusReply < QList<QVariant> > reply = timed.add_events_sync(list);
+        if (!reply.isValid()) {
+            qCWarning(lcMkcal) << "failed to add alarms: " << reply.error().message();
+            return false;
+        }
+        for (const QVariant &v : reply.value()) {
+            bool ok = true;
+            uint cookie = v.toUInt(&ok);
+            cookies->append(ok ? cookie : 0);
+        }
+        return true;
+    }
+};
+#endif
+
+static AlarmBackend *defaultBackend()
+{
+#ifdef TIMED_SUPPORT
+    static TimedAlarmBackend timed;
+    return &timed;
+#else
+    return nullptr;
+#endif
+}
+
+static AlarmBackend *currentBackend = nullptr;
+
+AlarmBackend *AlarmBackend::instance()
+{
+    return currentBackend ? currentBackend : defaultBackend();
+}
+
+void AlarmBackend::setInstance(AlarmBackend *backend)
+{
+    currentBackend = backend;
+}
+
+RecordingAlarmBackend::RecordingAlarmBackend()
+{
+}
+
+RecordingAlarmBackend::~RecordingAlarmBackend()
+{
+}
+
+bool RecordingAlarmBackend::query(const QMap<QString, QVariant> &query, QList<uint> *cookies)
+{
+    mQueryCount += 1;
+    for (QHash<uint, Event>::ConstIterator it = mEvents.constBegin();
+         it != mEvents.constEnd(); it++) {
+        bool match = true;
+        for (QMap<QString, QVariant>::ConstIterator attr = query.constBegin();
+             match && attr != query.constEnd(); attr++) {
+            QMap<QString, QString>::ConstIterator value = it->attributes.constFind(attr.key());
+            match = value != it->attributes.constEnd() && *value == attr.value().toString();
+        }
+        if (match) {
+            cookies->append(it.key());
+        }
+    }
+    return true;
+}
+
+bool RecordingAlarmBackend::attributes(const QList<uint> &cookies,
+                                       QMap<uint, QMap<QString, QString>> *attributes)
+{
+    mAttributesCount += 1;
+    for (uint cookie : cookies) {
+        QHash<uint, Event>::ConstIterator it = mEvents.constFind(cookie);
+        if (it != mEvents.constEnd()) {
+            attributes->insert(cookie, it->attributes);
+        }
+    }
+    return true;
+}
+
+bool RecordingAlarmBackend::cancel(const QList<uint> &cookies)
+{
+    bool success = true;
+    mCancelCount += 1;
+    for (uint cookie : cookies) {
+        success = mEvents.remove(cookie) && success;
+    }
+    return success;
+}
+
+bool RecordingAlarmBackend::add(const EventList &events, QList<uint> *cookies)
+{
+    mAddCount += 1;
+    for (const Event &event : events) {
+        mEvents.insert(++mLastCookie, event);
+        cookies->append(mLastCookie);
+    }
+    return true;
+}
+
+QHash<uint, AlarmBackend::Event> RecordingAlarmBackend::events() const
+{
+    return mEvents;
+}
+
+void RecordingAlarmBackend::clear()
+{
+    mEvents.clear();
+    mQueryCount = 0;
+    mAttributesCount = 0;
+    mCancelCount = 0;
+    mAddCount = 0;
+}
+
+int RecordingAlarmBackend::queryCount() const
+{
+    return mQueryCount;
+}
+
+int RecordingAlarmBackend::attributesCount() const
+{
+    return mAttributesCount;
+}
+
+int RecordingAlarmBackend::cancelCount() const
+{
+    return mCancelCount;
+}
+
+int RecordingAlarmBackend::addCount() const
+{
+    return mAddCount;
+}
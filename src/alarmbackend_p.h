@@ -0,0 +1,180 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling alarms and
+  defines the interface to the alarm scheduler.
+*/
+
+#ifndef MKCAL_ALARMBACKEND_H
+#define MKCAL_ALARMBACKEND_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+
+#include "mkcal_export.h"
+
+namespace mKCal {
+
+/**
+  @brief
+  This class defines the operations used by the alarm handler
+  to schedule alarms.
+
+  Alarms are identified by a cookie given by the backend when
+  they are added. They are associated to a set of string
+  attributes that can be used to query them back.
+*/
+class MKCAL_EXPORT AlarmBackend
+{
+public:
+    /**
+      A command run by the scheduler.
+    */
+    struct Action {
+        enum When {
+            WhenServed,
+            WhenFinalized
+        };
+        QString command;
+        When when = WhenServed;
+    };
+
+    /**
+      An alarm to be scheduled.
+    */
+    struct Event {
+        QDateTime ticker;
+        QMap<QString, QString> attributes;
+        QList<Action> actions;
+        bool reminder = false;
+    };
+    typedef QList<Event> EventList;
+
+    virtual ~AlarmBackend() { }
+
+    /**
+      Lists the cookies of alarms whose attributes match all
+      the ones in @p query.
+
+      @param query a set of attributes and their values.
+      @param cookies the matching alarms.
+      @returns true on success.
+     */
+    virtual bool query(const QMap<QString, QVariant> &query, QList<uint> *cookies) = 0;
+
+    /**
+      Retrieves the attributes of a list of alarms.
+
+      @param cookies the alarms.
+      @param attributes the attributes, by cookie.
+      @returns true on success.
+     */
+    virtual bool attributes(const QList<uint> &cookies,
+                            QMap<uint, QMap<QString, QString>> *attributes) = 0;
+
+    /**
+      Removes alarms.
+
+      @param cookies the alarms to remove.
+      @returns true if all alarms have been removed.
+     */
+    virtual bool cancel(const QList<uint> &cookies) = 0;
+
+    /**
+      Schedules alarms.
+
+      @param events the alarms to schedule.
+      @param cookies the cookies of the added alarms, in the same order
+             than @p events, a cookie of zero denotes a failure.
+      @returns true on success.
+     */
+    virtual bool add(const EventList &events, QList<uint> *cookies) = 0;
+
+    /**
+      The backend used by the alarm handler. By default, it is
+      timed when available, or none.
+
+      @returns the current backend, can be null.
+     */
+    static AlarmBackend *instance();
+
+    /**
+      Replaces the backend used by the alarm handler. The backend
+      is not owned and must outlive its usage.
+
+      @param backend the new backend, or null to restore the default one.
+     */
+    static void setInstance(AlarmBackend *backend);
+};
+
+/**
+  @brief
+  An in-process alarm backend that only records the alarms
+  scheduled, to be used when timed is not available.
+*/
+class MKCAL_EXPORT RecordingAlarmBackend : public AlarmBackend
+{
+public:
+    RecordingAlarmBackend();
+    ~RecordingAlarmBackend();
+
+    bool query(const QMap<QString, QVariant> &query, QList<uint> *cookies) override;
+    bool attributes(const QList<uint> &cookies,
+                    QMap<uint, QMap<QString, QString>> *attributes) override;
+    bool cancel(const QList<uint> &cookies) override;
+    bool add(const EventList &events, QList<uint> *cookies) override;
+
+    /**
+      The currently scheduled alarms, by cookie.
+     */
+    QHash<uint, Event> events() const;
+
+    /**
+      Removes all scheduled alarms and resets the counters.
+     */
+    void clear();
+
+    /**
+      The number of calls to each of the backend operations
+      since construction or the last call to clear().
+     */
+    int queryCount() const;
+    int attributesCount() const;
+    int cancelCount() const;
+    int addCount() const;
+
+private:
+    QHash<uint, Event> mEvents;
+    uint mLastCookie = 0;
+    int mQueryCount = 0;
+    int mAttributesCount = 0;
+    int mCancelCount = 0;
+    int mAddCount = 0;
+};
+
+}
+
+#endif
@@ -20,119 +20,20 @@
 */
 
 #include "alarmhandler_p.h"
+#include "alarmbackend_p.h"
 #include "logging_p.h"
+#include "tracer_p.h"
 
 using namespace mKCal;
 
 #include <KCalendarCore/Todo>
 using namespace KCalendarCore;
 
-#ifdef TIMED_SUPPORT
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-# include <timed-qt6/interface.h>
-# include <timed-qt6/event-declarations.h>
-# include <timed-qt6/exception.h>
-#else
-# include <timed-qt5/interface.h>
-# include <timed-qt5/event-declarations.h>
-# include <timed-qt5/exception.h>
-#endif
-# include <QtCore/QMap>
-# include <QtDBus/QDBusReply>
-using namespace Maemo;
-static const QLatin1String RESET_ALARMS_CMD("invoker --type=generic -n /usr/bin/mkcaltool --reset-alarms");
-#endif
-
-bool AlarmHandler::clearAlarms(const QString &notebookUid, const QString &uid)
-{
-#if defined(TIMED_SUPPORT)
-    Timed::Interface timed;
-    if (!timed.isValid()) {
-        qCWarning(lcMkcal) << "cannot clear alarms,"
-                 << "timed interface is not valid" << timed.lastError();
-        return false;
-    }
-
-    QMap<QString, QVariant> query;
-    query["APPLICATION"] = "libextendedkcal";
-    query["notebook"] = notebookUid;
-    if (!uid.isEmpty()) {
-        query["uid"] = uid;
-    }
-    QDBusReply<QList<QVariant> > reply = timed.query_sync(query);
-    if (!reply.isValid()) {
-        qCWarning(lcMkcal) << "cannot get alarm cookies" << timed.lastError();
-        return false;
-    }
-    QList<uint> cookies;
-    for (const QVariant &variant : reply.value()) {
-        cookies.append(variant.toUInt());
-    }
-    if (!cookies.isEmpty()) {
-        QDBusReply<QList<uint>> reply = timed.cancel_events_sync(cookies);
-        if (!reply.isValid() || !reply.value().isEmpty()) {
-            qCWarning(lcMkcal) << "cannot remove alarms" << cookies;
-        }
-    }
-#endif
-    return true;
-}
-
-static bool cancelAlarms(const QSet<QPair<QString, QString>> &uids)
-{
-#if defined(TIMED_SUPPORT)
-    if (uids.count() == 1) {
-        QPair<QString, QString> id = uids.values()[0];
-        return AlarmHandler::clearAlarms(id.first, id.second);
-    }
-
-    Timed::Interface timed;
-    if (!timed.isValid()) {
-        qCWarning(lcMkcal) << "cannot clear alarms,"
-                 << "timed interface is not valid" << timed.lastError();
-        return false;
-    }
-
-    QMap<QString, QVariant> query;
-    query["APPLICATION"] = "libextendedkcal";
-    QDBusReply<QList<QVariant> > reply = timed.query_sync(query);
-    if (!reply.isValid()) {
-        qCWarning(lcMkcal) << "cannot get alarm cookies" << timed.lastError();
-        return false;
-    }
-    QList<uint> cookiesAll;
-    for (const QVariant &variant : reply.value()) {
-        cookiesAll.append(variant.toUInt());
-    }
-    QDBusReply<QMap<uint, QMap<QString,QString> >> attributes = timed.get_attributes_by_cookies_sync(cookiesAll);
-    if (!attributes.isValid()) {
-        qCWarning(lcMkcal) << "cannot get alarm attributes" << timed.lastError();
-        return false;
-    }
-    QList<uint> cookiesDoomed;
-    const QMap<uint, QMap<QString,QString> > map = attributes.value();
-    for (QMap<uint, QMap<QString,QString> >::ConstIterator it = map.constBegin();
-         it != map.constEnd(); it++) {
-        const QString notebook = it.value()["notebook"];
-        const QString uid = it.value()["uid"];
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
 
-        if (uids.contains(QPair<QString, QString>(notebook, uid))
-            || uids.contains(QPair<QString, QString>(notebook, QString()))) {
-            qCDebug(lcMkcal) << "removing alarm" << it.key() << notebook << uid;
-            cookiesDoomed.append(it.key());
-        }
-    }
-    if (!cookiesDoomed.isEmpty()) {
-        QDBusReply<QList<uint>> reply = timed.cancel_events_sync(cookiesDoomed);
-        if (!reply.isValid() || !reply.value().isEmpty()) {
-            qCWarning(lcMkcal) << "cannot remove alarms" << cookiesDoomed;
-        }
-    }
-#endif
-    return true;
-}
+static const QLatin1String RESET_ALARMS_CMD("invoker --type=generic -n /usr/bin/mkcaltool --reset-alarms");
 
-#if defined(TIMED_SUPPORT)
 static QDateTime getNextOccurrence(const Recurrence *recurrence,
                                    const QDateTime &start,
                                    const QSet<QDateTime> &recurrenceIds)
@@ -146,7 +47,7 @@ static QDateTime getNextOccurrence(const Recurrence *recurrence,
     return match;
 }
 
-static void addAlarms(Timed::Event::List *events,
+static void addAlarms(AlarmBackend::EventList *events,
                       const QString &notebookUid, const Incidence &incidence,
                       const QDateTime &laterThan)
 {
@@ -181,14 +82,8 @@ static void addAlarms(Timed::Event::List *events,
                 continue;
             }
         }
-        Timed::Event &e = events->append();
-        e.setUserModeFlag();
-        e.setMaximalTimeoutSnoozeCounter(2);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
-        e.setTicker(alarmTime.toUTC().toSecsSinceEpoch());
-#else
-        e.setTicker(alarmTime.toUTC().toTime_t());
-#endif
+        AlarmBackend::Event e;
+        e.ticker = alarmTime.toUTC();
         // The code'll crash (=exception) iff the content is empty. So
         // we have to check here.
         QString s;
@@ -198,31 +93,32 @@ static void addAlarms(Timed::Event::List *events,
         if (s.isEmpty()) {
             s = ' ';
         }
-        e.setAttribute("TITLE", s);
-        e.setAttribute("PLUGIN", "libCalendarReminder");
-        e.setAttribute("APPLICATION", "libextendedkcal");
-        //e.setAttribute( "translation", "organiser" );
+        e.attributes.insert("TITLE", s);
+        e.attributes.insert("PLUGIN", "libCalendarReminder");
+        e.attributes.insert("APPLICATION", "libextendedkcal");
+        //e.attributes.insert( "translation", "organiser" );
         // This really has to exist or code is badly broken
         Q_ASSERT(!incidence.uid().isEmpty());
-        e.setAttribute("uid", incidence.uid());
+        e.attributes.insert("uid", incidence.uid());
 #ifndef QT_NO_DEBUG_OUTPUT //Helps debuggin
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
-        e.setAttribute("alarmtime", alarmTime.toOffsetFromUtc(0).toString(Qt::ISODate));
+        e.attributes.insert("alarmtime", alarmTime.toOffsetFromUtc(0).toString(Qt::ISODate));
 #else
-        e.setAttribute("alarmtime", alarmTime.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
+        e.attributes.insert("alarmtime", alarmTime.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
 #endif
 #endif // QT_NO_DEBUG_OUTPUT
         if (!incidence.location().isEmpty()) {
-            e.setAttribute("location", incidence.location());
+            e.attributes.insert("location", incidence.location());
         }
         if (incidence.recurs()) {
-            e.setAttribute("recurs", "true");
-            Timed::Event::Action &a = e.addAction();
-            a.runCommand(QString("%1 %2 %3")
-                         .arg(RESET_ALARMS_CMD)
-                         .arg(notebookUid)
-                         .arg(incidence.uid()));
-            a.whenServed();
+            e.attributes.insert("recurs", "true");
+            AlarmBackend::Action a;
+            a.command = QString("%1 %2 %3")
+                .arg(RESET_ALARMS_CMD)
+                .arg(notebookUid)
+                .arg(incidence.uid());
+            a.when = AlarmBackend::Action::WhenServed;
+            e.actions.append(a);
         }
 
         // TODO - consider this how it should behave for recurrence
@@ -231,12 +127,12 @@ static void addAlarms(Timed::Event::List *events,
 
             if (todo->hasDueDate()) {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
-                e.setAttribute("time", todo->dtDue(true).toOffsetFromUtc(0).toString(Qt::ISODate));
+                e.attributes.insert("time", todo->dtDue(true).toOffsetFromUtc(0).toString(Qt::ISODate));
 #else
-                e.setAttribute("time", todo->dtDue(true).toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
+                e.attributes.insert("time", todo->dtDue(true).toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
 #endif
             }
-            e.setAttribute("type", "todo");
+            e.attributes.insert("type", "todo");
         } else if (incidence.dtStart().isValid()) {
             QDateTime eventStart;
 
@@ -247,100 +143,254 @@ static void addAlarms(Timed::Event::List *events,
                 eventStart = incidence.dtStart();
             }
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
-            e.setAttribute("time", eventStart.toOffsetFromUtc(0).toString(Qt::ISODate));
-            e.setAttribute("startDate", eventStart.toOffsetFromUtc(0).toString(Qt::ISODate));
+            e.attributes.insert("time", eventStart.toOffsetFromUtc(0).toString(Qt::ISODate));
+            e.attributes.insert("startDate", eventStart.toOffsetFromUtc(0).toString(Qt::ISODate));
             if (incidence.endDateForStart(eventStart).isValid()) {
-                e.setAttribute("endDate", incidence.endDateForStart(eventStart).toOffsetFromUtc(0).toString(Qt::ISODate));
+                e.attributes.insert("endDate", incidence.endDateForStart(eventStart).toOffsetFromUtc(0).toString(Qt::ISODate));
             }
 #else
-            e.setAttribute("time", eventStart.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
-            e.setAttribute("startDate", eventStart.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
+            e.attributes.insert("time", eventStart.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
+            e.attributes.insert("startDate", eventStart.toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
             if (incidence.endDateForStart(eventStart).isValid()) {
-                e.setAttribute("endDate", incidence.endDateForStart(eventStart).toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
+                e.attributes.insert("endDate", incidence.endDateForStart(eventStart).toTimeSpec(Qt::OffsetFromUTC).toString(Qt::ISODate));
             }
 #endif
-            e.setAttribute("type", "event");
+            e.attributes.insert("type", "event");
         }
 
         if (incidence.hasRecurrenceId()) {
-            e.setAttribute("recurrenceId", incidence.recurrenceId().toString(Qt::ISODate));
+            e.attributes.insert("recurrenceId", incidence.recurrenceId().toString(Qt::ISODate));
         }
-        e.setAttribute("notebook", notebookUid);
+        e.attributes.insert("notebook", notebookUid);
 
         if (alarm->type() == Alarm::Procedure) {
             QString prog = alarm->programFile();
             if (!prog.isEmpty()) {
-                Timed::Event::Action &a = e.addAction();
-                a.runCommand(prog + " " + alarm->programArguments());
-                a.whenFinalized();
+                AlarmBackend::Action a;
+                a.command = prog + " " + alarm->programArguments();
+                a.when = AlarmBackend::Action::WhenFinalized;
+                e.actions.append(a);
             }
         } else {
-            e.setReminderFlag();
-            e.setAlignedSnoozeFlag();
+            e.reminder = true;
         }
+        events->append(e);
     }
 }
-#endif
 
-bool AlarmHandler::setupAlarms(const QString &notebookUid, const QString &uid)
+static QByteArray fingerprint(const AlarmBackend::EventList &events)
 {
-    QSet<QPair<QString, QString>> uids;
-    uids.insert(QPair<QString, QString>(notebookUid, uid));
-    return setupAlarms(uids);
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    for (const AlarmBackend::Event &event : events) {
+        stream << event.ticker.toMSecsSinceEpoch() << event.attributes << event.reminder;
+        for (const AlarmBackend::Action &action : event.actions) {
+            stream << action.command << int(action.when);
+        }
+    }
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
 }
 
-bool AlarmHandler::setupAlarms(const QSet<QPair<QString, QString>> &uids)
+void AlarmHandler::invalidateAlarms()
 {
-#if defined(TIMED_SUPPORT)
-    cancelAlarms(uids);
+    mScheduled.clear();
+    mSynchronized = false;
+}
+
+bool AlarmHandler::synchronize(AlarmBackend *backend)
+{
+    MKCAL_TRACE("alarms", "synchronize");
+    mScheduled.clear();
+
+    QMap<QString, QVariant> query;
+    query["APPLICATION"] = "libextendedkcal";
+    QList<uint> cookies;
+    if (!backend->query(query, &cookies)) {
+        return false;
+    }
+    QMap<uint, QMap<QString,QString> > map;
+    if (!cookies.isEmpty() && !backend->attributes(cookies, &map)) {
+        return false;
+    }
+    // Fingerprints are not known for existing alarms, they
+    // will be replaced the first time their incidence is set up.
+    for (QMap<uint, QMap<QString,QString> >::ConstIterator it = map.constBegin();
+         it != map.constEnd(); it++) {
+        mScheduled[it.value().value("notebook")][it.value().value("uid")][it.value().value("recurrenceId")]
+            .cookies.append(it.key());
+    }
+    qCDebug(lcMkcal) << "synchronized" << map.count() << "alarms";
+    mSynchronized = true;
+
+    return true;
+}
+
+bool AlarmHandler::reconcile(const QSet<QPair<QString, QString>> &uids, bool setup)
+{
+    TraceSpan span("alarms", setup ? "setup" : "clear");
+    if (span.isEnabled()) {
+        span.setDetail(QString::fromLatin1("%1 series").arg(uids.count()));
+    }
+    AlarmBackend *backend = AlarmBackend::instance();
+    if (!backend) {
+        return true;
+    }
+
+    if (backend != mBackend) {
+        invalidateAlarms();
+        mBackend = backend;
+    }
+    if (!mSynchronized && !synchronize(backend)) {
+        invalidateAlarms();
+        return false;
+    }
+
+    struct Pending {
+        QString notebookUid;
+        QString uid;
+        QString recurrenceId;
+        int count;
+    };
+    QList<Pending> pendings;
+    AlarmBackend::EventList events;
+    QList<uint> cookiesDoomed;
 
     const QDateTime now = QDateTime::currentDateTime();
-    Timed::Event::List events;
-    for (QSet<QPair<QString, QString>>::ConstIterator it = uids.constBegin();
-         it != uids.constEnd(); it++) {
-        Incidence::List list = incidencesWithAlarms(it->first, it->second);
-        QSet<QDateTime> recurrenceIds;
-        for (Incidence::List::ConstIterator inc = list.constBegin();
-             inc != list.constEnd(); inc++) {
-            if ((*inc)->hasRecurrenceId()) {
-                recurrenceIds.insert((*inc)->recurrenceId());
+    for (int attempt = 0; ; attempt++) {
+        pendings.clear();
+        events.clear();
+        cookiesDoomed.clear();
+        for (QSet<QPair<QString, QString>>::ConstIterator it = uids.constBegin();
+             it != uids.constEnd(); it++) {
+            // Alarms that should exist, by incidence uid and recurrence id.
+            QHash<QString, QHash<QString, AlarmBackend::EventList>> wanted;
+            if (setup) {
+                Incidence::List list = incidencesWithAlarms(it->first, it->second);
+                QSet<QDateTime> recurrenceIds;
+                for (Incidence::List::ConstIterator inc = list.constBegin();
+                     inc != list.constEnd(); inc++) {
+                    if ((*inc)->hasRecurrenceId()) {
+                        recurrenceIds.insert((*inc)->recurrenceId());
+                    }
+                }
+                for (Incidence::List::ConstIterator inc = list.constBegin();
+                     inc != list.constEnd(); inc++) {
+                    AlarmBackend::EventList alarms;
+                    if ((*inc)->recurs()) {
+                        addAlarms(&alarms, it->first, **inc,
+                                  getNextOccurrence((*inc)->recurrence(), now, recurrenceIds));
+                    } else {
+                        addAlarms(&alarms, it->first, **inc, now);
+                    }
+                    if (!alarms.isEmpty()) {
+                        const QString recurrenceId = (*inc)->hasRecurrenceId()
+                            ? (*inc)->recurrenceId().toString(Qt::ISODate) : QString();
+                        wanted[(*inc)->uid()][recurrenceId] += alarms;
+                    }
+                }
             }
-        }
-        for (Incidence::List::ConstIterator inc = list.constBegin();
-             inc != list.constEnd(); inc++) {
-            if ((*inc)->recurs()) {
-                addAlarms(&events, it->first, **inc,
-                          getNextOccurrence((*inc)->recurrence(), now, recurrenceIds));
-            } else {
-                addAlarms(&events, it->first, **inc, now);
+
+            QHash<QString, QHash<QString, Scheduled>> &notebook = mScheduled[it->first];
+            const QStringList covered = it->second.isEmpty()
+                ? notebook.keys()
+                : (notebook.contains(it->second) ? QStringList() << it->second : QStringList());
+            for (const QString &uid : covered) {
+                QHash<QString, Scheduled> &series = notebook[uid];
+                for (QHash<QString, Scheduled>::Iterator scheduled = series.begin();
+                     scheduled != series.end();) {
+                    QHash<QString, AlarmBackend::EventList>::Iterator alarms = wanted[uid].find(scheduled.key());
+                    if (alarms != wanted[uid].end()
+                        && !scheduled->fingerprint.isEmpty()
+                        && scheduled->fingerprint == fingerprint(*alarms)) {
+                        wanted[uid].erase(alarms);
+                        ++scheduled;
+                    } else {
+                        qCDebug(lcMkcal) << "removing alarm" << scheduled->cookies << it->first << uid;
+                        cookiesDoomed += scheduled->cookies;
+                        scheduled = series.erase(scheduled);
+                    }
+                }
+                if (series.isEmpty()) {
+                    notebook.remove(uid);
+                }
             }
+
+            for (QHash<QString, QHash<QString, AlarmBackend::EventList>>::ConstIterator series = wanted.constBegin();
+                 series != wanted.constEnd(); series++) {
+                for (QHash<QString, AlarmBackend::EventList>::ConstIterator alarms = series->constBegin();
+                     alarms != series->constEnd(); alarms++) {
+                    // Registered now, with cookies given later, so a notebook and one
+                    // of its series both in uids don't schedule the alarms twice.
+                    notebook[series.key()][alarms.key()].fingerprint = fingerprint(*alarms);
+                    pendings.append(Pending{it->first, series.key(), alarms.key(), int(alarms->count())});
+                    events += *alarms;
+                }
+            }
+            if (notebook.isEmpty()) {
+                mScheduled.remove(it->first);
+            }
+        }
+
+        if (cookiesDoomed.isEmpty() || backend->cancel(cookiesDoomed)) {
+            break;
+        }
+        // Alarms may have been removed by someone else, like when
+        // they expire, the local state cannot be trusted anymore.
+        // Fetch the alarms again from the backend before adding
+        // anything, otherwise the replaced ones would be duplicated.
+        qCWarning(lcMkcal) << "cannot remove alarms" << cookiesDoomed;
+        if (attempt > 0 || !synchronize(backend)) {
+            invalidateAlarms();
+            return false;
         }
     }
+
     if (events.count() > 0) {
-        Timed::Interface timed;
-        if (!timed.isValid()) {
-            qCWarning(lcMkcal) << "cannot set alarm for incidence: "
-                               << "alarm interface is not valid" << timed.lastError();
+        QList<uint> cookies;
+        if (!backend->add(events, &cookies)) {
+            invalidateAlarms();
             return false;
         }
-        QDBusReply < QList<QVariant> > reply = timed.add_events_sync(events);
-        if (reply.isValid()) {
-            foreach (QVariant v, reply.value()) {
-                bool ok = true;
-                uint cookie = v.toUInt(&ok);
-                if (ok && cookie) {
+        int at = 0;
+        for (const Pending &pending : pendings) {
+            Scheduled &scheduled = mScheduled[pending.notebookUid][pending.uid][pending.recurrenceId];
+            for (int i = 0; i < pending.count; i++, at++) {
+                uint cookie = at < cookies.count() ? cookies[at] : 0;
+                if (cookie) {
                     qCDebug(lcMkcal) << "added alarm: " << cookie;
+                    scheduled.cookies.append(cookie);
                 } else {
                     qCWarning(lcMkcal) << "failed to add alarm";
+                    scheduled.fingerprint.clear();
                 }
             }
-        } else {
-            qCWarning(lcMkcal) << "failed to add alarms: " << reply.error().message();
-            return false;
         }
     } else {
         qCDebug(lcMkcal) << "No alarms to send";
     }
-#endif
     return true;
 }
+
+bool AlarmHandler::clearAlarms(const QString &notebookUid, const QString &uid)
+{
+    QSet<QPair<QString, QString>> uids;
+    uids.insert(QPair<QString, QString>(notebookUid, uid));
+    return reconcile(uids, false);
+}
+
+bool AlarmHandler::clearAlarms(const QSet<QPair<QString, QString>> &uids)
+{
+    return reconcile(uids, false);
+}
+
+bool AlarmHandler::setupAlarms(const QString &notebookUid, const QString &uid)
+{
+    QSet<QPair<QString, QString>> uids;
+    uids.insert(QPair<QString, QString>(notebookUid, uid));
+    return setupAlarms(uids);
+}
+
+bool AlarmHandler::setupAlarms(const QSet<QPair<QString, QString>> &uids)
+{
+    return reconcile(uids, true);
+}
@@ -30,15 +30,19 @@
 
 #include <KCalendarCore/Incidence>
 
+#include <QtCore/QHash>
+
 #include "mkcal_export.h"
 
 namespace mKCal {
 
+class AlarmBackend;
+
 /**
   @brief
   This class provides an interface to handle alarms.
 */
-class AlarmHandler
+class MKCAL_EXPORT AlarmHandler
 {
 protected:
     AlarmHandler() { }
@@ -71,7 +75,17 @@ public:
       @param uid, when not empty, restrict the removal to incidences with this UID.
       @returns true on success.
      */
-    static bool clearAlarms(const QString &notebookUid, const QString &uid = QString());
+    bool clearAlarms(const QString &notebookUid, const QString &uid = QString());
+
+    /**
+      Remove alarms for a set of incidences known by the notebook
+      they belong to and their UID.
+
+      @param uids, a set of tuple (notebookUid, incidenceUid), an empty
+             incidenceUid removes all alarms of the notebook.
+      @returns true on success.
+     */
+    bool clearAlarms(const QSet<QPair<QString, QString>> &uids);
 
     /**
       Create alarms for all incidence of a notebook, or to a series in this notebook.
@@ -90,6 +104,28 @@ public:
       @returns true on success.
      */
     bool setupAlarms(const QSet<QPair<QString, QString>> &uids);
+
+    /**
+      Forget about the alarms known to be scheduled. The next call
+      to setupAlarms() or clearAlarms() will fetch them again from
+      the alarm backend. To be called when alarms may have been
+      modified outside of this handler.
+     */
+    void invalidateAlarms();
+
+private:
+    AlarmBackend *mBackend = nullptr;
+    struct Scheduled {
+        QList<uint> cookies;
+        QByteArray fingerprint;
+    };
+    // Alarms scheduled by this handler, by notebook uid,
+    // incidence uid and recurrence id.
+    QHash<QString, QHash<QString, QHash<QString, Scheduled>>> mScheduled;
+    bool mSynchronized = false;
+
+    bool synchronize(AlarmBackend *backend);
+    bool reconcile(const QSet<QPair<QString, QString>> &uids, bool setup);
 };
 
 }
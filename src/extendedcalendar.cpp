@@ -285,6 +285,36 @@ Incidence::List ExtendedCalendar::incidences(const QDate &start, const QDate &en
     return mergeIncidenceList(events(start, end), todos(start, end), journals(start, end));
 }
 
+bool ExtendedCalendar::unloadIncidence(const Incidence::Ptr &incidence)
+{
+    if (!incidence) {
+        return false;
+    }
+
+#if KCALENDARCORE_VERSION < QT_VERSION_CHECK(5, 245, 0)
+    // Don't keep a reference on unloaded incidences in the
+    // deleted lists, they are not deleted, only removed from memory.
+    const bool tracking = deletionTracking();
+    setDeletionTracking(false);
+#endif
+    const bool unloaded = deleteIncidence(incidence);
+#if KCALENDARCORE_VERSION < QT_VERSION_CHECK(5, 245, 0)
+    setDeletionTracking(tracking);
+#endif
+
+    return unloaded;
+}
+
+MemoryUsage ExtendedCalendar::memoryUsage() const
+{
+    MemoryUsage usage;
+    const Incidence::List list = mergeIncidenceList(rawEvents(), rawTodos(), rawJournals());
+    for (const Incidence::Ptr &incidence : list) {
+        usage.addIncidence(incidence, notebook(incidence));
+    }
+    return usage;
+}
+
 ExtendedStorage::Ptr ExtendedCalendar::defaultStorage(const ExtendedCalendar::Ptr &calendar)
 {
     SqliteStorage::Ptr ss = SqliteStorage::Ptr(new SqliteStorage(calendar));
@@ -193,6 +193,7 @@
 #define MKCAL_EXTENDEDCALENDAR_H
 
 #include "mkcal_export.h"
+#include "memoryusage.h"
 
 #include <KCalendarCore/MemoryCalendar>
 
@@ -362,6 +363,26 @@ public:
     */
     KCalendarCore::Incidence::List incidences(const QDate &start, const QDate &end);
 
+    /**
+      Removes an incidence from memory without recording it as deleted.
+      This is used by storages to release memory held by incidences
+      that can be loaded again later, the incidence is not removed
+      from any storage.
+
+      @param incidence is the incidence to remove from memory.
+      @return true if the incidence was in the calendar and has been removed.
+    */
+    bool unloadIncidence(const KCalendarCore::Incidence::Ptr &incidence);
+
+    /**
+      Estimates the memory held by the incidences of this calendar,
+      by notebook, by incidence type and by incidence part.
+
+      @return the calendar part of the usage, the storage fields
+      are left empty, see SqliteStorage::memoryUsage().
+    */
+    MemoryUsage memoryUsage() const;
+
     /**
       Creates the default Storage Object used in Maemo.
       The Storage is already linked to this calendar object.
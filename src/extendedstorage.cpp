@@ -34,11 +34,14 @@
 #include "extendedstorageobserver.h"
 #include "alarmhandler_p.h"
 #include "logging_p.h"
+#include "tracer_p.h"
 
 #include <KCalendarCore/Exceptions>
 #include <KCalendarCore/Calendar>
 using namespace KCalendarCore;
 
+#include <QtCore/QTimer>
+
 using namespace mKCal;
 
 struct Range
@@ -53,7 +56,15 @@ struct Range
             && (mEnd.isNull() || at <= mEnd);
     }
 
+    // end is exclusive, null dates are unbounded.
+    bool intersects(const QDate &start, const QDate &end) const
+    {
+        return (start.isNull() || mEnd.isNull() || start <= mEnd)
+            && (end.isNull() || mStart.isNull() || end > mStart);
+    }
+
     QDate mStart, mEnd;
+    quint64 mLastUse = 0;
 };
 
 // Range a is strictly before range b.
@@ -86,10 +97,26 @@ public:
 #endif
         , mValidateNotebooks(validateNotebooks)
         , mIsRecurrenceLoaded(false)
-    {}
+        , mRangeClock(0)
+        , mIncidenceBudget(0)
+    {
+        // Saves happening in a burst, like during a sync, are
+        // updating alarms only once.
+        mAlarmTimer.setSingleShot(true);
+        mAlarmTimer.setInterval(ALARM_DELAY_MS);
+        QObject::connect(&mAlarmTimer, &QTimer::timeout,
+                         mStorage, [this] {flushAlarms();});
+
+        QObject::connect(&mMetricsTimer, &QTimer::timeout,
+                         mStorage, [this] {
+                             qCInfo(lcMkcal).noquote() << "storage metrics:\n" + mMetrics->toString();
+                         });
+    }
 
     ~Private()
-    {}
+    {
+        delete mMetrics;
+    }
 
     ExtendedStorage *mStorage;
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
@@ -97,13 +124,40 @@ public:
 #endif
     bool mValidateNotebooks;
     QList<Range> mRanges;
+    // Notebooks fully loaded with loadNotebookIncidences().
+    QSet<QString> mLoadedNotebooks;
     bool mIsRecurrenceLoaded;
+    quint64 mRangeClock;
+    int mIncidenceBudget;
     QList<ExtendedStorageObserver *> mObservers;
+    // Observers registered as ExtendedStorageObserver2.
+    QHash<ExtendedStorageObserver *, ExtendedStorageObserver2 *> mObservers2;
+    // Observers only interested in some notebooks.
+    QHash<ExtendedStorageObserver *, QStringList> mObserverNotebooks;
     QHash<QString, Notebook::Ptr> mNotebooks; // uid to notebook
     Notebook::Ptr mDefaultNotebook;
+    // Notebooks are loaded on first use.
+    bool mNotebooksDeferred = false;
+    QTimer mAlarmTimer;
+    // Series with alarms to be updated, as they were when saved.
+    QHash<QPair<QString, QString>, Incidence::List> mPendingAlarms;
+    StorageMetrics *mMetrics = nullptr;
+    QTimer mMetricsTimer;
 
-    bool clear();
+    static const int ALARM_DELAY_MS = 250;
 
+    bool clear();
+    bool ensureNotebooks();
+    bool isInterested(ExtendedStorageObserver *observer,
+                      const QStringList &notebookUids) const;
+    void refreshNotebooks();
+    bool applyChanges(const StorageChange::List &changes);
+
+    void scheduleAlarms(const QSet<QPair<QString, QString>> &uids);
+    void scheduleAlarms(const QString &notebookUid, const Incidence::List &list);
+    void flushAlarms();
+    Incidence::List currentIncidencesWithAlarms(const QString &notebookUid,
+                                                const QString &uid);
     Incidence::List incidencesWithAlarms(const QString &notebookUid,
                                          const QString &uid) override;
 };
@@ -111,16 +165,229 @@ public:
 bool ExtendedStorage::Private::clear()
 {
     mRanges.clear();
+    mLoadedNotebooks.clear();
     mIsRecurrenceLoaded = false;
     mNotebooks.clear();
     mDefaultNotebook = Notebook::Ptr();
+    mNotebooksDeferred = false;
 
     return true;
 }
 
+bool ExtendedStorage::Private::ensureNotebooks()
+{
+    if (!mNotebooksDeferred) {
+        return true;
+    }
+    mNotebooksDeferred = false;
+    if (!mStorage->loadNotebooks()) {
+        qCWarning(lcMkcal) << "loading deferred notebooks failed";
+        return false;
+    }
+    return true;
+}
+
+bool ExtendedStorage::Private::isInterested(ExtendedStorageObserver *observer,
+                                            const QStringList &notebookUids) const
+{
+    QHash<ExtendedStorageObserver *, QStringList>::ConstIterator it
+        = mObserverNotebooks.constFind(observer);
+    if (notebookUids.isEmpty() || it == mObserverNotebooks.constEnd()) {
+        return true;
+    }
+    for (const QString &uid : notebookUids) {
+        if (it->contains(uid)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reload the notebook properties, without touching the incidences.
+void ExtendedStorage::Private::refreshNotebooks()
+{
+    // Not loaded yet, they will be up to date when used.
+    if (mNotebooksDeferred) {
+        return;
+    }
+    const QStringList previous = mNotebooks.keys();
+    mNotebooks.clear();
+    mDefaultNotebook = Notebook::Ptr();
+    if (!mStorage->loadNotebooks()) {
+        qCWarning(lcMkcal) << "loading notebooks failed";
+    }
+    for (const QString &uid : previous) {
+        if (!mNotebooks.contains(uid) && !mStorage->calendar()->deleteNotebook(uid)) {
+            qCDebug(lcMkcal) << "notebook" << uid << "already removed from calendar";
+        }
+    }
+}
+
+static QString uidFromInstanceIdentifier(const QString &instanceIdentifier)
+{
+    // At the moment, from KCalendarCore, if the instance is an exception,
+    // the instanceIdentifier will ends with yyyy-MM-ddTHH:mm:ss[Z|[+|-]HH:mm]
+    // This is tested in tst_loadIncidenceInstance() to ensure that any
+    // future breakage would be properly detected.
+    if (instanceIdentifier.endsWith('Z')) {
+        return instanceIdentifier.left(instanceIdentifier.length() - 20);
+    } else if (instanceIdentifier.length() > 19
+               && instanceIdentifier[instanceIdentifier.length() - 9] == 'T') {
+        return instanceIdentifier.left(instanceIdentifier.length() - 19);
+    } else if (instanceIdentifier.length() > 25
+               && instanceIdentifier[instanceIdentifier.length() - 3] == ':') {
+        return instanceIdentifier.left(instanceIdentifier.length() - 25);
+    } else {
+        return instanceIdentifier;
+    }
+}
+
+// Replace in memory the series modified by another process.
+// Returns false when the calendar should be reloaded instead.
+bool ExtendedStorage::Private::applyChanges(const StorageChange::List &changes)
+{
+    bool notebooksChanged = false;
+    QSet<QString> uids;
+    for (const StorageChange &change : changes) {
+        if (change.instanceIdentifier.isEmpty()) {
+            if (change.operation == StorageChange::Deleted) {
+                return false;
+            }
+            notebooksChanged = true;
+        } else {
+            uids.insert(uidFromInstanceIdentifier(change.instanceIdentifier));
+        }
+    }
+
+    Incidence::List list;
+    for (const QString &uid : uids) {
+        const Incidence::Ptr parent = mStorage->calendar()->incidence(uid);
+        if (parent) {
+            list.append(parent);
+            list += mStorage->calendar()->instances(parent);
+        }
+    }
+    for (const StorageChange &change : changes) {
+        const Incidence::Ptr instance = change.instanceIdentifier.isEmpty()
+            ? Incidence::Ptr() : mStorage->calendar()->instance(change.instanceIdentifier);
+        if (instance && !list.contains(instance)) {
+            list.append(instance);
+        }
+    }
+    if (!mStorage->unloadIncidences(list)) {
+        return false;
+    }
+
+    if (notebooksChanged) {
+        refreshNotebooks();
+    }
+    // New incidences may belong to a loaded range, but checking
+    // it requires to load them anyway. Incidences of notebooks
+    // loaded as a whole are always loaded.
+    QSet<QString> loadedUids;
+    for (const StorageChange &change : changes) {
+        if (!change.instanceIdentifier.isEmpty()
+            && mLoadedNotebooks.contains(change.notebookUid)) {
+            loadedUids.insert(uidFromInstanceIdentifier(change.instanceIdentifier));
+        }
+    }
+    if (!list.isEmpty() || !mRanges.isEmpty() || !loadedUids.isEmpty()) {
+        for (const QString &uid : uids) {
+            if (!mStorage->load(uid)) {
+                return false;
+            }
+        }
+    }
+    invalidateAlarms();
+
+    return true;
+}
+
+void ExtendedStorage::Private::scheduleAlarms(const QSet<QPair<QString, QString>> &uids)
+{
+    for (const QPair<QString, QString> &id : uids) {
+        // Copies, since the calendar may modify or unload the
+        // incidences before the alarms are scheduled.
+        Incidence::List copies;
+        const Incidence::List list = currentIncidencesWithAlarms(id.first, id.second);
+        for (const Incidence::Ptr &incidence : list) {
+            copies.append(Incidence::Ptr(incidence->clone()));
+        }
+        mPendingAlarms.insert(id, copies);
+    }
+    if (!mPendingAlarms.isEmpty()) {
+        mAlarmTimer.start();
+    }
+}
+
+// The incidences may not be in the calendar, or only as an outdated
+// copy, so their series are scheduled from them, completed with the
+// other loaded incidences of the series.
+void ExtendedStorage::Private::scheduleAlarms(const QString &notebookUid,
+                                              const Incidence::List &list)
+{
+    QHash<QString, Incidence::List> series;
+    for (const Incidence::Ptr &incidence : list) {
+        series[incidence->uid()].append(incidence);
+    }
+    ensureNotebooks();
+    const bool visible = mNotebooks.contains(notebookUid)
+        && mNotebooks.value(notebookUid)->isVisible();
+    for (QHash<QString, Incidence::List>::ConstIterator it = series.constBegin();
+         it != series.constEnd(); it++) {
+        Incidence::List copies;
+        if (visible) {
+            QSet<QDateTime> recurrenceIds;
+            for (const Incidence::Ptr &incidence : it.value()) {
+                recurrenceIds.insert(incidence->recurrenceId());
+                // Recurring incidences may not have alarms but their exception may.
+                if (incidence->hasEnabledAlarms() || incidence->recurs()
+                    || incidence->hasRecurrenceId()) {
+                    copies.append(Incidence::Ptr(incidence->clone()));
+                }
+            }
+            const Incidence::List loaded = currentIncidencesWithAlarms(notebookUid, it.key());
+            for (const Incidence::Ptr &incidence : loaded) {
+                if (!recurrenceIds.contains(incidence->recurrenceId())) {
+                    copies.append(Incidence::Ptr(incidence->clone()));
+                }
+            }
+        }
+        mPendingAlarms.insert(QPair<QString, QString>(notebookUid, it.key()), copies);
+    }
+    if (!mPendingAlarms.isEmpty()) {
+        mAlarmTimer.start();
+    }
+}
+
+void ExtendedStorage::Private::flushAlarms()
+{
+    mAlarmTimer.stop();
+    if (mPendingAlarms.isEmpty()) {
+        return;
+    }
+
+    QSet<QPair<QString, QString>> uids;
+    for (QHash<QPair<QString, QString>, Incidence::List>::ConstIterator it = mPendingAlarms.constBegin();
+         it != mPendingAlarms.constEnd(); it++) {
+        uids.insert(it.key());
+    }
+    setupAlarms(uids);
+    mPendingAlarms.clear();
+}
+
 Incidence::List ExtendedStorage::Private::incidencesWithAlarms(const QString &notebookUid, const QString &uid)
+{
+    QHash<QPair<QString, QString>, Incidence::List>::ConstIterator it =
+        mPendingAlarms.constFind(QPair<QString, QString>(notebookUid, uid));
+    return it != mPendingAlarms.constEnd() ? *it
+        : currentIncidencesWithAlarms(notebookUid, uid);
+}
+
+Incidence::List ExtendedStorage::Private::currentIncidencesWithAlarms(const QString &notebookUid, const QString &uid)
 {
     Incidence::List list;
+    ensureNotebooks();
     if (!mNotebooks.contains(notebookUid)
         || !mNotebooks.value(notebookUid)->isVisible()) {
         return list;
@@ -133,7 +400,7 @@ Incidence::List ExtendedStorage::Private::incidencesWithAlarms(const QString &no
         // This case is called when changing notebook visibility.
         // There is no guarantee that the calendar contains all incidences.
         Incidence::List all;
-        mStorage->allIncidences(&all, notebookUid);
+        mStorage->alarmIncidences(&all, notebookUid, QDateTime::currentDateTimeUtc());
         for (Incidence::List::ConstIterator it = all.constBegin();
              it != all.constEnd(); it++) {
             // Recurring incidences may not have alarms but their exception may.
@@ -171,10 +438,17 @@ ExtendedStorage::ExtendedStorage(const ExtendedCalendar::Ptr &cal, bool validate
 #endif
 {
     cal->registerObserver(this);
+
+    bool ok = false;
+    int interval = qEnvironmentVariableIntValue("MKCAL_METRICS_DUMP", &ok);
+    if (ok && interval > 0) {
+        setMetricsDumpInterval(interval * 1000);
+    }
 }
 
 ExtendedStorage::~ExtendedStorage()
 {
+    d->flushAlarms();
     calendar()->unregisterObserver(this);
     delete d;
 }
@@ -198,7 +472,10 @@ bool ExtendedStorage::getLoadDates(const QDate &start, const QDate &end,
     loadEnd->setDate(end);   // may be null if end is not valid
 
     // Check the need to load from db.
-    for (const Range &loadedRange : d->mRanges) {
+    for (Range &loadedRange : d->mRanges) {
+        if (loadedRange.intersects(start, end)) {
+            loadedRange.mLastUse = ++d->mRangeClock;
+        }
         bool startIsIn = loadedRange.contains(loadStart->date())
             || (loadedRange.mStart.isNull() && loadStart->date().isNull());
         bool endIsIn = loadedRange.contains(loadEnd->date().addDays(-1))
@@ -227,11 +504,19 @@ bool ExtendedStorage::getLoadDates(const QDate &start, const QDate &end,
     return true;
 }
 
+void ExtendedStorage::addLoadedNotebook(const QString &notebookUid) const
+{
+    qCDebug(lcMkcal) << "set loaded notebook" << notebookUid;
+
+    d->mLoadedNotebooks.insert(notebookUid);
+}
+
 void ExtendedStorage::addLoadedRange(const QDate &start, const QDate &end) const
 {
     qCDebug(lcMkcal) << "set load dates" << start << end;
 
     Range range(start, end.addDays(-1));
+    range.mLastUse = ++d->mRangeClock;
     QList<Range>::Iterator it = d->mRanges.begin();
     while (it != d->mRanges.end()) {
         if (range < *it) {
@@ -241,6 +526,7 @@ void ExtendedStorage::addLoadedRange(const QDate &start, const QDate &end) const
             if (start < *it) {
                 it->mStart = start;
             }
+            it->mLastUse = range.mLastUse;
             return;
         } else if (start < *it) {
             it = d->mRanges.erase(it);
@@ -254,6 +540,162 @@ void ExtendedStorage::addLoadedRange(const QDate &start, const QDate &end) const
     d->mRanges.append(range);
 }
 
+void ExtendedStorage::setIncidenceBudget(int budget)
+{
+    d->mIncidenceBudget = budget;
+}
+
+int ExtendedStorage::incidenceBudget() const
+{
+    return d->mIncidenceBudget;
+}
+
+void ExtendedStorage::setMetricsEnabled(bool enabled)
+{
+    if (enabled && !d->mMetrics) {
+        d->mMetrics = new StorageMetrics;
+    } else if (!enabled && d->mMetrics) {
+        d->mMetricsTimer.stop();
+        delete d->mMetrics;
+        d->mMetrics = nullptr;
+    }
+}
+
+bool ExtendedStorage::metricsEnabled() const
+{
+    return d->mMetrics != nullptr;
+}
+
+StorageMetrics ExtendedStorage::metrics() const
+{
+    return d->mMetrics ? *d->mMetrics : StorageMetrics();
+}
+
+void ExtendedStorage::resetMetrics()
+{
+    if (d->mMetrics) {
+        *d->mMetrics = StorageMetrics();
+    }
+}
+
+void ExtendedStorage::setMetricsDumpInterval(int msec)
+{
+    if (msec > 0) {
+        setMetricsEnabled(true);
+        d->mMetricsTimer.start(msec);
+    } else {
+        d->mMetricsTimer.stop();
+    }
+}
+
+int ExtendedStorage::metricsDumpInterval() const
+{
+    return d->mMetricsTimer.isActive() ? d->mMetricsTimer.interval() : 0;
+}
+
+StorageMetrics *ExtendedStorage::metricsCollector() const
+{
+    return d->mMetrics;
+}
+
+static bool incidenceDates(const Incidence::Ptr &incidence, const QTimeZone &zone,
+                           QDate *start, QDate *end)
+{
+    QDateTime dtStart = incidence->dtStart();
+    QDateTime dtEnd = incidence->dateTime(IncidenceBase::RoleEnd);
+    if (!dtStart.isValid()) {
+        dtStart = dtEnd;
+    }
+    if (!dtEnd.isValid()) {
+        dtEnd = dtStart;
+    }
+    if (!dtStart.isValid()) {
+        return false;
+    }
+    *start = dtStart.toTimeZone(zone).date();
+    *end = dtEnd.toTimeZone(zone).date().addDays(1);
+    return true;
+}
+
+void ExtendedStorage::evictLoadedRanges(const QDate &start, const QDate &end)
+{
+    if (d->mIncidenceBudget <= 0) {
+        return;
+    }
+
+    const Range active(start, end.addDays(-1));
+    // Ranges with incidences that could not be unloaded stay loaded.
+    QList<Range> kept;
+    auto isKept = [&kept] (const Range &range) {
+        for (const Range &keptRange : kept) {
+            if (keptRange.mStart == range.mStart && keptRange.mEnd == range.mEnd) {
+                return true;
+            }
+        }
+        return false;
+    };
+    int count = calendar()->rawIncidences().count();
+    while (count > d->mIncidenceBudget) {
+        QList<Range>::Iterator lru = d->mRanges.end();
+        for (QList<Range>::Iterator it = d->mRanges.begin(); it != d->mRanges.end(); ++it) {
+            if (!it->intersects(start, end) && !isKept(*it)
+                && (lru == d->mRanges.end() || it->mLastUse < lru->mLastUse)) {
+                lru = it;
+            }
+        }
+        if (lru == d->mRanges.end()) {
+            qCDebug(lcMkcal) << "incidence budget exceeded, but no range to evict";
+            return;
+        }
+
+        // Recurring incidences and exceptions are kept since
+        // they are always loaded, see isRecurrenceLoaded(), as
+        // well as incidences of notebooks loaded as a whole.
+        Incidence::List list;
+        const Incidence::List all = calendar()->rawIncidences();
+        for (const Incidence::Ptr &incidence : all) {
+            QDate from, to;
+            if (incidence->recurs() || incidence->hasRecurrenceId()
+                || d->mLoadedNotebooks.contains(calendar()->notebook(incidence))
+                || !incidenceDates(incidence, calendar()->timeZone(), &from, &to)
+                || !lru->intersects(from, to)
+                || active.intersects(from, to)) {
+                continue;
+            }
+            bool isInOtherRange = false;
+            for (QList<Range>::ConstIterator it = d->mRanges.constBegin();
+                 it != d->mRanges.constEnd() && !isInOtherRange; ++it) {
+                isInOtherRange = (it != lru && it->intersects(from, to));
+            }
+            if (!isInOtherRange) {
+                list.append(incidence);
+            }
+        }
+        qCDebug(lcMkcal) << "evicting range" << lru->mStart << lru->mEnd
+                         << "with" << list.count() << "incidences";
+        if (!unloadIncidences(list)) {
+            return;
+        }
+        const int remaining = calendar()->rawIncidences().count();
+        if (count - remaining < list.count()) {
+            qCDebug(lcMkcal) << "keeping range" << lru->mStart << lru->mEnd
+                             << "with" << list.count() - count + remaining
+                             << "incidences with local changes";
+            kept.append(*lru);
+        } else {
+            d->mRanges.erase(lru);
+        }
+        count = remaining;
+    }
+}
+
+bool ExtendedStorage::unloadIncidences(const Incidence::List &list)
+{
+    UnloadIncidencesHookData data = {&list, false};
+    virtual_hook(UnloadIncidencesHook, &data);
+    return data.result;
+}
+
 bool ExtendedStorage::isRecurrenceLoaded() const
 {
     return d->mIsRecurrenceLoaded;
@@ -278,24 +720,20 @@ bool ExtendedStorage::load(const QString &uid, const QDateTime &recurrenceId)
     return load(uid);
 }
 
+bool ExtendedStorage::changesSince(int sequence, const QString &notebookUid,
+                                   Incidence::List *added,
+                                   Incidence::List *modified,
+                                   Incidence::List *deleted,
+                                   int *latest)
+{
+    ChangesSinceHookData data = {sequence, &notebookUid, added, modified, deleted, latest, false};
+    virtual_hook(ChangesSinceHook, &data);
+    return data.result;
+}
+
 bool ExtendedStorage::loadIncidenceInstance(const QString &instanceIdentifier)
 {
-    QString uid;
-    // At the moment, from KCalendarCore, if the instance is an exception,
-    // the instanceIdentifier will ends with yyyy-MM-ddTHH:mm:ss[Z|[+|-]HH:mm]
-    // This is tested in tst_loadIncidenceInstance() to ensure that any
-    // future breakage would be properly detected.
-    if (instanceIdentifier.endsWith('Z')) {
-        uid = instanceIdentifier.left(instanceIdentifier.length() - 20);
-    } else if (instanceIdentifier.length() > 19
-               && instanceIdentifier[instanceIdentifier.length() - 9] == 'T') {
-        uid = instanceIdentifier.left(instanceIdentifier.length() - 19);
-    } else if (instanceIdentifier.length() > 25
-               && instanceIdentifier[instanceIdentifier.length() - 3] == ':') {
-        uid = instanceIdentifier.left(instanceIdentifier.length() - 25);
-    } else {
-        uid = instanceIdentifier;
-    }
+    const QString uid = uidFromInstanceIdentifier(instanceIdentifier);
 
     // Even if we're looking for a specific incidence instance, we load all
     // the series for recurring event, to avoid orphaned exceptions in the
@@ -308,6 +746,15 @@ bool ExtendedStorage::load(const QDate &date)
     return date.isValid() && load(date, date.addDays(1));
 }
 
+bool ExtendedStorage::alarmIncidences(Incidence::List *list,
+                                      const QString &notebookUid,
+                                      const QDateTime &after)
+{
+    AlarmIncidencesHookData data = {list, &notebookUid, &after, false, false};
+    virtual_hook(AlarmIncidencesHook, &data);
+    return data.handled ? data.result : allIncidences(list, notebookUid);
+}
+
 void ExtendedStorageObserver::storageModified(ExtendedStorage *storage,
                                               const QString &info)
 {
@@ -334,39 +781,135 @@ void ExtendedStorageObserver::storageUpdated(ExtendedStorage *storage,
     Q_UNUSED(deleted);
 }
 
+void ExtendedStorageObserver2::storageNotebooksModified(ExtendedStorage *storage,
+                                                        const QString &info,
+                                                        const QStringList &notebookUids)
+{
+    Q_UNUSED(notebookUids);
+    storageModified(storage, info);
+}
+
+void ExtendedStorageObserver2::storageChanged(ExtendedStorage *storage,
+                                              const QString &info,
+                                              const StorageChange::List &changes)
+{
+    QStringList notebookUids;
+    for (const StorageChange &change : changes) {
+        if (!notebookUids.contains(change.notebookUid)) {
+            notebookUids.append(change.notebookUid);
+        }
+    }
+    storageNotebooksModified(storage, info, notebookUids);
+}
+
 void ExtendedStorage::registerObserver(ExtendedStorageObserver *observer)
 {
     if (!d->mObservers.contains(observer)) {
         d->mObservers.append(observer);
     }
+    d->mObservers2.remove(observer);
+    d->mObserverNotebooks.remove(observer);
+}
+
+void ExtendedStorage::registerObserver(ExtendedStorageObserver *observer,
+                                       const QStringList &notebookUids)
+{
+    registerObserver(observer);
+    d->mObserverNotebooks.insert(observer, notebookUids);
+}
+
+void ExtendedStorage::registerObserver(ExtendedStorageObserver2 *observer)
+{
+    registerObserver(static_cast<ExtendedStorageObserver *>(observer));
+    d->mObservers2.insert(observer, observer);
+}
+
+void ExtendedStorage::registerObserver(ExtendedStorageObserver2 *observer,
+                                       const QStringList &notebookUids)
+{
+    registerObserver(observer);
+    d->mObserverNotebooks.insert(observer, notebookUids);
 }
 
 void ExtendedStorage::unregisterObserver(ExtendedStorageObserver *observer)
 {
     d->mObservers.removeAll(observer);
+    d->mObservers2.remove(observer);
+    d->mObserverNotebooks.remove(observer);
 }
 
 void ExtendedStorage::emitStorageModified(const QString &info)
 {
+    emitStorageModified(info, QStringList());
+}
+
+void ExtendedStorage::emitStorageModified(const QString &info, const QStringList &notebookUids,
+                                          const StorageChange::List &changes)
+{
+    if (!changes.isEmpty() && d->applyChanges(changes)) {
+        MKCAL_TRACE("observer", "storageChanged");
+        foreach (ExtendedStorageObserver *observer, d->mObservers) {
+            if (!d->isInterested(observer, notebookUids)) {
+                continue;
+            }
+            ExtendedStorageObserver2 *observer2 = d->mObservers2.value(observer);
+            if (observer2) {
+                observer2->storageChanged(this, info, changes);
+            } else {
+                observer->storageModified(this, info);
+            }
+        }
+        return;
+    }
+
+    bool interested = false;
+    for (ExtendedStorageObserver *observer : d->mObservers) {
+        interested = interested || d->isInterested(observer, notebookUids);
+    }
+    interested = interested || notebookUids.isEmpty();
+    for (const QString &uid : notebookUids) {
+        interested = interested || !calendar()->incidences(uid).isEmpty()
+            || d->mLoadedNotebooks.contains(uid);
+    }
+    if (!interested) {
+        // Nothing in memory depends on the modified notebooks,
+        // only their properties need to be refreshed.
+        d->refreshNotebooks();
+        qCDebug(lcMkcal) << "no observer for modified notebooks" << notebookUids;
+        return;
+    }
+
     const QStringList list = d->mNotebooks.keys();
     for (const QString &uid : list) {
         if (!calendar()->deleteNotebook(uid)) {
             qCDebug(lcMkcal) << "notebook" << uid << "already removed from calendar";
         }
     }
+    const bool deferred = d->mNotebooksDeferred;
     calendar()->close();
     d->clear();
-    if (!loadNotebooks()) {
+    d->invalidateAlarms();
+    if (deferred) {
+        d->mNotebooksDeferred = true;
+    } else if (!loadNotebooks()) {
         qCWarning(lcMkcal) << "loading notebooks failed";
     }
 
+    MKCAL_TRACE("observer", "storageModified");
+    // The calendar has been reset, all observers need to reload.
     foreach (ExtendedStorageObserver *observer, d->mObservers) {
-        observer->storageModified(this, info);
+        ExtendedStorageObserver2 *observer2 = d->mObservers2.value(observer);
+        if (observer2) {
+            observer2->storageNotebooksModified(this, info, notebookUids);
+        } else {
+            observer->storageModified(this, info);
+        }
     }
 }
 
 void ExtendedStorage::emitStorageFinished(bool error, const QString &info)
 {
+    MKCAL_TRACE("observer", "storageFinished");
     foreach (ExtendedStorageObserver *observer, d->mObservers) {
         observer->storageFinished(this, error, info);
     }
@@ -376,20 +919,46 @@ void ExtendedStorage::emitStorageUpdated(const KCalendarCore::Incidence::List &a
                                          const KCalendarCore::Incidence::List &modified,
                                          const KCalendarCore::Incidence::List &deleted)
 {
-    foreach (ExtendedStorageObserver *observer, d->mObservers) {
-        observer->storageUpdated(this, added, modified, deleted);
+    emitStorageUpdated(added, modified, deleted, QString());
+}
+
+void ExtendedStorage::emitStorageUpdated(const KCalendarCore::Incidence::List &added,
+                                         const KCalendarCore::Incidence::List &modified,
+                                         const KCalendarCore::Incidence::List &deleted,
+                                         const QString &notebookUid)
+{
+    {
+        MKCAL_TRACE("observer", "storageUpdated");
+        foreach (ExtendedStorageObserver *observer, d->mObservers) {
+            observer->storageUpdated(this, added, modified, deleted);
+        }
     }
 
     QSet<QPair<QString, QString>> uids;
-    for (const Incidence::Ptr &incidence : added + modified + deleted) {
-        uids.insert(QPair<QString, QString>(calendar()->notebook(incidence),
+    for (const Incidence::Ptr &incidence : notebookUid.isEmpty() ? added + modified + deleted : deleted) {
+        uids.insert(QPair<QString, QString>(notebookUid.isEmpty()
+                                            ? calendar()->notebook(incidence) : notebookUid,
                                             incidence->uid()));
     }
-    d->setupAlarms(uids);
+    d->scheduleAlarms(uids);
+    if (!notebookUid.isEmpty()) {
+        d->scheduleAlarms(notebookUid, added + modified);
+    }
+}
+
+void ExtendedStorage::flushAlarms()
+{
+    d->flushAlarms();
+}
+
+void ExtendedStorage::invalidateAlarms()
+{
+    d->invalidateAlarms();
 }
 
 bool ExtendedStorage::addNotebook(const Notebook::Ptr &nb)
 {
+    d->ensureNotebooks();
     if (!nb || d->mNotebooks.contains(nb->uid())) {
         return false;
     }
@@ -409,6 +978,7 @@ bool ExtendedStorage::addNotebook(const Notebook::Ptr &nb)
 
 bool ExtendedStorage::updateNotebook(const Notebook::Ptr &nb)
 {
+    d->ensureNotebooks();
     if (!nb
         || !d->mNotebooks.contains(nb->uid())
         || d->mNotebooks.value(nb->uid()) != nb) {
@@ -425,6 +995,7 @@ bool ExtendedStorage::updateNotebook(const Notebook::Ptr &nb)
         return false;
     }
 
+    d->flushAlarms();
     if (wasVisible && !nb->isVisible()) {
         d->clearAlarms(nb->uid());
     } else if (!wasVisible && nb->isVisible()) {
@@ -436,6 +1007,7 @@ bool ExtendedStorage::updateNotebook(const Notebook::Ptr &nb)
 
 bool ExtendedStorage::deleteNotebook(const Notebook::Ptr &nb)
 {
+    d->ensureNotebooks();
     if (!nb || !d->mNotebooks.contains(nb->uid())) {
         return false;
     }
@@ -490,6 +1062,7 @@ bool ExtendedStorage::deleteNotebook(const Notebook::Ptr &nb)
 
 bool ExtendedStorage::setDefaultNotebook(const Notebook::Ptr &nb)
 {
+    d->ensureNotebooks();
     d->mDefaultNotebook = nb;
 
     if (!nb
@@ -507,19 +1080,32 @@ bool ExtendedStorage::setDefaultNotebook(const Notebook::Ptr &nb)
 
 Notebook::Ptr ExtendedStorage::defaultNotebook()
 {
+    d->ensureNotebooks();
     return d->mDefaultNotebook;
 }
 
 Notebook::List ExtendedStorage::notebooks()
 {
+    d->ensureNotebooks();
     return d->mNotebooks.values();
 }
 
 Notebook::Ptr ExtendedStorage::notebook(const QString &uid) const
 {
+    d->ensureNotebooks();
     return d->mNotebooks.value(uid);
 }
 
+void ExtendedStorage::deferNotebookLoading()
+{
+    d->mNotebooksDeferred = true;
+}
+
+bool ExtendedStorage::loadDeferredNotebooks()
+{
+    return d->ensureNotebooks();
+}
+
 void ExtendedStorage::setValidateNotebooks(bool validateNotebooks)
 {
     d->mValidateNotebooks = validateNotebooks;
@@ -35,6 +35,7 @@
 #include "extendedcalendar.h"
 #include "extendedstorageobserver.h"
 #include "notebook.h"
+#include "storagemetrics.h"
 
 #include <KCalendarCore/CalStorage>
 #include <KCalendarCore/Calendar>
@@ -315,6 +316,36 @@ public:
                                    const QDateTime &after = QDateTime(),
                                    const QString &notebookUid = QString()) = 0;
 
+    /**
+      Get the incidences added, modified and marked as deleted in
+      storage after a given change sequence. Unlike insertedIncidences(),
+      modifiedIncidences() and deletedIncidences(), sequences do not
+      depend on the device clock. Incidences removed from storage,
+      with PurgeDeleted or purgeDeletedIncidences(), are not reported.
+
+      @param sequence list changes done after this sequence, use the
+             value returned in @p latest by the previous call, or -1
+             to list all incidences
+      @param notebookUid list only incidences for given notebook
+      @param added incidences created after @p sequence, can be null
+      @param modified incidences created before and modified after
+             @p sequence, can be null
+      @param deleted incidences created before and marked as deleted
+             after @p sequence, can be null. When all lists are null,
+             only @p latest is read.
+      @param latest the sequence of the last change in storage
+      @return true on success, false if the storage does not
+              support change sequences
+
+      Implementations provide it with virtual_hook(), see
+      ChangesSinceHook.
+    */
+    bool changesSince(int sequence, const QString &notebookUid,
+                      KCalendarCore::Incidence::List *added,
+                      KCalendarCore::Incidence::List *modified,
+                      KCalendarCore::Incidence::List *deleted,
+                      int *latest);
+
     /**
       Get all incidences from storage.
 
@@ -325,6 +356,26 @@ public:
     virtual bool allIncidences(KCalendarCore::Incidence::List *list,
                                const QString &notebookUid = QString()) = 0;
 
+    /**
+      Get the incidences of a notebook that may trigger alarms at
+      or after a given time. Recurring incidences are returned with
+      all their exceptions. The list may contain more incidences
+      than strictly needed, like recurring ones without alarms,
+      but never less.
+
+      Implementations provide it with virtual_hook(), see
+      AlarmIncidencesHook. Otherwise, all incidences of the notebook
+      are returned, see allIncidences().
+
+      @param list incidences with alarms
+      @param notebookUid list incidences for given notebook
+      @param after list only incidences with alarms triggering after this time
+      @return true on success
+    */
+    bool alarmIncidences(KCalendarCore::Incidence::List *list,
+                         const QString &notebookUid,
+                         const QDateTime &after);
+
     /**
       Get all incidences from storage that match key. Incidences are
       loaded into the associated ExtendedCalendar. More incidences than
@@ -368,6 +419,51 @@ public:
      */
     void registerObserver(ExtendedStorageObserver *observer);
 
+    /**
+      Registers an Observer for modifications done to some notebooks only.
+      When modifications from external processes only concern other
+      notebooks, that none of the registered observers are interested in
+      and that have no incidences loaded, the calendar is not reset and the
+      observers are not notified.
+
+      @param observer is a pointer to an Observer object that will be
+      watching this Storage.
+      @param notebookUids the notebooks the observer is interested in.
+
+      @see unregisterObserver()
+     */
+    void registerObserver(ExtendedStorageObserver *observer,
+                          const QStringList &notebookUids);
+
+    /**
+      Registers an Observer for this Storage, that is notified with
+      ExtendedStorageObserver2::storageNotebooksModified() and
+      ExtendedStorageObserver2::storageChanged() instead of
+      ExtendedStorageObserver::storageModified().
+
+      @param observer is a pointer to an Observer object that will be
+      watching this Storage.
+
+      @see unregisterObserver()
+     */
+    void registerObserver(ExtendedStorageObserver2 *observer);
+
+    /**
+      Registers an Observer for modifications done to some notebooks
+      only, that is notified with
+      ExtendedStorageObserver2::storageNotebooksModified() and
+      ExtendedStorageObserver2::storageChanged().
+
+      @param observer is a pointer to an Observer object that will be
+      watching this Storage.
+      @param notebookUids the notebooks the observer is interested in.
+
+      @see registerObserver(ExtendedStorageObserver *, const QStringList &)
+      @see unregisterObserver()
+     */
+    void registerObserver(ExtendedStorageObserver2 *observer,
+                          const QStringList &notebookUids);
+
     /**
       Unregisters an Observer for this Storage.
 
@@ -482,6 +578,101 @@ public:
     Notebook::Ptr createDefaultNotebook(QString name = QString(),
                                         QString color = QString());
 
+    /**
+      Set the maximum number of incidences the associated calendar
+      should hold when loading by date ranges. When a call to
+      load(const QDate &, const QDate &) makes the calendar exceed this
+      budget, the least recently used loaded ranges that don't intersect
+      the requested one are unloaded, until the budget is met again.
+
+      Incidences with pending local changes, recurring incidences and
+      their exceptions are never unloaded.
+
+      @param budget the maximum number of incidences, 0 (default)
+             means no limit.
+    */
+    void setIncidenceBudget(int budget);
+
+    /**
+      Returns the maximum number of incidences the associated calendar
+      should hold when loading by date ranges, 0 means no limit.
+
+      @see setIncidenceBudget()
+    */
+    int incidenceBudget() const;
+
+    /**
+      Alarms of incidences modified by save() or reported by
+      emitStorageUpdated() are not scheduled immediately. The
+      modified series are collected for a short time and their
+      alarms are updated at once, from the event loop.
+
+      Call this method to schedule pending alarms synchronously,
+      for instance before leaving a process without event loop.
+    */
+    void flushAlarms();
+
+    /**
+      Remove the given incidences from memory, without marking them
+      as deleted. They can be loaded again later. Incidences with
+      pending changes are not unloaded.
+
+      This is dispatched to implementations with virtual_hook(),
+      see UnloadIncidencesHook.
+
+      @param list the incidences to unload
+      @return false if unloading is not supported by the storage.
+    */
+    bool unloadIncidences(const KCalendarCore::Incidence::List &list);
+
+    /**
+      Enable or disable the collection of metrics on the storage
+      operations. Metrics are disabled by default, unless the
+      MKCAL_METRICS_DUMP environment variable is set, see
+      setMetricsDumpInterval(). Disabling metrics discards the
+      collected values.
+
+      @param enabled true to collect metrics
+    */
+    void setMetricsEnabled(bool enabled);
+
+    /**
+      Returns true if metrics are collected.
+
+      @see setMetricsEnabled()
+    */
+    bool metricsEnabled() const;
+
+    /**
+      Returns the metrics collected since they have been enabled
+      or since the last call to resetMetrics().
+
+      @return a snapshot of the metrics, all zero if disabled
+    */
+    StorageMetrics metrics() const;
+
+    /**
+      Set all collected metrics back to zero.
+    */
+    void resetMetrics();
+
+    /**
+      Set the interval at which the collected metrics are
+      printed in the logs, with the org.kde.pim.mkcal category.
+      A non null interval enables the metrics. Its initial
+      value is read in seconds from the MKCAL_METRICS_DUMP
+      environment variable.
+
+      @param msec the interval in milliseconds, 0 to stop dumping
+    */
+    void setMetricsDumpInterval(int msec);
+
+    /**
+      Returns the interval at which the collected metrics are
+      printed, 0 if they are not.
+    */
+    int metricsDumpInterval() const;
+
     /**
       Standard trick to add virtuals later.
 
@@ -501,14 +692,99 @@ protected:
                       QDateTime *loadStart, QDateTime *loadEnd) const;
 
     void addLoadedRange(const QDate &start, const QDate &end) const;
+    void addLoadedNotebook(const QString &notebookUid) const;
     bool isRecurrenceLoaded() const;
     void setIsRecurrenceLoaded(bool loaded);
 
+    /**
+      Unload the least recently used ranges until the calendar
+      holds no more than incidenceBudget() incidences. Ranges
+      intersecting [start, end[ are never unloaded.
+    */
+    void evictLoadedRanges(const QDate &start, const QDate &end);
+
+    /**
+      Identifiers of the calls dispatched to implementations with
+      virtual_hook(). Implementations should ignore unknown identifiers.
+    */
+    enum VirtualHookId {
+        /**
+          Data is an UnloadIncidencesHookData, see unloadIncidences().
+        */
+        UnloadIncidencesHook = 1,
+        /**
+          Data is an AlarmIncidencesHookData, see alarmIncidences().
+          Set handled to true when supported.
+        */
+        AlarmIncidencesHook,
+        /**
+          Data is a ChangesSinceHookData, see changesSince().
+        */
+        ChangesSinceHook
+    };
+
+    struct UnloadIncidencesHookData {
+        const KCalendarCore::Incidence::List *list;
+        bool result;
+    };
+
+    struct AlarmIncidencesHookData {
+        KCalendarCore::Incidence::List *list;
+        const QString *notebookUid;
+        const QDateTime *after;
+        bool handled;
+        bool result;
+    };
+
+    struct ChangesSinceHookData {
+        int sequence;
+        const QString *notebookUid;
+        KCalendarCore::Incidence::List *added;
+        KCalendarCore::Incidence::List *modified;
+        KCalendarCore::Incidence::List *deleted;
+        int *latest;
+        bool result;
+    };
+
+    /**
+      The metrics to update by implementations, null when
+      metrics are disabled.
+    */
+    StorageMetrics *metricsCollector() const;
+
+    /**
+      Defers loadNotebooks() until the notebooks are first used,
+      through the notebook accessors or loadDeferredNotebooks().
+    */
+    void deferNotebookLoading();
+
+    /**
+      Loads the notebooks now if their loading has been deferred.
+
+      @return false if the loading failed.
+    */
+    bool loadDeferredNotebooks();
+
+    /**
+      To be called by implementations when alarms have been
+      scheduled by another process, so they are fetched again
+      from the alarm backend on next use.
+    */
+    void invalidateAlarms();
+
     void emitStorageModified(const QString &info);
+    void emitStorageModified(const QString &info, const QStringList &notebookUids,
+                             const StorageChange::List &changes = StorageChange::List());
     void emitStorageFinished(bool error, const QString &info);
     void emitStorageUpdated(const KCalendarCore::Incidence::List &added,
                             const KCalendarCore::Incidence::List &modified,
                             const KCalendarCore::Incidence::List &deleted);
+    // For incidences of @p notebookUid that may not be in the calendar,
+    // their alarms are scheduled from the given incidences.
+    void emitStorageUpdated(const KCalendarCore::Incidence::List &added,
+                            const KCalendarCore::Incidence::List &modified,
+                            const KCalendarCore::Incidence::List &deleted,
+                            const QString &notebookUid);
 
 private:
     //@cond PRIVATE
@@ -32,12 +32,47 @@
 #define MKCAL_STORAGEOBSERVER_H
 
 #include <QString>
+#include <QStringList>
 #include <KCalendarCore/Incidence>
 
 
 namespace mKCal {
 class ExtendedStorage;
 
+/**
+   @struct StorageChange
+
+   A modification done to a storage by another process, as
+   given by ExtendedStorageObserver2::storageChanged().
+*/
+struct StorageChange
+{
+    enum Operation {
+        Added,
+        Modified,
+        Deleted
+    };
+    typedef QList<StorageChange> List;
+
+    /**
+       The transaction of the modification.
+    */
+    int transactionId;
+
+    /**
+       The notebook of the incidence, or the modified notebook.
+    */
+    QString notebookUid;
+
+    /**
+       The instance identifier of the incidence, empty for
+       modifications done to the notebook itself.
+    */
+    QString instanceIdentifier;
+
+    Operation operation;
+};
+
 /**
    @class ExtendedStorageObserver
 
@@ -95,5 +130,61 @@ public:
                                 const KCalendarCore::Incidence::List &deleted);
 };
 
+/**
+   @class ExtendedStorageObserver2
+
+   An ExtendedStorageObserver also notified of the notebooks modified
+   by external processes, and of the modifications themselves. Its
+   additional notifications are only delivered when registered with
+   ExtendedStorage::registerObserver(ExtendedStorageObserver2 *).
+*/
+class MKCAL_EXPORT ExtendedStorageObserver2 : public ExtendedStorageObserver //krazy:exclude=dpointer
+{
+public:
+    /**
+       Destructor.
+    */
+    virtual ~ExtendedStorageObserver2() {}
+
+    /**
+       Notify the Observer that a Storage has been modified by an external
+       process, in the given notebooks. It is called instead of
+       storageModified(). The calendar has been reset, so every observer is
+       notified, including the ones registered for other notebooks only.
+       When the calendar does not need to be reset, because the modified
+       notebooks have no incidences in memory and no observer registered
+       for them, observers are not notified at all, see
+       ExtendedStorage::registerObserver().
+
+       The default implementation calls storageModified().
+
+       @param storage is a pointer to the ExtendedStorage object that
+       is being observed.
+       @param info uids inserted/updated/deleted, modified file etc.
+       @param notebookUids the uids of the modified notebooks, empty
+       when they are not known.
+    */
+    virtual void storageNotebooksModified(ExtendedStorage *storage, const QString &info,
+                                          const QStringList &notebookUids);
+
+    /**
+       Notify the Observer that a Storage has been modified by an external
+       process, with the list of modifications. It is called instead of
+       storageModified(). The calendar has already been updated for these
+       modifications, it is not reset as for storageNotebooksModified().
+       Observers registered for a set of notebooks only are not notified
+       of modifications to other notebooks.
+
+       The default implementation calls storageNotebooksModified().
+
+       @param storage is a pointer to the ExtendedStorage object that
+       is being observed.
+       @param info uids inserted/updated/deleted, modified file etc.
+       @param changes the modifications, in the order they were done.
+    */
+    virtual void storageChanged(ExtendedStorage *storage, const QString &info,
+                                const StorageChange::List &changes);
+};
+
 }
 #endif /* !MKCAL_STORAGEOBSERVER_H */
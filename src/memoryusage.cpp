@@ -0,0 +1,309 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "memoryusage.h"
+#include "memoryusage_p.h"
+
+#include <KCalendarCore/Recurrence>
+
+using namespace KCalendarCore;
+using namespace mKCal;
+
+// The private data of KCalendarCore objects is not public, these
+// are rough sizes of them on 64 bit builds, without their strings.
+static const quint64 PointerScale = sizeof(void*);
+static const quint64 IncidenceBytes = 96 * PointerScale;
+static const quint64 AttendeeBytes = 16 * PointerScale;
+static const quint64 AlarmBytes = 32 * PointerScale;
+static const quint64 AttachmentBytes = 8 * PointerScale;
+static const quint64 RecurrenceBytes = 24 * PointerScale;
+static const quint64 RecurrenceRuleBytes = 40 * PointerScale;
+static const quint64 DateTimeBytes = 2 * PointerScale;
+// A shared array header, as used by QString, QByteArray and containers.
+static const quint64 ArrayBytes = 3 * PointerScale;
+// A node of a QMap or a QHash, without its key and value.
+static const quint64 NodeBytes = 4 * PointerScale;
+
+namespace {
+
+class StringCounter
+{
+public:
+    StringCounter(quint64 *total)
+        : mTotal(total)
+    {
+    }
+
+    quint64 bytes() const
+    {
+        return mBytes;
+    }
+
+    void add(const QString &string)
+    {
+        if (!string.isEmpty()) {
+            count(ArrayBytes + quint64(string.capacity() + 1) * sizeof(QChar));
+        }
+    }
+
+    void add(const QByteArray &array)
+    {
+        if (!array.isEmpty()) {
+            count(ArrayBytes + quint64(array.capacity() + 1));
+        }
+    }
+
+    void add(const QStringList &list)
+    {
+        if (!list.isEmpty()) {
+            mBytes += ArrayBytes + quint64(list.count()) * sizeof(QString);
+            for (const QString &string : list) {
+                add(string);
+            }
+        }
+    }
+
+    void add(const QMap<QByteArray, QString> &properties)
+    {
+        for (QMap<QByteArray, QString>::ConstIterator it = properties.constBegin();
+             it != properties.constEnd(); it++) {
+            mBytes += NodeBytes;
+            add(it.key());
+            add(it.value());
+        }
+    }
+
+private:
+    void count(quint64 bytes)
+    {
+        mBytes += bytes;
+        *mTotal += bytes;
+    }
+
+    quint64 *mTotal;
+    quint64 mBytes = 0;
+};
+
+}
+
+MemoryUsage::MemoryUsage()
+    : d(new MemoryUsage::Private)
+{
+}
+
+MemoryUsage::MemoryUsage(const MemoryUsage &other)
+    : d(new MemoryUsage::Private(*other.d))
+{
+}
+
+MemoryUsage::~MemoryUsage()
+{
+    delete d;
+}
+
+MemoryUsage &MemoryUsage::operator=(const MemoryUsage &other)
+{
+    if (&other == this) {
+        return *this;
+    }
+    *d = *other.d;
+    return *this;
+}
+
+quint64 MemoryUsage::count(Category category) const
+{
+    return category < CategoryCount ? d->usages[category].count : 0;
+}
+
+quint64 MemoryUsage::bytes(Category category) const
+{
+    return category < CategoryCount ? d->usages[category].bytes : 0;
+}
+
+quint64 MemoryUsage::size(Size size) const
+{
+    return size < SizeCount ? d->sizes[size] : 0;
+}
+
+QStringList MemoryUsage::notebookUids() const
+{
+    return d->notebooks.keys();
+}
+
+quint64 MemoryUsage::count(const QString &notebookUid) const
+{
+    return d->notebooks.value(notebookUid).count;
+}
+
+quint64 MemoryUsage::bytes(const QString &notebookUid) const
+{
+    return d->notebooks.value(notebookUid).bytes;
+}
+
+void MemoryUsage::addIncidence(const Incidence::Ptr &incidence,
+                               const QString &notebookUid)
+{
+    if (!incidence) {
+        return;
+    }
+
+    quint64 *stringBytes = &d->sizes[StringBytes];
+    MemoryUsage::Private::Usage *usages = d->usages;
+    StringCounter texts(stringBytes);
+    texts.add(incidence->uid());
+    texts.add(incidence->summary());
+    texts.add(incidence->description());
+    texts.add(incidence->location());
+    texts.add(incidence->categories());
+    texts.add(incidence->comments());
+    texts.add(incidence->contacts());
+    texts.add(incidence->relatedTo());
+    texts.add(incidence->schedulingID());
+    texts.add(incidence->customStatus());
+    texts.add(incidence->organizer().name());
+    texts.add(incidence->organizer().email());
+    quint64 bytes = IncidenceBytes + texts.bytes();
+
+    for (const Attendee &attendee : incidence->attendees()) {
+        StringCounter attendeeTexts(stringBytes);
+        attendeeTexts.add(attendee.name());
+        attendeeTexts.add(attendee.email());
+        attendeeTexts.add(attendee.uid());
+        attendeeTexts.add(attendee.delegate());
+        attendeeTexts.add(attendee.delegator());
+        attendeeTexts.add(attendee.customProperties().customProperties());
+        usages[Attendees].add(AttendeeBytes + attendeeTexts.bytes());
+        bytes += AttendeeBytes + attendeeTexts.bytes();
+    }
+
+    for (const Alarm::Ptr &alarm : incidence->alarms()) {
+        StringCounter alarmTexts(stringBytes);
+        alarmTexts.add(alarm->text());
+        alarmTexts.add(alarm->programFile());
+        alarmTexts.add(alarm->programArguments());
+        alarmTexts.add(alarm->audioFile());
+        alarmTexts.add(alarm->mailSubject());
+        alarmTexts.add(alarm->mailText());
+        alarmTexts.add(alarm->mailAttachments());
+        for (const Person &address : alarm->mailAddresses()) {
+            alarmTexts.add(address.name());
+            alarmTexts.add(address.email());
+        }
+        alarmTexts.add(alarm->customProperties());
+        usages[Alarms].add(AlarmBytes + alarmTexts.bytes());
+        bytes += AlarmBytes + alarmTexts.bytes();
+    }
+
+    for (const Attachment &attachment : incidence->attachments()) {
+        StringCounter attachmentTexts(stringBytes);
+        attachmentTexts.add(attachment.uri());
+        attachmentTexts.add(attachment.data());
+        attachmentTexts.add(attachment.label());
+        attachmentTexts.add(attachment.mimeType());
+        usages[Attachments].add(AttachmentBytes + attachmentTexts.bytes());
+        bytes += AttachmentBytes + attachmentTexts.bytes();
+    }
+
+    const QMap<QByteArray, QString> properties = incidence->customProperties();
+    if (!properties.isEmpty()) {
+        StringCounter propertyTexts(stringBytes);
+        propertyTexts.add(properties);
+        usages[CustomProperties].count += properties.count();
+        usages[CustomProperties].bytes += propertyTexts.bytes();
+        bytes += propertyTexts.bytes();
+    }
+
+    if (incidence->recurs()) {
+        const Recurrence *recurrence = incidence->recurrence();
+        const quint64 recurrenceBytes = RecurrenceBytes
+            + quint64(recurrence->rRules().count() + recurrence->exRules().count()) * RecurrenceRuleBytes
+            + quint64(recurrence->rDates().count() + recurrence->exDates().count()) * sizeof(QDate)
+            + quint64(recurrence->rDateTimes().count() + recurrence->exDateTimes().count()) * DateTimeBytes;
+        usages[Recurrences].add(recurrenceBytes);
+        bytes += recurrenceBytes;
+    }
+
+    usages[Incidences].add(bytes);
+    switch (incidence->type()) {
+    case IncidenceBase::TypeEvent:
+        usages[Events].add(bytes);
+        break;
+    case IncidenceBase::TypeTodo:
+        usages[Todos].add(bytes);
+        break;
+    case IncidenceBase::TypeJournal:
+        usages[Journals].add(bytes);
+        break;
+    default:
+        break;
+    }
+    d->notebooks[notebookUid].add(bytes);
+}
+
+quint64 MemoryUsage::totalBytes() const
+{
+    return bytes(Incidences) + bytes(Statements) + size(PageCacheBytes) + size(SchemaBytes)
+        + bytes(PendingInserts) + bytes(PendingUpdates) + bytes(PendingDeletes);
+}
+
+static QString usageString(const char *name, quint64 count, quint64 bytes)
+{
+    return QString::fromLatin1("%1: %2, %3 bytes\n")
+        .arg(QString::fromLatin1(name)).arg(count).arg(bytes);
+}
+
+QString MemoryUsage::toString() const
+{
+    static const struct {
+        const char *name;
+        Category category;
+    } incidenceParts[] = {
+        {"incidences", Incidences},
+        {"  events", Events},
+        {"  todos", Todos},
+        {"  journals", Journals},
+        {"  attendees", Attendees},
+        {"  alarms", Alarms},
+        {"  attachments", Attachments},
+        {"  custom properties", CustomProperties},
+        {"  recurrences", Recurrences}
+    };
+
+    QString out;
+    for (const auto &part : incidenceParts) {
+        out += usageString(part.name, count(part.category), bytes(part.category));
+    }
+    out += QString::fromLatin1("  strings: %1 bytes\n").arg(size(StringBytes));
+    for (QHash<QString, MemoryUsage::Private::Usage>::ConstIterator it = d->notebooks.constBegin();
+         it != d->notebooks.constEnd(); it++) {
+        out += QString::fromLatin1("  notebook %1: %2, %3 bytes\n")
+            .arg(it.key()).arg(it->count).arg(it->bytes);
+    }
+    out += usageString("prepared statements", count(Statements), bytes(Statements));
+    out += QString::fromLatin1("page cache: %1 bytes\n").arg(size(PageCacheBytes));
+    out += QString::fromLatin1("schema: %1 bytes\n").arg(size(SchemaBytes));
+    out += usageString("pending inserts", count(PendingInserts), bytes(PendingInserts));
+    out += usageString("pending updates", count(PendingUpdates), bytes(PendingUpdates));
+    out += usageString("pending deletes", count(PendingDeletes), bytes(PendingDeletes));
+    out += QString::fromLatin1("sqlite heap (process): %1 bytes\n").arg(size(SqliteHeapBytes));
+    out += QString::fromLatin1("total: %1 bytes").arg(totalBytes());
+    return out;
+}
@@ -0,0 +1,172 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the MemoryUsage class.
+*/
+
+#ifndef MKCAL_MEMORYUSAGE_H
+#define MKCAL_MEMORYUSAGE_H
+
+#include "mkcal_export.h"
+
+#include <KCalendarCore/Incidence>
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+namespace mKCal {
+
+/**
+  @brief
+  An estimation of the memory held by a calendar and its storage,
+  see ExtendedCalendar::memoryUsage() and SqliteStorage::memoryUsage().
+
+  Calendar sizes are estimated from the content of the incidences
+  and the size of the objects holding it, they do not account for
+  the allocator overhead. Storage sizes are reported by sqlite.
+*/
+class MKCAL_EXPORT MemoryUsage
+{
+public:
+    /**
+      The objects that are counted, with the bytes they hold.
+    */
+    enum Category {
+        /**
+          All incidences, including their parts listed below.
+        */
+        Incidences,
+        Events,
+        Todos,
+        Journals,
+        /**
+          Parts of the incidences.
+        */
+        Attendees,
+        Alarms,
+        Attachments,
+        CustomProperties,
+        Recurrences,
+        /**
+          The prepared statements of the storage connection.
+        */
+        Statements,
+        /**
+          Incidences waiting to be saved. The incidences themselves
+          are counted in the calendar, only the hash entries are
+          counted here.
+        */
+        PendingInserts,
+        PendingUpdates,
+        PendingDeletes,
+        CategoryCount
+    };
+
+    /**
+      The sizes that are measured without a number of objects.
+    */
+    enum Size {
+        /**
+          Bytes of text in all the incidences and their parts.
+        */
+        StringBytes,
+        /**
+          Memory used by sqlite for the page cache and the schema
+          of the storage connection.
+        */
+        PageCacheBytes,
+        SchemaBytes,
+        /**
+          Memory allocated by sqlite in the whole process.
+        */
+        SqliteHeapBytes,
+        SizeCount
+    };
+
+    /**
+      Constructs an empty usage.
+    */
+    MemoryUsage();
+
+    MemoryUsage(const MemoryUsage &other);
+
+    ~MemoryUsage();
+
+    MemoryUsage &operator=(const MemoryUsage &other);
+
+    /**
+      Number of objects of @p category.
+    */
+    quint64 count(Category category) const;
+
+    /**
+      Bytes held by the objects of @p category.
+    */
+    quint64 bytes(Category category) const;
+
+    /**
+      The value of @p size, in bytes.
+    */
+    quint64 size(Size size) const;
+
+    /**
+      The uids of the notebooks with counted incidences.
+    */
+    QStringList notebookUids() const;
+
+    /**
+      Number of incidences of the notebook @p notebookUid.
+    */
+    quint64 count(const QString &notebookUid) const;
+
+    /**
+      Bytes held by the incidences of the notebook @p notebookUid.
+    */
+    quint64 bytes(const QString &notebookUid) const;
+
+    /**
+      Adds the estimated size of @p incidence to the calendar counters.
+    */
+    void addIncidence(const KCalendarCore::Incidence::Ptr &incidence,
+                      const QString &notebookUid);
+
+    /**
+      The estimated bytes held by the calendar and the storage.
+    */
+    quint64 totalBytes() const;
+
+    /**
+      A multi-line human readable summary.
+    */
+    QString toString() const;
+
+private:
+    //@cond PRIVATE
+    class Private;
+    Private *const d;
+    //@endcond
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MKCAL_MEMORYUSAGE_P_H
+#define MKCAL_MEMORYUSAGE_P_H
+
+#include "memoryusage.h"
+
+#include <QtCore/QHash>
+
+namespace mKCal {
+
+class MemoryUsage::Private
+{
+public:
+    /*
+      A number of objects and the bytes they hold.
+    */
+    struct Usage
+    {
+        quint64 count = 0;
+        quint64 bytes = 0;
+
+        void add(quint64 size)
+        {
+            count += 1;
+            bytes += size;
+        }
+    };
+
+    Usage usages[MemoryUsage::CategoryCount];
+    // Incidences by notebook uid.
+    QHash<QString, Usage> notebooks;
+    quint64 sizes[MemoryUsage::SizeCount] = {};
+
+    static Private *get(MemoryUsage *usage)
+    {
+        return usage ? usage->d : nullptr;
+    }
+};
+
+}
+
+#endif
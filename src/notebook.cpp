@@ -531,3 +531,19 @@ QList<QByteArray> Notebook::customPropertyKeys() const
 {
     return d->mCustomProperties.keys();
 }
+
+static const QByteArray TOMBSTONE_RETENTION("tombstoneRetentionDays");
+static const int DEFAULT_TOMBSTONE_RETENTION = 30;
+
+int Notebook::tombstoneRetentionDays() const
+{
+    bool ok = false;
+    const int days = d->mCustomProperties.value(TOMBSTONE_RETENTION).toInt(&ok);
+    return ok ? days : DEFAULT_TOMBSTONE_RETENTION;
+}
+
+void Notebook::setTombstoneRetentionDays(int days)
+{
+    setCustomProperty(TOMBSTONE_RETENTION, days == DEFAULT_TOMBSTONE_RETENTION
+                      ? QString() : QString::number(days));
+}
@@ -424,6 +424,28 @@ public:
     */
     QList<QByteArray> customPropertyKeys() const;
 
+    /**
+      Returns the number of days incidences marked as deleted are kept
+      in storage, 30 by default, see SqliteStorage::purgeExpiredTombstones().
+      For notebooks with a synchronization plugin or account, the days
+      are counted from their last synchronization, see syncDate(), and
+      incidences are kept when the notebook was never synchronized.
+      A negative value means they are kept until purged explicitly
+      with ExtendedStorage::purgeDeletedIncidences().
+      @see setTombstoneRetentionDays().
+    */
+    int tombstoneRetentionDays() const;
+
+    /**
+      Sets the number of days incidences marked as deleted are kept
+      in storage. Synchronization plugins should keep them at least
+      as long as the interval between two synchronizations.
+      The value is saved as a custom property.
+      @param days number of days, or a negative value to keep them.
+      @see tombstoneRetentionDays().
+    */
+    void setTombstoneRetentionDays(int days);
+
     /**
       Assignment operator.
      */
@@ -31,12 +31,15 @@
 
 #include "semaphore_p.h"
 #include "logging_p.h"
+#include "storagemetrics_p.h"
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <libgen.h>
 
 #include <sys/sem.h>
+#include <sys/shm.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
@@ -57,15 +60,24 @@ void semaphoreError(const char *msg, const char *id, int error)
                  error).toUtf8().constData();
 }
 
-int semaphoreInit(const char *id, size_t count, const int *initialValues)
+key_t semaphoreKey(const char *id, int projectId)
 {
-    int rv = -1;
-
-    // the specific value of proj_id is unimportant except that it must be non-zero, so 5?
     char *filepath = ::strdup(id);
     char *dirpath = ::dirname(filepath);
-    key_t key = ::ftok(dirpath, 5);
+    key_t key = ::ftok(dirpath, projectId);
     ::free(filepath);
+    return key;
+}
+
+// the specific value of proj_id is unimportant except that it must be non-zero, so 5?
+const int semaphoreProjectId = 5;
+const int recordProjectId = 6;
+
+int semaphoreInit(const char *id, size_t count, const int *initialValues)
+{
+    int rv = -1;
+
+    key_t key = semaphoreKey(id, semaphoreProjectId);
 
     rv = ::semget(key, count, 0);
     if (rv == -1) {
@@ -196,6 +208,16 @@ QString Semaphore::errorString() const
     return m_errorString;
 }
 
+// Written by the process holding the lock, in a shared memory
+// segment, so that other processes can tell who holds the lock
+// and since when.
+struct LockRecord
+{
+    qint64 pid;
+    qint64 since; // monotonic clock, in microseconds
+    char operation[32];
+};
+
 static const int initialSemaphoreValues[] = { 1, 0, 1 };
 
 static size_t databaseOwnershipIndex = 0;
@@ -209,7 +231,19 @@ static size_t writeAccessIndex = 2;
 ProcessMutex::ProcessMutex(const QString &path)
     : m_semaphore(path.toLatin1(), 3, initialSemaphoreValues)
     , m_initialProcess(false)
+    , m_record(nullptr)
+    , m_acquiredAt(0)
 {
+    // The lock record is a diagnostic help, ignore failures.
+    int shm = ::shmget(semaphoreKey(path.toLatin1().constData(), recordProjectId),
+                       sizeof(LockRecord), IPC_CREAT | S_IRWXO | S_IRWXG | S_IRWXU);
+    if (shm != -1) {
+        void *address = ::shmat(shm, nullptr, 0);
+        if (address != reinterpret_cast<void*>(-1)) {
+            m_record = static_cast<LockRecord*>(address);
+        }
+    }
+
     if (!m_semaphore.isValid()) {
         qCWarning(lcMkcal) << "Unable to create semaphore array!";
     } else {
@@ -227,13 +261,49 @@ ProcessMutex::ProcessMutex(const QString &path)
     }
 }
 
+ProcessMutex::~ProcessMutex()
+{
+    if (m_record) {
+        ::shmdt(m_record);
+    }
+}
+
 bool ProcessMutex::acquire()
 {
-    return m_semaphore.decrement(writeAccessIndex);
+    MKCAL_TRACE("lock", "acquire");
+    const qint64 start = mKCal::Tracer::now();
+    if (!m_semaphore.decrement(writeAccessIndex)) {
+        return false;
+    }
+    m_acquiredAt = mKCal::Tracer::now();
+
+    if (m_record) {
+        m_record->pid = ::getpid();
+        m_record->since = m_acquiredAt;
+        ::strncpy(m_record->operation, mKCal::MetricsScope::currentOperation(),
+                  sizeof(m_record->operation) - 1);
+        m_record->operation[sizeof(m_record->operation) - 1] = '\0';
+    }
+
+    mKCal::StorageMetrics::Private *metrics = mKCal::MetricsScope::current();
+    if (Q_UNLIKELY(metrics)) {
+        metrics->locks[mKCal::StorageMetrics::LockWait].add(quint64(m_acquiredAt - start));
+    }
+    return true;
 }
 
 bool ProcessMutex::release()
 {
+    if (m_record) {
+        m_record->pid = 0;
+    }
+
+    mKCal::StorageMetrics::Private *metrics = mKCal::MetricsScope::current();
+    if (Q_UNLIKELY(metrics) && m_acquiredAt) {
+        metrics->locks[mKCal::StorageMetrics::LockHold].add(quint64(mKCal::Tracer::now() - m_acquiredAt));
+    }
+    m_acquiredAt = 0;
+
     return m_semaphore.increment(writeAccessIndex);
 }
 
@@ -251,3 +321,39 @@ QString ProcessMutex::errorString() const
 {
     return m_semaphore.errorString();
 }
+
+ProcessMutex::Status ProcessMutex::status(const QString &path)
+{
+    Status status;
+
+    const QByteArray id = path.toLatin1();
+    int sem = ::semget(semaphoreKey(id.constData(), semaphoreProjectId), 0, 0);
+    if (sem == -1) {
+        return status;
+    }
+    status.valid = true;
+    status.connections = ::semctl(sem, databaseConnectionsIndex, GETVAL, 0);
+    status.locked = (::semctl(sem, writeAccessIndex, GETVAL, 0) == 0);
+    status.waiters = ::semctl(sem, writeAccessIndex, GETNCNT, 0);
+    if (!status.locked) {
+        return status;
+    }
+
+    // The last process to operate on a taken lock is its holder.
+    status.holder = ::semctl(sem, writeAccessIndex, GETPID, 0);
+    int shm = ::shmget(semaphoreKey(id.constData(), recordProjectId), sizeof(LockRecord), 0);
+    if (shm != -1) {
+        void *address = ::shmat(shm, nullptr, SHM_RDONLY);
+        if (address != reinterpret_cast<void*>(-1)) {
+            const LockRecord record = *static_cast<LockRecord*>(address);
+            ::shmdt(address);
+            if (record.pid == status.holder && record.since > 0) {
+                status.heldUs = mKCal::Tracer::now() - record.since;
+                status.operation = QString::fromLatin1(record.operation,
+                                                       ::strnlen(record.operation, sizeof(record.operation)));
+            }
+        }
+    }
+
+    return status;
+}
@@ -34,6 +34,8 @@
 
 #include <QString>
 
+#include "mkcal_export.h"
+
 class Semaphore
 {
 public:
@@ -58,13 +60,30 @@ private:
     int m_id;
 };
 
-class ProcessMutex
+struct LockRecord;
+
+class MKCAL_EXPORT ProcessMutex
 {
     Semaphore m_semaphore;
     bool m_initialProcess;
+    LockRecord *m_record;
+    qint64 m_acquiredAt;
 
 public:
+    // The state of the lock of a database, as seen by any process.
+    struct Status {
+        bool valid = false;
+        bool locked = false;
+        int connections = 0;
+        int waiters = 0;
+        qint64 holder = 0;
+        // Only known if the holder process is instrumented.
+        qint64 heldUs = -1;
+        QString operation;
+    };
+
     ProcessMutex(const QString &path);
+    ~ProcessMutex();
 
     bool acquire();
     bool release();
@@ -74,6 +93,8 @@ public:
     bool isInitialProcess() const;
 
     QString errorString() const;
+
+    static Status status(const QString &path);
 };
 
 #endif
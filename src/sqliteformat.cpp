@@ -57,6 +57,10 @@ public:
     {
         sqlite3_finalize(mSelectMetadata);
         sqlite3_finalize(mUpdateMetadata);
+        sqlite3_finalize(mSelectNotebookChanges);
+        sqlite3_finalize(mInsertChangelog);
+        sqlite3_finalize(mSelectChangelog);
+        sqlite3_finalize(mDeleteChangelog);
         sqlite3_finalize(mSelectCalProps);
         sqlite3_finalize(mInsertCalProps);
         sqlite3_finalize(mSelectIncProperties);
@@ -67,6 +71,7 @@ public:
         sqlite3_finalize(mSelectIncAttachments);
         sqlite3_finalize(mSelectDeletedIncidences);
         sqlite3_finalize(mSelectDeletedIncidencesFromNotebook);
+        sqlite3_finalize(mSelectExpiredIncidences);
         sqlite3_finalize(mDeleteIncComponents);
         sqlite3_finalize(mDeleteIncProperties);
         sqlite3_finalize(mDeleteIncAttendees);
@@ -75,14 +80,20 @@ public:
         sqlite3_finalize(mDeleteIncRDates);
         sqlite3_finalize(mDeleteIncAttachments);
         sqlite3_finalize(mInsertIncComponents);
+        sqlite3_finalize(mUpsertIncComponents);
+        sqlite3_finalize(mSelectUpsertedComponent);
         sqlite3_finalize(mInsertIncProperties);
         sqlite3_finalize(mInsertIncAttendees);
         sqlite3_finalize(mInsertIncAlarms);
         sqlite3_finalize(mInsertIncRecursives);
         sqlite3_finalize(mInsertIncRDates);
         sqlite3_finalize(mInsertIncAttachments);
-        sqlite3_finalize(mUpdateIncComponents);
+        for (sqlite3_stmt *stmt : mUpdateIncComponents) {
+            sqlite3_finalize(stmt);
+        }
         sqlite3_finalize(mMarkDeletedIncidences);
+        sqlite3_finalize(mInsertAlarmIndex);
+        sqlite3_finalize(mDeleteAlarmIndex);
     }
     SqliteFormat *mFormat;
     sqlite3 *mDatabase;
@@ -90,6 +101,10 @@ public:
     // Cache for various queries.
     sqlite3_stmt *mSelectMetadata = nullptr;
     sqlite3_stmt *mUpdateMetadata = nullptr;
+    sqlite3_stmt *mSelectNotebookChanges = nullptr;
+    sqlite3_stmt *mInsertChangelog = nullptr;
+    sqlite3_stmt *mSelectChangelog = nullptr;
+    sqlite3_stmt *mDeleteChangelog = nullptr;
 
     sqlite3_stmt *mSelectCalProps = nullptr;
     sqlite3_stmt *mInsertCalProps = nullptr;
@@ -103,6 +118,7 @@ public:
 
     sqlite3_stmt *mSelectDeletedIncidences = nullptr;
     sqlite3_stmt *mSelectDeletedIncidencesFromNotebook = nullptr;
+    sqlite3_stmt *mSelectExpiredIncidences = nullptr;
 
     sqlite3_stmt *mDeleteIncComponents = nullptr;
     sqlite3_stmt *mDeleteIncProperties = nullptr;
@@ -113,6 +129,8 @@ public:
     sqlite3_stmt *mDeleteIncAttachments = nullptr;
 
     sqlite3_stmt *mInsertIncComponents = nullptr;
+    sqlite3_stmt *mUpsertIncComponents = nullptr;
+    sqlite3_stmt *mSelectUpsertedComponent = nullptr;
     sqlite3_stmt *mInsertIncProperties = nullptr;
     sqlite3_stmt *mInsertIncAttendees = nullptr;
     sqlite3_stmt *mInsertIncAlarms = nullptr;
@@ -120,10 +138,14 @@ public:
     sqlite3_stmt *mInsertIncRDates = nullptr;
     sqlite3_stmt *mInsertIncAttachments = nullptr;
 
-    sqlite3_stmt *mUpdateIncComponents = nullptr;
+    // Updates of Components, by set of written columns.
+    QHash<quint64, sqlite3_stmt*> mUpdateIncComponents;
 
     sqlite3_stmt *mMarkDeletedIncidences = nullptr;
 
+    sqlite3_stmt *mInsertAlarmIndex = nullptr;
+    sqlite3_stmt *mDeleteAlarmIndex = nullptr;
+
     bool updateMetadata(int transactionId);
     bool selectCustomproperties(Incidence::Ptr &incidence, int rowid);
     int selectRowId(const QString &notebookUid, const QString &uid,
@@ -146,6 +168,10 @@ public:
     bool insertRdates(const Incidence &incidence, int rowid);
     bool insertRdate(int rowid, int type, const QDateTime &rdate, bool allDay);
     bool deleteListsForIncidence(int rowid);
+    int selectUpsertedRowId(const Incidence &incidence, bool *inserted);
+    sqlite3_stmt *updateStatement(quint64 columns);
+    bool insertAlarmIndex(const Incidence &incidence, const QByteArray &notebook, int rowid);
+    bool deleteAlarmIndex(int rowid);
     bool modifyCalendarProperties(const Notebook &notebook, DBOperation dbop);
     bool deleteCalendarProperties(const QByteArray &id);
     bool insertCalendarProperty(const QByteArray &id, const QByteArray &key,
@@ -202,6 +228,110 @@ bool SqliteFormat::incrementTransactionId(int *id)
     return true;
 }
 
+bool SqliteFormat::selectNotebookChanges(int id, QStringList *notebookUids)
+{
+    int rv = 0;
+    int index = 1;
+
+    if (!notebookUids)
+        return false;
+    if (!d->mSelectNotebookChanges) {
+        const char *query = SELECT_NOTEBOOKCHANGES;
+        int qsize = sizeof(SELECT_NOTEBOOKCHANGES);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mSelectNotebookChanges, NULL);
+    }
+    SL3_bind_int64(d->mSelectNotebookChanges, index, id);
+    SL3_step(d->mSelectNotebookChanges);
+    while (rv == SQLITE_ROW) {
+        notebookUids->append(QString::fromUtf8((const char *)sqlite3_column_text(d->mSelectNotebookChanges, 0)));
+        SL3_step(d->mSelectNotebookChanges);
+    }
+    SL3_reset(d->mSelectNotebookChanges);
+
+    return true;
+
+error:
+    sqlite3_reset(d->mSelectNotebookChanges);
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(d->mDatabase);
+    return false;
+}
+
+bool SqliteFormat::insertChanges(const StorageChange::List &changes, int limit)
+{
+    int rv = 0;
+    int index = 1;
+
+    if (!d->mInsertChangelog) {
+        const char *query = INSERT_CHANGELOG;
+        int qsize = sizeof(INSERT_CHANGELOG);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mInsertChangelog, NULL);
+    }
+    if (!d->mDeleteChangelog) {
+        const char *query = DELETE_CHANGELOG;
+        int qsize = sizeof(DELETE_CHANGELOG);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mDeleteChangelog, NULL);
+    }
+
+    for (const StorageChange &change : changes) {
+        const QByteArray notebook = change.notebookUid.toUtf8();
+        const QByteArray identifier = change.instanceIdentifier.toUtf8();
+        index = 1;
+        SL3_reset(d->mInsertChangelog);
+        SL3_bind_text(d->mInsertChangelog, index, notebook.constData(), notebook.length(), SQLITE_STATIC);
+        SL3_bind_text(d->mInsertChangelog, index, identifier.constData(), identifier.length(), SQLITE_STATIC);
+        SL3_bind_int(d->mInsertChangelog, index, change.operation);
+        SL3_step(d->mInsertChangelog);
+    }
+    SL3_reset(d->mInsertChangelog);
+
+    index = 1;
+    SL3_reset(d->mDeleteChangelog);
+    SL3_bind_int(d->mDeleteChangelog, index, limit);
+    SL3_step(d->mDeleteChangelog);
+    SL3_reset(d->mDeleteChangelog);
+
+    return true;
+
+error:
+    sqlite3_reset(d->mInsertChangelog);
+    sqlite3_reset(d->mDeleteChangelog);
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(d->mDatabase);
+    return false;
+}
+
+bool SqliteFormat::selectChanges(int id, StorageChange::List *changes)
+{
+    int rv = 0;
+    int index = 1;
+
+    if (!changes)
+        return false;
+    if (!d->mSelectChangelog) {
+        const char *query = SELECT_CHANGELOG;
+        int qsize = sizeof(SELECT_CHANGELOG);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mSelectChangelog, NULL);
+    }
+    SL3_bind_int64(d->mSelectChangelog, index, id);
+    SL3_step(d->mSelectChangelog);
+    while (rv == SQLITE_ROW) {
+        StorageChange change;
+        change.transactionId = sqlite3_column_int(d->mSelectChangelog, 0);
+        change.notebookUid = QString::fromUtf8((const char *)sqlite3_column_text(d->mSelectChangelog, 1));
+        change.instanceIdentifier = QString::fromUtf8((const char *)sqlite3_column_text(d->mSelectChangelog, 2));
+        change.operation = StorageChange::Operation(sqlite3_column_int(d->mSelectChangelog, 3));
+        changes->append(change);
+        SL3_step(d->mSelectChangelog);
+    }
+    SL3_reset(d->mSelectChangelog);
+
+    return true;
+
+error:
+    sqlite3_reset(d->mSelectChangelog);
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(d->mDatabase);
+    return false;
+}
+
 bool SqliteFormat::Private::updateMetadata(int transactionId)
 {
     int rv = 0;
@@ -366,6 +496,133 @@ error:
     return false;
 }
 
+bool SqliteFormat::purgeDeletedComponents(const KCalendarCore::Incidence::List &list,
+                                          const QString &notebook, int *purged)
+{
+    static const char *purges[] = {
+        PURGE_ROWS("Rdates"),
+        PURGE_ROWS("Customproperties"),
+        PURGE_ROWS("Recursive"),
+        PURGE_ROWS("Alarm"),
+        PURGE_ROWS("Attendee"),
+        PURGE_ROWS("Attachments"),
+        PURGE_ROWS("Alarmindex"),
+        PURGE_ROWS("Components")
+    };
+    int rv;
+    int index = 1;
+    char *errmsg = nullptr;
+    const char *query = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    const QByteArray nbUid(notebook.toUtf8());
+    MKCAL_TRACE("sqlite", "purge components");
+
+    query = CREATE_PURGE_TABLES;
+    SL3_exec(d->mDatabase);
+    query = CLEAR_PURGE_TABLES;
+    SL3_exec(d->mDatabase);
+
+    SL3_prepare_v2(d->mDatabase, INSERT_PURGE_TARGET, sizeof(INSERT_PURGE_TARGET), &stmt, nullptr);
+    for (const KCalendarCore::Incidence::Ptr &incidence : list) {
+        const QByteArray uid(incidence->uid().toUtf8());
+        qint64 secsRecurId = 0;
+        if (incidence->hasRecurrenceId() && incidence->recurrenceId().timeSpec() == Qt::LocalTime) {
+            secsRecurId = toLocalOriginTime(incidence->recurrenceId());
+        } else if (incidence->hasRecurrenceId()) {
+            secsRecurId = toOriginTime(incidence->recurrenceId());
+        }
+        index = 1;
+        SL3_reset(stmt);
+        SL3_bind_text(stmt, index, uid.constData(), uid.length(), SQLITE_TRANSIENT);
+        SL3_bind_int64(stmt, index, secsRecurId);
+        SL3_step(stmt);
+    }
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    if (nbUid.isEmpty()) {
+        SL3_prepare_v2(d->mDatabase, SELECT_PURGE_ROWS, sizeof(SELECT_PURGE_ROWS), &stmt, nullptr);
+    } else {
+        SL3_prepare_v2(d->mDatabase, SELECT_PURGE_ROWS_BY_NOTEBOOK,
+                       sizeof(SELECT_PURGE_ROWS_BY_NOTEBOOK), &stmt, nullptr);
+        index = 1;
+        SL3_bind_text(stmt, index, nbUid.constData(), nbUid.length(), SQLITE_STATIC);
+    }
+    SL3_step(stmt);
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    // Child tables first, Components last.
+    for (const char *purge : purges) {
+        query = purge;
+        SL3_exec(d->mDatabase);
+        MKCAL_METRICS_ADD(ChildStatements, 1);
+    }
+    // Components is purged last.
+    if (purged)
+        *purged = sqlite3_changes(d->mDatabase);
+
+    query = CLEAR_PURGE_TABLES;
+    SL3_exec(d->mDatabase);
+
+    return true;
+
+error:
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(d->mDatabase);
+    sqlite3_finalize(stmt);
+    return false;
+}
+
+int SqliteFormat::purgeExpiredComponents(const QString &notebook, const QDateTime &before, int limit)
+{
+    int rv;
+    int index = 1;
+    const QByteArray nbUid(notebook.toUtf8());
+    QList<int> rowids;
+
+    if (!d->mDeleteIncComponents) {
+        const char *query = DELETE_COMPONENTS;
+        int qsize = sizeof(DELETE_COMPONENTS);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mDeleteIncComponents, nullptr);
+    }
+
+    if (!d->mSelectExpiredIncidences) {
+        const char *query = SELECT_ROWID_FROM_COMPONENTS_BY_NOTEBOOK_AND_EXPIRED;
+        int qsize = sizeof(SELECT_ROWID_FROM_COMPONENTS_BY_NOTEBOOK_AND_EXPIRED);
+        SL3_prepare_v2(d->mDatabase, query, qsize, &d->mSelectExpiredIncidences, nullptr);
+    }
+    SL3_reset(d->mSelectExpiredIncidences);
+    SL3_bind_text(d->mSelectExpiredIncidences, index, nbUid.constData(), nbUid.length(), SQLITE_STATIC);
+    SL3_bind_int64(d->mSelectExpiredIncidences, index, toOriginTime(before));
+    SL3_bind_int(d->mSelectExpiredIncidences, index, limit);
+
+    // Collect the rows first, not to delete from the table being read.
+    SL3_step(d->mSelectExpiredIncidences);
+    while (rv == SQLITE_ROW) {
+        rowids.append(sqlite3_column_int(d->mSelectExpiredIncidences, 0));
+        SL3_step(d->mSelectExpiredIncidences);
+    }
+    SL3_reset(d->mSelectExpiredIncidences);
+
+    for (int rowid : rowids) {
+        int index2 = 1;
+        SL3_reset(d->mDeleteIncComponents);
+        SL3_bind_int(d->mDeleteIncComponents, index2, rowid);
+        SL3_step(d->mDeleteIncComponents);
+
+        if (!d->deleteListsForIncidence(rowid)) {
+            qCWarning(lcMkcal) << "failed to delete lists for component" << rowid;
+            return -1;
+        }
+    }
+
+    return rowids.count();
+
+error:
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(d->mDatabase);
+    return -1;
+}
+
 static bool setDateTime(SqliteFormat *format, sqlite3_stmt *stmt, int &index, const QDateTime &dateTime, bool allDay)
 {
     int rv = 0;
@@ -400,8 +657,276 @@ static bool setDateTime(SqliteFormat *format, sqlite3_stmt *stmt, int &index, co
             goto error;                                                \
     }
 
+// The columns of Components, in the binding order of the update.
+static const char *const updatedColumns[] = {
+    "Notebook", "Type", "Summary", "Category", "DateStart", "DateStartLocal", "StartTimeZone",
+    "HasDueDate", "DateEndDue", "DateEndDueLocal", "EndDueTimeZone", "Duration", "Classification", "Location",
+    "Description", "Status", "GeoLatitude", "GeoLongitude", "Priority", "Resources", "DateCreated", "DateStamp",
+    "DateLastModified", "Sequence", "Comments", "Attachments", "Contact", "RecurId", "RecurIdLocal", "RecurIdTimeZone",
+    "RelatedTo", "URL", "UID", "Transparency", "LocalOnly", "Percent", "DateCompleted", "DateCompletedLocal",
+    "CompletedTimeZone", "extra1", "thisAndFuture"
+};
+static const int updatedColumnCount = sizeof(updatedColumns) / sizeof(updatedColumns[0]);
+// The index of the updated columns in a select * from Components.
+static const int selectedColumns[] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,
+    29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 42, 45
+};
+Q_STATIC_ASSERT(sizeof(selectedColumns) / sizeof(selectedColumns[0]) == updatedColumnCount);
+static const quint64 allColumns = (Q_UINT64_C(1) << updatedColumnCount) - 1;
+// Distinct sets of changed columns are few in practice,
+// this only bounds the cache against unusual usage.
+static const int maxUpdateStatements = 32;
+
+static uint columnHash(int type, sqlite3_int64 integer, double real, const char *text, int length)
+{
+    switch (type) {
+    case SQLITE_INTEGER:
+        return uint(qHash(integer, type));
+    case SQLITE_FLOAT:
+        return uint(qHash(real, type));
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+        return uint(qHash(QByteArray::fromRawData(text, length), type)) ^ uint(length);
+    default:
+        return uint(type);
+    }
+}
+
+// Only reads the value with its own type, not to convert it.
+static uint columnHash(sqlite3_stmt *stmt, int column)
+{
+    const int type = sqlite3_column_type(stmt, column);
+    switch (type) {
+    case SQLITE_INTEGER:
+        return columnHash(type, sqlite3_column_int64(stmt, column), 0., nullptr, 0);
+    case SQLITE_FLOAT:
+        return columnHash(type, 0, sqlite3_column_double(stmt, column), nullptr, 0);
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+        const char *text = static_cast<const char *>(sqlite3_column_blob(stmt, column));
+        return columnHash(type, 0, 0., text, sqlite3_column_bytes(stmt, column));
+    }
+    default:
+        return columnHash(type, 0, 0., nullptr, 0);
+    }
+}
+
+// Columns whose value differs from the stored one.
+static quint64 changedColumns(const SqliteFormat::ColumnHashes &current,
+                              const SqliteFormat::ColumnHashes &stored)
+{
+    quint64 columns = 0;
+    for (int i = 0; i < current.count(); i++) {
+        if (stored.count() != current.count() || stored.at(i) != current.at(i))
+            columns |= Q_UINT64_C(1) << i;
+    }
+    return columns;
+}
+
+namespace {
+
+/*
+  The values of the updated columns of a component, collected
+  before being bound, so that an update can skip unchanged columns.
+*/
+class ComponentValues
+{
+public:
+    ComponentValues()
+    {
+        mValues.reserve(updatedColumnCount);
+    }
+
+    void addText(const QByteArray &text)
+    {
+        Value value;
+        value.type = SQLITE_TEXT;
+        value.text = text;
+        mValues.append(value);
+    }
+
+    void addInt(sqlite3_int64 integer)
+    {
+        Value value;
+        value.type = SQLITE_INTEGER;
+        value.integer = integer;
+        mValues.append(value);
+    }
+
+    void addDouble(double real)
+    {
+        Value value;
+        value.type = SQLITE_FLOAT;
+        value.real = real;
+        mValues.append(value);
+    }
+
+    void addNull()
+    {
+        mValues.append(Value());
+    }
+
+    // Same values as setDateTime().
+    void addDateTime(SqliteFormat *format, const QDateTime &dateTime, bool allDay)
+    {
+        if (dateTime.isValid()) {
+            addInt((dateTime.timeSpec() == Qt::LocalTime || allDay)
+                   ? format->toLocalOriginTime(dateTime) : format->toOriginTime(dateTime));
+            addInt(format->toLocalOriginTime(dateTime));
+            if (allDay) {
+                addText(FLOATING_DATE);
+            } else if (dateTime.timeSpec() != Qt::LocalTime) {
+                addText(dateTime.timeZone().id());
+            } else {
+                addText(QByteArray());
+            }
+        } else {
+            addInt(0);
+            addInt(0);
+            addText(QByteArray());
+        }
+    }
+
+    SqliteFormat::ColumnHashes hashes() const
+    {
+        SqliteFormat::ColumnHashes hashes;
+        hashes.reserve(mValues.count());
+        for (const Value &value : mValues) {
+            hashes.append(columnHash(value.type, value.integer, value.real,
+                                     value.text.constData(), value.text.length()));
+        }
+        return hashes;
+    }
+
+    int bind(sqlite3_stmt *stmt, int index, int column) const
+    {
+        const Value &value = mValues.at(column);
+        switch (value.type) {
+        case SQLITE_INTEGER:
+            return sqlite3_bind_int64(stmt, index, value.integer);
+        case SQLITE_FLOAT:
+            return sqlite3_bind_double(stmt, index, value.real);
+        case SQLITE_TEXT:
+            return sqlite3_bind_text(stmt, index, value.text.constData(), value.text.length(),
+                                     SQLITE_STATIC);
+        default:
+            return sqlite3_bind_null(stmt, index);
+        }
+    }
+
+    int count() const
+    {
+        return mValues.count();
+    }
+
+private:
+    struct Value
+    {
+        int type = SQLITE_NULL;
+        sqlite3_int64 integer = 0;
+        double real = 0.;
+        QByteArray text;
+    };
+    QVector<Value> mValues;
+};
+
+}
+
+//@cond PRIVATE
+sqlite3_stmt *SqliteFormat::Private::updateStatement(quint64 columns)
+{
+    int rv = 0;
+    sqlite3_stmt *stmt = mUpdateIncComponents.value(columns);
+    QByteArray query("update Components set ");
+
+    if (stmt)
+        return stmt;
+
+    if (mUpdateIncComponents.count() >= maxUpdateStatements) {
+        for (sqlite3_stmt *cached : mUpdateIncComponents) {
+            sqlite3_finalize(cached);
+        }
+        mUpdateIncComponents.clear();
+    }
+    for (int i = 0; i < updatedColumnCount; i++) {
+        if (columns & (Q_UINT64_C(1) << i)) {
+            query += updatedColumns[i];
+            query += "=?, ";
+        }
+    }
+    query += "ChangeSeq=" NEXT_TRANSACTION_ID " where ComponentId=?";
+    SL3_prepare_v2(mDatabase, query.constData(), query.length(), &stmt, nullptr);
+    mUpdateIncComponents.insert(columns, stmt);
+
+    return stmt;
+
+error:
+    return nullptr;
+}
+//@endcond
+
+// Inserts a component, or updates the one with the same UID and
+// recurrence id if it belongs to the same notebook. The creation
+// date of an updated component is kept, since it is set to the
+// current time when the incidence has none.
+static QByteArray upsertComponentsQuery()
+{
+    QByteArray query(INSERT_COMPONENTS " on conflict(UID, RecurId, DateDeleted) do update set ");
+    for (int i = 0; i < updatedColumnCount; i++) {
+        if (qstrcmp(updatedColumns[i], "DateCreated") == 0)
+            continue;
+        query += updatedColumns[i] + QByteArray("=excluded.") + updatedColumns[i] + ", ";
+    }
+    query += "ChangeSeq=excluded.ChangeSeq";
+    query += " where Notebook=excluded.Notebook";
+    return query;
+}
+
+// Returns the rowid of the component written by an upsert,
+// 0 if it was not written, -1 on error.
+int SqliteFormat::Private::selectUpsertedRowId(const Incidence &incidence, bool *inserted)
+{
+    int rv = 0;
+    int index = 1;
+    const QByteArray uid(incidence.uid().toUtf8());
+    qint64 secsRecurId = 0;
+    int rowid = -1;
+
+    // The conflicting component is in another notebook.
+    if (sqlite3_changes(mDatabase) == 0)
+        return 0;
+
+    if (incidence.hasRecurrenceId() && incidence.recurrenceId().timeSpec() == Qt::LocalTime) {
+        secsRecurId = mFormat->toLocalOriginTime(incidence.recurrenceId());
+    } else if (incidence.hasRecurrenceId()) {
+        secsRecurId = mFormat->toOriginTime(incidence.recurrenceId());
+    }
+
+    if (!mSelectUpsertedComponent) {
+        const char *query = SELECT_UPSERTED_COMPONENT;
+        int qsize = sizeof(SELECT_UPSERTED_COMPONENT);
+        SL3_prepare_v2(mDatabase, query, qsize, &mSelectUpsertedComponent, nullptr);
+    }
+    SL3_reset(mSelectUpsertedComponent);
+    SL3_bind_text(mSelectUpsertedComponent, index, uid.constData(), uid.length(), SQLITE_STATIC);
+    SL3_bind_int64(mSelectUpsertedComponent, index, secsRecurId);
+    SL3_step(mSelectUpsertedComponent);
+    if (rv == SQLITE_ROW) {
+        rowid = sqlite3_column_int(mSelectUpsertedComponent, 0);
+        if (inserted)
+            *inserted = sqlite3_column_int(mSelectUpsertedComponent, 1);
+    }
+    sqlite3_reset(mSelectUpsertedComponent);
+
+    return rowid;
+
+error:
+    return -1;
+}
+
 bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &nbook,
-                                    DBOperation dbop)
+                                    DBOperation dbop, bool *inserted, ColumnHashes *hashes)
 {
     int rv = 0;
     int index = 1;
@@ -420,7 +945,12 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
     QByteArray resources;
     sqlite3_int64 secs;
     int rowid = 0;
+    bool isInserted = false;
     sqlite3_stmt *stmt1;
+    ComponentValues values;
+    ColumnHashes written;
+    // All of them, unless only the changed ones are updated.
+    quint64 columns = allColumns;
 
     // Don't leave deleted events with the same UID/recID in the
     // notebook to add a new incidence to. It may otherwise
@@ -472,23 +1002,27 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
         SL3_reset(d->mInsertIncComponents);
         stmt1 = d->mInsertIncComponents;
         break;
+    case DBUpsert:
+        if (!d->mUpsertIncComponents) {
+            const QByteArray query = upsertComponentsQuery();
+            SL3_prepare_v2(d->mDatabase, query.constData(), query.length(),
+                           &d->mUpsertIncComponents, nullptr);
+        }
+        SL3_reset(d->mUpsertIncComponents);
+        stmt1 = d->mUpsertIncComponents;
+        break;
     case DBUpdate:
-        if (!d->mUpdateIncComponents) {
-            const char *query = UPDATE_COMPONENTS;
-            int qsize = sizeof(UPDATE_COMPONENTS);
-            SL3_prepare_v2(d->mDatabase, query, qsize, &d->mUpdateIncComponents, nullptr);
-        }
-        SL3_reset(d->mUpdateIncComponents);
-        stmt1 = d->mUpdateIncComponents;
+        // Depends on the changed columns, see Private::updateStatement().
+        stmt1 = nullptr;
         break;
     default:
         qCWarning(lcMkcal) << "unknown DB operation" << dbop;
         goto error;
     }
 
-    if (dbop == DBInsert || dbop == DBUpdate) {
+    if (dbop == DBInsert || dbop == DBUpdate || dbop == DBUpsert) {
         notebook = nbook.toUtf8();
-        SL3_bind_text(stmt1, index, notebook.constData(), notebook.length(), SQLITE_STATIC);
+        values.addText(notebook);
 
         switch (incidence.type()) {
         case Incidence::TypeEvent:
@@ -506,20 +1040,20 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
         case Incidence::TypeUnknown:
             goto error;
         }
-        SL3_bind_text(stmt1, index, type.constData(), type.length(), SQLITE_STATIC);   // NOTE
+        values.addText(type);   // NOTE
 
         summary = incidence.summary().toUtf8();
-        SL3_bind_text(stmt1, index, summary.constData(), summary.length(), SQLITE_STATIC);
+        values.addText(summary);
 
         category = incidence.categoriesStr().toUtf8();
-        SL3_bind_text(stmt1, index, category.constData(), category.length(), SQLITE_STATIC);
+        values.addText(category);
 
         if ((incidence.type() == Incidence::TypeEvent)
             || (incidence.type() == Incidence::TypeJournal)) {
-            SL3_bind_date_time(this, stmt1, index, incidence.dtStart(), incidence.allDay());
+            values.addDateTime(this, incidence.dtStart(), incidence.allDay());
 
             // set HasDueDate to false
-            SL3_bind_int(stmt1, index, 0);
+            values.addInt(0);
 
             QDateTime effectiveDtEnd;
             if (incidence.type() == Incidence::TypeEvent) {
@@ -534,66 +1068,65 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
                     }
                 }
             }
-            SL3_bind_date_time(this, stmt1, index, effectiveDtEnd, incidence.allDay());
+            values.addDateTime(this, effectiveDtEnd, incidence.allDay());
         } else if (incidence.type() == Incidence::TypeTodo) {
             const Todo *todo = static_cast<const Todo*>(&incidence);
-            SL3_bind_date_time(this, stmt1, index,
-                               todo->hasStartDate() ? todo->dtStart(true) : QDateTime(), todo->allDay());
+            values.addDateTime(this, todo->hasStartDate() ? todo->dtStart(true) : QDateTime(), todo->allDay());
 
-            SL3_bind_int(stmt1, index, (int) todo->hasDueDate());
+            values.addInt((int) todo->hasDueDate());
 
-            SL3_bind_date_time(this, stmt1, index, todo->hasDueDate() ? todo->dtDue(true) : QDateTime(), todo->allDay());
+            values.addDateTime(this, todo->hasDueDate() ? todo->dtDue(true) : QDateTime(), todo->allDay());
         }
 
         if (incidence.type() != Incidence::TypeJournal) {
-            SL3_bind_int(stmt1, index, incidence.duration().asSeconds()); // NOTE
+            values.addInt(incidence.duration().asSeconds()); // NOTE
         } else {
-            SL3_bind_int(stmt1, index, 0);
+            values.addInt(0);
         }
 
-        SL3_bind_int(stmt1, index, incidence.secrecy()); // NOTE
+        values.addInt(incidence.secrecy()); // NOTE
 
         if (incidence.type() != Incidence::TypeJournal) {
             location = incidence.location().toUtf8();
-            SL3_bind_text(stmt1, index, location.constData(), location.length(), SQLITE_STATIC);
+            values.addText(location);
         } else {
-            SL3_bind_text(stmt1, index, "", 0, SQLITE_STATIC);
+            values.addText(QByteArray());
         }
 
         description = incidence.description().toUtf8();
-        SL3_bind_text(stmt1, index, description.constData(), description.length(), SQLITE_STATIC);
+        values.addText(description);
 
-        SL3_bind_int(stmt1, index, incidence.status()); // NOTE
+        values.addInt(incidence.status()); // NOTE
 
         if (incidence.type() != Incidence::TypeJournal) {
             if (incidence.hasGeo()) {
-                SL3_bind_double(stmt1, index, incidence.geoLatitude());
-                SL3_bind_double(stmt1, index, incidence.geoLongitude());
+                values.addDouble(incidence.geoLatitude());
+                values.addDouble(incidence.geoLongitude());
             } else {
-                SL3_bind_double(stmt1, index, INVALID_LATLON);
-                SL3_bind_double(stmt1, index, INVALID_LATLON);
+                values.addDouble(INVALID_LATLON);
+                values.addDouble(INVALID_LATLON);
             }
 
-            SL3_bind_int(stmt1, index, incidence.priority());
+            values.addInt(incidence.priority());
 
             resources = incidence.resources().join(" ").toUtf8();
-            SL3_bind_text(stmt1, index, resources.constData(), resources.length(), SQLITE_STATIC);
+            values.addText(resources);
         } else {
-            SL3_bind_double(stmt1, index, INVALID_LATLON);
-            SL3_bind_double(stmt1, index, INVALID_LATLON);
-            SL3_bind_int(stmt1, index, 0);
-            SL3_bind_text(stmt1, index, "", 0, SQLITE_STATIC);
+            values.addDouble(INVALID_LATLON);
+            values.addDouble(INVALID_LATLON);
+            values.addInt(0);
+            values.addText(QByteArray());
         }
 
-        if (incidence.created().isValid() || dbop != DBInsert) {
+        if (incidence.created().isValid() || dbop == DBUpdate) {
             secs = toOriginTime(incidence.created());
         } else {
             secs = toOriginTime(QDateTime::currentDateTimeUtc());
         }
-        SL3_bind_int64(stmt1, index, secs);
+        values.addInt(secs);
 
         secs = toOriginTime(QDateTime::currentDateTimeUtc());
-        SL3_bind_int64(stmt1, index, secs);   // datestamp
+        values.addInt(secs);   // datestamp
 
         // lastModified is a public field of iCal RFC, so user should be
         // able to set its value to arbitrary date and time. This field is
@@ -605,41 +1138,41 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
         } else {
             secs = toOriginTime(QDateTime::currentDateTimeUtc());
         }
-        SL3_bind_int64(stmt1, index, secs);
+        values.addInt(secs);
 
-        SL3_bind_int(stmt1, index, incidence.revision());
+        values.addInt(incidence.revision());
 
         comments = incidence.comments().join(" ").toUtf8();
-        SL3_bind_text(stmt1, index, comments.constData(), comments.length(), SQLITE_STATIC);
+        values.addText(comments);
 
         // Attachments are now stored in a dedicated table.
-        SL3_bind_text(stmt1, index, nullptr, 0, SQLITE_STATIC);
+        values.addNull();
 
         contact = incidence.contacts().join(" ").toUtf8();
-        SL3_bind_text(stmt1, index, contact.constData(), contact.length(), SQLITE_STATIC);
+        values.addText(contact);
 
         // Never save recurrenceId as FLOATING_DATE, because the time of a
         // floating date is not guaranteed on read and recurrenceId is used
         // for date-time comparisons.
-        SL3_bind_date_time(this, stmt1, index, incidence.recurrenceId(), false);
+        values.addDateTime(this, incidence.recurrenceId(), false);
 
         relatedtouid = incidence.relatedTo().toUtf8();
-        SL3_bind_text(stmt1, index, relatedtouid.constData(), relatedtouid.length(), SQLITE_STATIC);
+        values.addText(relatedtouid);
 
         url = incidence.url().toString().toUtf8();
-        SL3_bind_text(stmt1, index, url.constData(), url.length(), SQLITE_STATIC);
+        values.addText(url);
 
         uid = incidence.uid().toUtf8();
-        SL3_bind_text(stmt1, index, uid.constData(), uid.length(), SQLITE_STATIC);
+        values.addText(uid);
 
         if (incidence.type() == Incidence::TypeEvent) {
             const Event *event = static_cast<const Event*>(&incidence);
-            SL3_bind_int(stmt1, index, (int)event->transparency());
+            values.addInt((int)event->transparency());
         } else {
-            SL3_bind_int(stmt1, index, 0);
+            values.addInt(0);
         }
 
-        SL3_bind_int(stmt1, index, (int) incidence.localOnly());
+        values.addInt((int) incidence.localOnly());
 
         int percentComplete = 0;
         QDateTime effectiveDtCompleted;
@@ -648,23 +1181,65 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
             percentComplete = todo->percentComplete();
             effectiveDtCompleted = todo->completed();
         }
-        SL3_bind_int(stmt1, index, percentComplete);
-        SL3_bind_date_time(this, stmt1, index, effectiveDtCompleted, incidence.allDay());
+        values.addInt(percentComplete);
+        values.addDateTime(this, effectiveDtCompleted, incidence.allDay());
 
         colorstr = incidence.color().toUtf8();
-        SL3_bind_text(stmt1, index, colorstr.constData(), colorstr.length(), SQLITE_STATIC);
-
-        SL3_bind_int(stmt1, index, incidence.thisAndFuture());
-
+        values.addText(colorstr);
+
+        values.addInt(incidence.thisAndFuture());
+
+        if (hashes)
+            written = values.hashes();
+        if (dbop == DBUpdate) {
+            if (hashes)
+                columns = changedColumns(written, *hashes);
+            stmt1 = d->updateStatement(columns);
+            if (!stmt1)
+                goto error;
+            SL3_reset(stmt1);
+        }
+        for (int i = 0; i < values.count(); i++) {
+            if (columns & (Q_UINT64_C(1) << i)) {
+                rv = values.bind(stmt1, index++, i);
+                if (rv) {
+                    qCWarning(lcMkcal) << "sqlite3_bind error:" << rv << "on column" << updatedColumns[i];
+                    goto error;
+                }
+            }
+        }
         if (dbop == DBUpdate)
             SL3_bind_int(stmt1, index, rowid);
     }
 
     SL3_step(stmt1);
 
-    if ((dbop == DBDelete || dbop == DBUpdate) && !d->deleteListsForIncidence(rowid)) {
+    if (dbop == DBUpsert) {
+        rowid = d->selectUpsertedRowId(incidence, &isInserted);
+        if (!rowid) {
+            qCWarning(lcMkcal) << "incidence" << incidence.uid() << "is already stored in another notebook";
+            goto error;
+        } else if (rowid < 0) {
+            qCWarning(lcMkcal) << "failed to select rowid of upserted incidence" << incidence.uid();
+            goto error;
+        }
+        if (inserted)
+            *inserted = isInserted;
+        // Like on insertion, don't leave deleted events with the same UID/recID.
+        if (isInserted && !purgeDeletedComponents(incidence, nbook)) {
+            qCWarning(lcMkcal) << "cannot purge deleted components on insertion.";
+        }
+    }
+
+    // Lists are deleted even for an inserted upsert, since the incidence
+    // may have been written already earlier in the same transaction.
+    if (dbop == DBMarkDeleted && !d->deleteAlarmIndex(rowid)) {
+        qCWarning(lcMkcal) << "failed to delete alarm index for incidence" << incidence.uid();
+    } else if ((dbop == DBDelete || dbop == DBUpdate || dbop == DBUpsert)
+               && !d->deleteListsForIncidence(rowid)) {
         qCWarning(lcMkcal) << "failed to delete lists for incidence" << incidence.uid();
-    } else if (dbop == DBInsert || dbop == DBUpdate) {
+    } else if (dbop == DBInsert || dbop == DBUpdate || dbop == DBUpsert) {
+        MKCAL_TRACE("sqlite", "insert children");
         if (dbop == DBInsert)
             rowid = sqlite3_last_insert_rowid(d->mDatabase);
 
@@ -685,8 +1260,14 @@ bool SqliteFormat::modifyComponents(const Incidence &incidence, const QString &n
 
         if (!d->insertAttachments(incidence, rowid))
             qCWarning(lcMkcal) << "failed to modify attachments for incidence" << incidence.uid();
+
+        if (!d->insertAlarmIndex(incidence, notebook, rowid))
+            qCWarning(lcMkcal) << "failed to modify alarm index for incidence" << incidence.uid();
     }
 
+    if (hashes && (dbop == DBInsert || dbop == DBUpdate || dbop == DBUpsert))
+        *hashes = written;
+
     return true;
 
 error:
@@ -698,6 +1279,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
 {
     int rv = 0;
     int index = 1;
+    MKCAL_TRACE("sqlite", "delete children");
 
     if (!mDeleteIncProperties) {
         const char *query = DELETE_CUSTOMPROPERTIES;
@@ -705,6 +1287,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncProperties, nullptr);
     }
     SL3_reset(mDeleteIncProperties);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncProperties, index, rowid);
     SL3_step(mDeleteIncProperties);
@@ -715,6 +1298,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncAlarms, nullptr);
     }
     SL3_reset(mDeleteIncAlarms);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncAlarms, index, rowid);
     SL3_step(mDeleteIncAlarms);
@@ -725,6 +1309,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncAttendees, nullptr);
     }
     SL3_reset(mDeleteIncAttendees);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncAttendees, index, rowid);
     SL3_step(mDeleteIncAttendees);
@@ -735,6 +1320,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncRecursives, nullptr);
     }
     SL3_reset(mDeleteIncRecursives);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncRecursives, index, rowid);
     SL3_step(mDeleteIncRecursives);
@@ -745,6 +1331,7 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncRDates, nullptr);
     }
     SL3_reset(mDeleteIncRDates);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncRDates, index, rowid);
     SL3_step(mDeleteIncRDates);
@@ -755,11 +1342,12 @@ bool SqliteFormat::Private::deleteListsForIncidence(int rowid)
         SL3_prepare_v2(mDatabase, query, qsize, &mDeleteIncAttachments, nullptr);
     }
     SL3_reset(mDeleteIncAttachments);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     index = 1;
     SL3_bind_int(mDeleteIncAttachments, index, rowid);
     SL3_step(mDeleteIncAttachments);
 
-    return true;
+    return deleteAlarmIndex(rowid);
 
 error:
     qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(mDatabase);
@@ -796,6 +1384,7 @@ bool SqliteFormat::Private::insertCustomproperty(int rowid, const QByteArray &ke
         SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncProperties, nullptr);
     }
     SL3_reset(mInsertIncProperties);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mInsertIncProperties, index, rowid);
     SL3_bind_text(mInsertIncProperties, index, key.constData(), key.length(), SQLITE_STATIC);
     valueba = value.toUtf8();
@@ -876,6 +1465,7 @@ bool SqliteFormat::Private::insertRdate(int rowid, int type, const QDateTime &da
         SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncRDates, nullptr);
     }
     SL3_reset(mInsertIncRDates);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mInsertIncRDates, index, rowid);
     SL3_bind_int(mInsertIncRDates, index, type);
     SL3_bind_date_time(mFormat, mInsertIncRDates, index, date, allDay);
@@ -904,6 +1494,87 @@ bool SqliteFormat::Private::insertAlarms(const Incidence &incidence, int rowid)
     return success;
 }
 
+bool SqliteFormat::Private::insertAlarmIndex(const Incidence &incidence,
+                                             const QByteArray &notebook, int rowid)
+{
+    int rv = 0;
+    int index = 1;
+    bool enabled = false;
+    QDateTime lastTrigger;
+
+    const Alarm::List alarms = incidence.alarms();
+    if (alarms.isEmpty()) {
+        return true;
+    }
+
+    // Recurring incidences without end may trigger alarms forever,
+    // for the others, the last trigger is the last alarm repetition
+    // of the last occurrence.
+    const QDateTime end = incidence.recurs()
+        ? incidence.recurrence()->endDateTime() : incidence.dtStart();
+    bool isBound = !incidence.recurs() || end.isValid();
+    for (const Alarm::Ptr &alarm : alarms) {
+        if (!alarm->enabled()) {
+            continue;
+        }
+        enabled = true;
+        QDateTime at = alarm->endTime();
+        if (at.isValid() && incidence.recurs() && incidence.dtStart().isValid()) {
+            at = at.addSecs(incidence.dtStart().secsTo(end));
+        }
+        if (!at.isValid()) {
+            isBound = false;
+        } else if (!lastTrigger.isValid() || at > lastTrigger) {
+            lastTrigger = at;
+        }
+    }
+
+    if (!mInsertAlarmIndex) {
+        const char *query = INSERT_ALARMINDEX;
+        int qsize = sizeof(INSERT_ALARMINDEX);
+        SL3_prepare_v2(mDatabase, query, qsize, &mInsertAlarmIndex, nullptr);
+    }
+    SL3_reset(mInsertAlarmIndex);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
+    SL3_bind_int(mInsertAlarmIndex, index, rowid);
+    SL3_bind_text(mInsertAlarmIndex, index, notebook.constData(), notebook.length(), SQLITE_STATIC);
+    if (isBound && lastTrigger.isValid()) {
+        SL3_bind_int64(mInsertAlarmIndex, index, mFormat->toOriginTime(lastTrigger));
+    } else {
+        SL3_bind_null(mInsertAlarmIndex, index);
+    }
+    SL3_bind_int(mInsertAlarmIndex, index, enabled ? 1 : 0);
+    SL3_step(mInsertAlarmIndex);
+
+    return true;
+
+error:
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(mDatabase);
+    return false;
+}
+
+bool SqliteFormat::Private::deleteAlarmIndex(int rowid)
+{
+    int rv = 0;
+    int index = 1;
+
+    if (!mDeleteAlarmIndex) {
+        const char *query = DELETE_ALARMINDEX;
+        int qsize = sizeof(DELETE_ALARMINDEX);
+        SL3_prepare_v2(mDatabase, query, qsize, &mDeleteAlarmIndex, nullptr);
+    }
+    SL3_reset(mDeleteAlarmIndex);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
+    SL3_bind_int(mDeleteAlarmIndex, index, rowid);
+    SL3_step(mDeleteAlarmIndex);
+
+    return true;
+
+error:
+    qCWarning(lcMkcal) << "Sqlite error:" << sqlite3_errmsg(mDatabase);
+    return false;
+}
+
 bool SqliteFormat::Private::insertAlarm(int rowid, const Alarm &alarm)
 {
     int rv = 0;
@@ -925,6 +1596,7 @@ bool SqliteFormat::Private::insertAlarm(int rowid, const Alarm &alarm)
         SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncAlarms, nullptr);
     }
     SL3_reset(mInsertIncAlarms);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mInsertIncAlarms, index, rowid);
 
     switch (type) {
@@ -1059,6 +1731,7 @@ bool SqliteFormat::Private::insertRecursive(int rowid, RecurrenceRule *rule, int
         SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncRecursives, nullptr);
     }
     SL3_reset(mInsertIncRecursives);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mInsertIncRecursives, index, rowid);
 
     SL3_bind_int(mInsertIncRecursives, index, type);
@@ -1176,6 +1849,7 @@ bool SqliteFormat::Private::insertAttendee(int rowid, const Attendee &attendee,
         SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncAttendees, nullptr);
     }
     SL3_reset(mInsertIncAttendees);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mInsertIncAttendees, index, rowid);
 
     email = attendee.email().toUtf8();
@@ -1220,6 +1894,7 @@ bool SqliteFormat::Private::insertAttachments(const Incidence &incidence, int ro
             SL3_prepare_v2(mDatabase, query, qsize, &mInsertIncAttachments, nullptr);
         }
         SL3_reset(mInsertIncAttachments);
+        MKCAL_METRICS_ADD(ChildStatements, 1);
         SL3_bind_int(mInsertIncAttachments, index, rowid);
         QByteArray uri; // must remain valid instance until end of the scope
         if (it->isBinary()) {
@@ -1320,7 +1995,8 @@ error:
 }
 //@endcond
 
-Notebook::Ptr SqliteFormat::selectCalendars(sqlite3_stmt *stmt, bool *isDefault)
+Notebook::Ptr SqliteFormat::selectCalendars(sqlite3_stmt *stmt, bool *isDefault,
+                                            const CalendarProperties *properties)
 {
     int rv = 0;
     Notebook::Ptr notebook;
@@ -1374,7 +2050,13 @@ Notebook::Ptr SqliteFormat::selectCalendars(sqlite3_stmt *stmt, bool *isDefault)
         notebook->setSyncProfile(syncProfile);
         notebook->setCreationDate(creationDate);
 
-        if (!d->selectCalendarProperties(notebook)) {
+        if (properties) {
+            const QHash<QByteArray, QString> values = properties->value(id);
+            for (QHash<QByteArray, QString>::ConstIterator it = values.constBegin();
+                 it != values.constEnd(); ++it) {
+                notebook->setCustomProperty(it.key(), it.value());
+            }
+        } else if (!d->selectCalendarProperties(notebook)) {
             qCWarning(lcMkcal) << "failed to get calendarproperties for notebook" << id;
         }
 
@@ -1390,6 +2072,35 @@ error:
     return notebook;
 }
 
+bool SqliteFormat::selectCalendarProperties(CalendarProperties *properties)
+{
+    int rv = 0;
+    sqlite3_stmt *stmt = nullptr;
+    bool success = false;
+
+    if (!properties)
+        return false;
+
+    const char *query = SELECT_CALENDARPROPERTIES_ALL;
+    int qsize = sizeof(SELECT_CALENDARPROPERTIES_ALL);
+    SL3_prepare_v2(d->mDatabase, query, qsize, &stmt, NULL);
+    do {
+        SL3_step(stmt);
+        if (rv == SQLITE_ROW) {
+            const QString id = QString::fromUtf8((const char *)sqlite3_column_text(stmt, 0));
+            const QByteArray name = (const char *)sqlite3_column_text(stmt, 1);
+            const QString value = QString::fromUtf8((const char *)sqlite3_column_text(stmt, 2));
+            (*properties)[id].insert(name, value);
+        }
+    } while (rv != SQLITE_DONE);
+    success = true;
+
+error:
+    sqlite3_finalize(stmt);
+
+    return success;
+}
+
 static QDateTime getDateTime(SqliteFormat *format, sqlite3_stmt *stmt, int index, bool *isDate = 0)
 {
     sqlite3_int64 date;
@@ -1438,7 +2149,8 @@ static QDateTime getDateTime(SqliteFormat *format, sqlite3_stmt *stmt, int index
     return dateTime;
 }
 
-Incidence::Ptr SqliteFormat::selectComponents(sqlite3_stmt *stmt1, QString &notebook)
+Incidence::Ptr SqliteFormat::selectComponents(sqlite3_stmt *stmt1, QString &notebook,
+                                              ColumnHashes *hashes)
 {
     int rv = 0;
     int index = 0;
@@ -1448,6 +2160,14 @@ Incidence::Ptr SqliteFormat::selectComponents(sqlite3_stmt *stmt1, QString &note
     SL3_step(stmt1);
 
     if (rv == SQLITE_ROW) {
+        // Before any conversion of the values by the reads below.
+        if (hashes) {
+            hashes->clear();
+            hashes->reserve(updatedColumnCount);
+            for (int i = 0; i < updatedColumnCount; i++) {
+                hashes->append(columnHash(stmt1, selectedColumns[i]));
+            }
+        }
 
         QByteArray type((const char *)sqlite3_column_text(stmt1, 2));
         if (type == "Event") {
@@ -1643,23 +2363,26 @@ Incidence::Ptr SqliteFormat::selectComponents(sqlite3_stmt *stmt1, QString &note
         incidence->setThisAndFuture(sqlite3_column_int(stmt1, index++));
 //    kDebug() << "loaded component for incidence" << incidence->uid() << "notebook" << notebook;
 
-        if (!d->selectCustomproperties(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get customproperties for incidence" << incidence->uid();
-        }
-        if (!d->selectAttendees(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get attendees for incidence" << incidence->uid();
-        }
-        if (!d->selectAlarms(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get alarms for incidence" << incidence->uid();
-        }
-        if (!d->selectRecursives(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get recursive for incidence" << incidence->uid();
-        }
-        if (!d->selectRdates(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get rdates for incidence" << incidence->uid();
-        }
-        if (!d->selectAttachments(incidence, rowid)) {
-            qCWarning(lcMkcal) << "failed to get attachments for incidence" << incidence->uid();
+        {
+            MKCAL_TRACE("sqlite", "select children");
+            if (!d->selectCustomproperties(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get customproperties for incidence" << incidence->uid();
+            }
+            if (!d->selectAttendees(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get attendees for incidence" << incidence->uid();
+            }
+            if (!d->selectAlarms(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get alarms for incidence" << incidence->uid();
+            }
+            if (!d->selectRecursives(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get recursive for incidence" << incidence->uid();
+            }
+            if (!d->selectRdates(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get rdates for incidence" << incidence->uid();
+            }
+            if (!d->selectAttachments(incidence, rowid)) {
+                qCWarning(lcMkcal) << "failed to get attachments for incidence" << incidence->uid();
+            }
         }
 
         // Backward compatibility with the old attachment storage.
@@ -1669,6 +2392,7 @@ Incidence::Ptr SqliteFormat::selectComponents(sqlite3_stmt *stmt1, QString &note
                 incidence->addAttachment(Attachment(*it));
             }
         }
+        MKCAL_METRICS_ADD(IncidencesDecoded, 1);
     }
 
 error:
@@ -1733,6 +2457,7 @@ bool SqliteFormat::Private::selectCustomproperties(Incidence::Ptr &incidence, in
     }
 
     SL3_reset(mSelectIncProperties);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncProperties, index, rowid);
     do {
         SL3_step(mSelectIncProperties);
@@ -1767,6 +2492,7 @@ bool SqliteFormat::Private::selectRdates(Incidence::Ptr &incidence, int rowid)
     }
 
     SL3_reset(mSelectIncRDates);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncRDates, index, rowid);
     do {
         SL3_step(mSelectIncRDates);
@@ -1810,6 +2536,7 @@ bool SqliteFormat::Private::selectRecursives(Incidence::Ptr &incidence, int rowi
     }
 
     SL3_reset(mSelectIncRecursives);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncRecursives, index, rowid);
     do {
         SL3_step(mSelectIncRecursives);
@@ -1968,6 +2695,7 @@ bool SqliteFormat::Private::selectAlarms(Incidence::Ptr &incidence, int rowid)
     }
 
     SL3_reset(mSelectIncAlarms);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncAlarms, index, rowid);
     do {
         SL3_step(mSelectIncAlarms);
@@ -2098,6 +2826,7 @@ bool SqliteFormat::Private::selectAttendees(Incidence::Ptr &incidence, int rowid
     }
 
     SL3_reset(mSelectIncAttendees);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncAttendees, index, rowid);
     do {
         SL3_step(mSelectIncAttendees);
@@ -2140,6 +2869,7 @@ bool SqliteFormat::Private::selectAttachments(Incidence::Ptr &incidence, int row
     }
 
     SL3_reset(mSelectIncAttachments);
+    MKCAL_METRICS_ADD(ChildStatements, 1);
     SL3_bind_int(mSelectIncAttachments, index, rowid);
     do {
         SL3_step(mSelectIncAttachments);
@@ -30,9 +30,13 @@
 #include "mkcal_export.h"
 #include "extendedstorage.h"
 #include "notebook.h"
+#include "storagemetrics_p.h"
 
 #include <KCalendarCore/Incidence>
 
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
 #include <sqlite3.h>
 
 namespace mKCal {
@@ -41,7 +45,8 @@ enum DBOperation {
     DBInsert,
     DBUpdate,
     DBMarkDeleted,
-    DBDelete
+    DBDelete,
+    DBUpsert
 };
 
 /*
@@ -96,41 +101,127 @@ public:
     */
     bool modifyCalendars(const Notebook &notebook, DBOperation dbop, sqlite3_stmt *stmt, bool isDefault);
 
+    // Custom properties of notebooks, by notebook uid.
+    typedef QHash<QString, QHash<QByteArray, QString>> CalendarProperties;
+
     /*
       Select notebooks from Calendars table.
 
       @param stmt prepared sqlite statement for calendars table
       @param isDefault true if the selected notebook is the DB default one
+      @param properties the custom properties of all notebooks, as
+      returned by selectCalendarProperties(), or null to query them
+      for this notebook only
       @return the queried notebook.
     */
-    Notebook::Ptr selectCalendars(sqlite3_stmt *stmt, bool *isDefault);
+    Notebook::Ptr selectCalendars(sqlite3_stmt *stmt, bool *isDefault,
+                                  const CalendarProperties *properties = nullptr);
+
+    /*
+      Select the custom properties of all notebooks in one query.
+
+      @param properties filled with the properties
+      @return true if the operation was successful; false otherwise.
+    */
+    bool selectCalendarProperties(CalendarProperties *properties);
+
+    /*
+      Hashes of the values of the columns of a component, as read by
+      selectComponents() or written by modifyComponents().
+    */
+    typedef QVector<uint> ColumnHashes;
 
     /*
       Update incidence data in Components table.
 
+      With DBUpsert, the incidence is inserted, or updated if it is
+      already stored in the same notebook, without prior lookup. It
+      fails if the incidence is already stored in another notebook.
+
+      With DBUpdate and the hashes of the stored values, only the
+      columns whose value changed are written.
+
       @param incidence incidence to update
       @param notebook notebook of incidence
       @param dbop database operation
+      @param inserted set with DBUpsert to true if the incidence was inserted
+      @param hashes optional, the hashes of the stored values, set to
+      the hashes of the written values on success
       @return true if the operation was successful; false otherwise.
     */
     bool modifyComponents(const KCalendarCore::Incidence &incidence, const QString &notebook,
-                          DBOperation dbop);
+                          DBOperation dbop, bool *inserted = nullptr,
+                          ColumnHashes *hashes = nullptr);
 
     bool purgeDeletedComponents(const KCalendarCore::Incidence &incidence,
                                 const QString &notebook = QString());
 
+    /*
+      Delete from Components table and its child tables the
+      components marked as deleted matching the UID and recurrence id
+      of the incidences in list, with one statement per table.
+
+      @param list incidences to purge
+      @param notebook notebook of the components, or any notebook if empty
+      @param purged set to the number of purged components
+      @return true if the operation was successful; false otherwise.
+    */
+    bool purgeDeletedComponents(const KCalendarCore::Incidence::List &list,
+                                const QString &notebook = QString(), int *purged = nullptr);
+
+    /*
+      Delete from Components table and its child tables the
+      components of a notebook marked as deleted before a date.
+
+      @param notebook notebook of the components
+      @param before components marked as deleted before this date are removed
+      @param limit maximum number of components to remove
+      @return the number of removed components, or -1 on error.
+    */
+    int purgeExpiredComponents(const QString &notebook, const QDateTime &before, int limit);
+
     /*
       Select incidences from Components table.
 
       @param stmt1 prepared sqlite statement for components table
       @param notebook notebook of incidence
+      @param hashes optional, set to the hashes of the read values
       @return the queried incidence.
     */
-    KCalendarCore::Incidence::Ptr selectComponents(sqlite3_stmt *stmt1, QString &notebook);
+    KCalendarCore::Incidence::Ptr selectComponents(sqlite3_stmt *stmt1, QString &notebook,
+                                                   ColumnHashes *hashes = nullptr);
 
     bool selectMetadata(int *id);
     bool incrementTransactionId(int *id);
 
+    /*
+      Select the notebooks modified by a transaction after the given one.
+
+      @param id a transaction id, as given by selectMetadata()
+      @param notebookUids the uids of the modified notebooks
+      @return true on success.
+    */
+    bool selectNotebookChanges(int id, QStringList *notebookUids);
+
+    /*
+      Record modifications for the transaction the current save will end
+      with, and remove the oldest records, keeping at most @p limit of them.
+
+      @param changes the modifications to record
+      @param limit the maximum number of records to keep
+      @return true on success.
+    */
+    bool insertChanges(const StorageChange::List &changes, int limit);
+
+    /*
+      Select the modifications recorded after the given transaction.
+
+      @param id a transaction id, as given by selectMetadata()
+      @param changes the recorded modifications, in order
+      @return true on success.
+    */
+    bool selectChanges(int id, StorageChange::List *changes);
+
     // Helper Functions //
 
     /*
@@ -207,6 +298,7 @@ private:
 {                                                                     \
  /* kDebug() << "SQL query:" << query;     */                         \
   rv = sqlite3_prepare_v2( (db), (query), (qsize), (stmt), (tail) );  \
+  MKCAL_METRICS_ADD( StatementsPrepared, 1 );                         \
   if ( rv ) {                                                         \
     qCWarning(lcMkcal) << "sqlite3_prepare error code:" << rv;                  \
     qCWarning(lcMkcal) << sqlite3_errmsg( (db) );                               \
@@ -264,9 +356,20 @@ private:
   index++;                                                            \
 }
 
+#define SL3_bind_null( stmt, index )                                  \
+{                                                                     \
+  rv = sqlite3_bind_null( (stmt), (index) );                          \
+  if ( rv ) {                                                         \
+    qCWarning(lcMkcal) << "sqlite3_bind_null error:" << rv << "on index:" << index; \
+    goto error;                                                       \
+  }                                                                   \
+  index++;                                                            \
+}
+
 #define SL3_step( stmt )                                \
 {                                                       \
   rv = sqlite3_step( (stmt) );                          \
+  MKCAL_METRICS_ADD( RowsStepped, rv == SQLITE_ROW );   \
   if ( rv && rv != SQLITE_DONE && rv != SQLITE_ROW ) {  \
     if ( rv != SQLITE_CONSTRAINT ) {                    \
       qCWarning(lcMkcal) << "sqlite3_step error:" << rv;          \
@@ -286,6 +389,12 @@ private:
 
 #define CREATE_METADATA \
   "CREATE TABLE IF NOT EXISTS Metadata(transactionId INTEGER)"
+// Last transaction that modified a notebook or its incidences.
+#define CREATE_NOTEBOOKCHANGES \
+  "CREATE TABLE IF NOT EXISTS NotebookChanges(Notebook TEXT PRIMARY KEY, transactionId INTEGER)"
+// Modifications done by the last transactions, for other processes.
+#define CREATE_CHANGELOG \
+  "CREATE TABLE IF NOT EXISTS Changelog(transactionId INTEGER, Notebook TEXT, Identifier TEXT, Operation INTEGER)"
 #define CREATE_CALENDARS \
   "CREATE TABLE IF NOT EXISTS Calendars(CalendarId TEXT PRIMARY KEY, Name TEXT, Description TEXT, Color INTEGER, " \
     "Flags INTEGER, syncDate INTEGER, pluginName TEXT, account TEXT, attachmentSize INTEGER, modifiedDate INTEGER, " \
@@ -304,7 +413,8 @@ private:
     "Attachments TEXT, Contact TEXT, InvitationStatus INTEGER, RecurId INTEGER, RecurIdLocal INTEGER, " \
     "RecurIdTimeZone TEXT, RelatedTo TEXT, URL TEXT, UID TEXT, Transparency INTEGER, LocalOnly INTEGER, Percent INTEGER, " \
     "DateCompleted INTEGER, DateCompletedLocal INTEGER, CompletedTimeZone TEXT, DateDeleted INTEGER, " \
-    "extra1 STRING, extra2 STRING, extra3 INTEGER, thisAndFuture INTEGER)"
+    "extra1 STRING, extra2 STRING, extra3 INTEGER, thisAndFuture INTEGER, " \
+    "CreatedSeq INTEGER DEFAULT 0, ChangeSeq INTEGER DEFAULT 0)"
 
 //Extra fields added for future use in case they are needed. They will be documented here
 //So we can add something without breaking the schema and not adding tables
@@ -331,6 +441,12 @@ private:
 #define CREATE_CALENDARPROPERTIES \
   "CREATE TABLE IF NOT EXISTS Calendarproperties(CalendarId REFERENCES Calendars(CalendarId) " \
     "ON DELETE CASCADE, Name TEXT NOT NULL, Value TEXT, UNIQUE (CalendarId, Name))"
+// One row per non deleted component with alarms. LastTrigger is the
+// latest time an alarm may trigger for this component, NULL when
+// it cannot be bound, like for never ending recurring events.
+#define CREATE_ALARMINDEX \
+  "CREATE TABLE IF NOT EXISTS Alarmindex(ComponentId INTEGER PRIMARY KEY, Notebook TEXT, " \
+    "LastTrigger INTEGER, Enabled INTEGER)"
 
 #define INDEX_CALENDAR \
 "CREATE INDEX IF NOT EXISTS IDX_CALENDAR on Calendars(CalendarId)"
@@ -340,6 +456,37 @@ private:
 "CREATE UNIQUE INDEX IF NOT EXISTS IDX_COMPONENT_UID on Components(UID, RecurId, DateDeleted)"
 #define INDEX_COMPONENT_NOTEBOOK \
 "CREATE INDEX IF NOT EXISTS IDX_COMPONENT_NOTEBOOK on Components(Notebook)"
+#define INDEX_COMPONENT_CHANGE \
+"CREATE INDEX IF NOT EXISTS IDX_COMPONENT_CHANGE on Components(ChangeSeq)"
+
+// The transaction id the current save will end with,
+// see SqliteFormat::incrementTransactionId().
+#define NEXT_TRANSACTION_ID \
+    "(coalesce((SELECT transactionId FROM Metadata WHERE rowid=1), -1) + 1)"
+#define TOUCH_NOTEBOOK(uid) \
+    "replace into NotebookChanges values (" uid ", " NEXT_TRANSACTION_ID "); "
+// CreatedSeq and ChangeSeq are set by the statements writing
+// the components, not to write each row a second time here.
+#define TRIGGER_COMPONENT_CREATED \
+"CREATE TRIGGER IF NOT EXISTS ComponentCreated AFTER INSERT ON Components BEGIN " \
+    TOUCH_NOTEBOOK("new.Notebook") "END"
+#define TRIGGER_COMPONENT_CHANGED \
+"CREATE TRIGGER IF NOT EXISTS ComponentChanged AFTER UPDATE ON Components BEGIN " \
+    TOUCH_NOTEBOOK("old.Notebook") TOUCH_NOTEBOOK("new.Notebook") "END"
+#define TRIGGER_COMPONENT_DELETED \
+"CREATE TRIGGER IF NOT EXISTS ComponentDeleted AFTER DELETE ON Components BEGIN " \
+    TOUCH_NOTEBOOK("old.Notebook") "END"
+#define TRIGGER_CALENDAR_CREATED \
+"CREATE TRIGGER IF NOT EXISTS CalendarCreated AFTER INSERT ON Calendars BEGIN " \
+    TOUCH_NOTEBOOK("new.CalendarId") "END"
+#define TRIGGER_CALENDAR_CHANGED \
+"CREATE TRIGGER IF NOT EXISTS CalendarChanged AFTER UPDATE ON Calendars BEGIN " \
+    TOUCH_NOTEBOOK("new.CalendarId") "END"
+#define TRIGGER_CALENDAR_DELETED \
+"CREATE TRIGGER IF NOT EXISTS CalendarDeleted AFTER DELETE ON Calendars BEGIN " \
+    TOUCH_NOTEBOOK("old.CalendarId") "END"
+#define INDEX_CHANGELOG \
+"CREATE INDEX IF NOT EXISTS IDX_CHANGELOG on Changelog(transactionId)"
 #define INDEX_RDATES \
 "CREATE INDEX IF NOT EXISTS IDX_RDATES on Rdates(ComponentId)"
 #define INDEX_CUSTOMPROPERTIES \
@@ -354,12 +501,15 @@ private:
 "CREATE INDEX IF NOT EXISTS IDX_ATTACHMENTS on Attachments(ComponentId)"
 #define INDEX_CALENDARPROPERTIES \
 "CREATE INDEX IF NOT EXISTS IDX_CALENDARPROPERTIES on Calendarproperties(CalendarId)"
+#define INDEX_ALARMINDEX \
+"CREATE INDEX IF NOT EXISTS IDX_ALARMINDEX on Alarmindex(Notebook, Enabled, LastTrigger)"
 
 #define INSERT_CALENDARS \
 "insert into Calendars values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, '', '')"
 #define INSERT_COMPONENTS \
 "insert into Components values (NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, " \
-    "?, ?, 0, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 0, ?, '', 0, ?)"
+    "?, ?, 0, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 0, ?, '', 0, ?, " \
+    NEXT_TRANSACTION_ID ", " NEXT_TRANSACTION_ID ")"
 #define INSERT_CUSTOMPROPERTIES \
 "insert into Customproperties values (?, ?, ?, ?)"
 #define INSERT_CALENDARPROPERTIES \
@@ -374,23 +524,25 @@ private:
 "insert into Attendee values (?, ?, ?, ?, ?, ?, ?, ?, ?)"
 #define INSERT_ATTACHMENTS \
 "insert into Attachments values (?, ?, ?, ?, ?, ?, ?)"
+#define INSERT_ALARMINDEX \
+"replace into Alarmindex values (?, ?, ?, ?)"
 
+#define INSERT_CHANGELOG \
+"insert into Changelog values (" NEXT_TRANSACTION_ID ", ?, ?, ?)"
 #define UPDATE_METADATA \
 "replace into Metadata (rowid, transactionId) values (1, ?)"
 #define UPDATE_CALENDARS \
 "update Calendars set Name=?, Description=?, Color=?, Flags=?, syncDate=?, pluginName=?, account=?, attachmentSize=?, " \
     "modifiedDate=?, sharedWith=?, syncProfile=?, createdDate=? where CalendarId=?"
-#define UPDATE_COMPONENTS \
-    "update Components set Notebook=?, Type=?, Summary=?, Category=?, DateStart=?, DateStartLocal=?, StartTimeZone=?, " \
-    "HasDueDate=?, DateEndDue=?, DateEndDueLocal=?, EndDueTimeZone=?, Duration=?, Classification=?, Location=?, " \
-    "Description=?, Status=?, GeoLatitude=?, GeoLongitude=?, Priority=?, Resources=?, DateCreated=?, DateStamp=?, " \
-    "DateLastModified=?, Sequence=?, Comments=?, Attachments=?, Contact=?, RecurId=?, RecurIdLocal=?, RecurIdTimeZone=?, " \
-    "RelatedTo=?, URL=?, UID=?, Transparency=?, LocalOnly=?, Percent=?, DateCompleted=?, DateCompletedLocal=?, " \
-    "CompletedTimeZone=?, extra1=?, thisAndFuture=? where ComponentId=?"
 #define UPDATE_COMPONENTS_AS_DELETED \
-"update Components set DateDeleted=? where ComponentId=?"
+"update Components set DateDeleted=?, ChangeSeq=" NEXT_TRANSACTION_ID " where ComponentId=?"
 //"update Components set DateDeleted=strftime('%s','now') where ComponentId=?"
 
+// Remove whole transactions, including the last one
+// when it alone is larger than the limit.
+#define DELETE_CHANGELOG \
+"delete from Changelog where transactionId<=(select transactionId from Changelog " \
+    "where rowid<=(select max(rowid) from Changelog)-? order by rowid desc limit 1)"
 #define DELETE_CALENDARS \
 "delete from Calendars where CalendarId=?"
 #define DELETE_COMPONENTS \
@@ -409,9 +561,15 @@ private:
 "delete from Attendee where ComponentId=?"
 #define DELETE_ATTACHMENTS \
 "delete from Attachments where ComponentId=?"
+#define DELETE_ALARMINDEX \
+"delete from Alarmindex where ComponentId=?"
 
 #define SELECT_METADATA \
 "select * from Metadata where rowid=1"
+#define SELECT_CHANGELOG \
+"select * from Changelog where transactionId>? order by rowid"
+#define SELECT_NOTEBOOKCHANGES \
+"select Notebook from NotebookChanges where transactionId>?"
 #define SELECT_CALENDARS_ALL \
 "select * from Calendars order by Name"
 #define SELECT_COMPONENTS_ALL \
@@ -433,8 +591,15 @@ private:
 "select * from Components where UID=? and DateDeleted=0"
 #define SELECT_COMPONENTS_BY_NOTEBOOKUID \
 "select * from Components where Notebook=? and DateDeleted=0"
+#define SELECT_COMPONENTS_BY_ALARMS \
+"select * from Components where UID in (select UID from Components join Alarmindex using (ComponentId) " \
+    "where Alarmindex.Notebook=? and Enabled=1 and (LastTrigger is null or LastTrigger>=?)) " \
+    "and Notebook=? and DateDeleted=0"
 #define SELECT_ROWID_FROM_COMPONENTS_BY_NOTEBOOK_UID_AND_RECURID \
 "select ComponentId from Components where Notebook=? and UID=? and RecurId=? and DateDeleted=0"
+// Also tells if the component has been created by the current save.
+#define SELECT_UPSERTED_COMPONENT \
+"select ComponentId, CreatedSeq=" NEXT_TRANSACTION_ID " from Components where UID=? and RecurId=? and DateDeleted=0"
 
 #define SELECT_RDATES_BY_ID \
 "select * from Rdates where ComponentId=?"
@@ -450,6 +615,8 @@ private:
 "select * from Attachments where ComponentId=?"
 #define SELECT_CALENDARPROPERTIES_BY_ID \
 "select * from Calendarproperties where CalendarId=?"
+#define SELECT_CALENDARPROPERTIES_ALL \
+"select * from Calendarproperties"
 #define SELECT_COMPONENTS_BY_CREATED \
 "select * from Components where DateCreated>=? and DateDeleted=0"
 #define SELECT_COMPONENTS_BY_CREATED_AND_NOTEBOOK \
@@ -462,10 +629,16 @@ private:
 "select * from Components where DateDeleted>=? and DateCreated<?"
 #define SELECT_COMPONENTS_BY_DELETED_AND_NOTEBOOK \
 "select * from Components where DateDeleted>=? and DateCreated<? and Notebook=?"
+#define SELECT_COMPONENTS_BY_CHANGE \
+"select *, CreatedSeq, DateDeleted from Components where ChangeSeq>?"
+#define SELECT_COMPONENTS_BY_CHANGE_AND_NOTEBOOK \
+"select *, CreatedSeq, DateDeleted from Components where ChangeSeq>? and Notebook=?"
 #define SELECT_COMPONENTS_BY_UID_RECID_AND_DELETED \
 "select ComponentId, DateDeleted from Components where UID=? and RecurId=? and DateDeleted<>0"
 #define SELECT_COMPONENTS_BY_NOTEBOOK_UID_RECID_AND_DELETED \
 "select ComponentId from Components where Notebook=? and UID=? and RecurId=? and DateDeleted<>0"
+#define SELECT_ROWID_FROM_COMPONENTS_BY_NOTEBOOK_AND_EXPIRED \
+"select ComponentId from Components where Notebook=? and DateDeleted<>0 and DateDeleted<? limit ?"
 
 #define SEARCH_COMPONENTS \
 "select *, (ComponentId in (select DISTINCT ComponentId from Recursive)" \
@@ -474,12 +647,43 @@ private:
 "                                       or description like ? escape '\\'" \
 "                                       or location like ? escape '\\') order by doRecur desc, datestart desc"
 
+// Used when migrating from version 2, trigger times are approximated
+// from the stored columns with a one day margin for clock times.
+#define MIGRATE_ALARMINDEX \
+"insert or replace into Alarmindex select ComponentId, Notebook, " \
+"  case when ComponentId in (select ComponentId from Recursive) " \
+"         or ComponentId in (select ComponentId from Rdates) then NULL " \
+"  else max(case when Alarm.DateTrigger<>0 then Alarm.DateTrigger " \
+"                else max(Components.DateStart, Components.DateEndDue) + Alarm.Offset end " \
+"           + Alarm.Repeat * Alarm.Duration) + 86400 end, " \
+"  max(Alarm.isEnabled) " \
+"from Components join Alarm using (ComponentId) where DateDeleted=0 group by ComponentId"
+
 #define UNSET_FLAG_FROM_CALENDAR \
 "update Calendars set Flags=(Flags & (~?))"
 
+// Temporary tables holding the components to purge.
+#define CREATE_PURGE_TABLES \
+"create temp table if not exists PurgeTargets(UID TEXT, RecurId INTEGER);" \
+"create temp table if not exists PurgeRows(ComponentId INTEGER PRIMARY KEY)"
+#define CLEAR_PURGE_TABLES \
+"delete from temp.PurgeTargets; delete from temp.PurgeRows"
+#define INSERT_PURGE_TARGET \
+"insert into temp.PurgeTargets values (?, ?)"
+#define SELECT_PURGE_ROWS \
+"insert or ignore into temp.PurgeRows select ComponentId from temp.PurgeTargets " \
+    "join Components using (UID, RecurId) where DateDeleted<>0"
+#define SELECT_PURGE_ROWS_BY_NOTEBOOK \
+"insert or ignore into temp.PurgeRows select ComponentId from temp.PurgeTargets " \
+    "join Components using (UID, RecurId) where DateDeleted<>0 and Notebook=?"
+#define PURGE_ROWS(table) \
+"delete from " table " where ComponentId in (select ComponentId from temp.PurgeRows)"
+
 #define BEGIN_TRANSACTION \
 "BEGIN IMMEDIATE;"
 #define COMMIT_TRANSACTION \
 "END;"
+#define ROLLBACK_TRANSACTION \
+"ROLLBACK;"
 
 #endif
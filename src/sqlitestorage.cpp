@@ -33,7 +33,9 @@
 */
 #include "sqlitestorage.h"
 #include "sqliteformat.h"
+#include "sqlitewriter_p.h"
 #include "logging_p.h"
+#include "memoryusage_p.h"
 
 #include <KCalendarCore/MemoryCalendar>
 #include <KCalendarCore/ICalFormat>
@@ -44,6 +46,8 @@ using namespace KCalendarCore;
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QTimer>
 #include <QtCore/QUuid>
 
 #include <iostream>
@@ -58,10 +62,18 @@ using namespace std;
 using namespace mKCal;
 
 static const QString gChanged(QLatin1String(".changed"));
+static const QString gAlarms(QLatin1String(".alarms"));
+// The user_version set after the createStatements, in the
+// same transaction, so that a database with this version has
+// every table, index and trigger.
+static const int gSchemaVersion = 7;
+static const char *gSetSchemaVersion = "PRAGMA user_version = 7";
 
 static const char *createStatements[] =
 {
     CREATE_METADATA,
+    CREATE_NOTEBOOKCHANGES,
+    CREATE_CHANGELOG,
     CREATE_CALENDARS,
     CREATE_COMPONENTS,
     CREATE_RDATES,
@@ -71,11 +83,20 @@ static const char *createStatements[] =
     CREATE_ATTENDEE,
     CREATE_ATTACHMENTS,
     CREATE_CALENDARPROPERTIES,
+    CREATE_ALARMINDEX,
     /* Create index on frequently used columns */
     INDEX_CALENDAR,
     INDEX_COMPONENT,
     INDEX_COMPONENT_UID,
     INDEX_COMPONENT_NOTEBOOK,
+    INDEX_COMPONENT_CHANGE,
+    TRIGGER_COMPONENT_CREATED,
+    TRIGGER_COMPONENT_CHANGED,
+    TRIGGER_COMPONENT_DELETED,
+    TRIGGER_CALENDAR_CREATED,
+    TRIGGER_CALENDAR_CHANGED,
+    TRIGGER_CALENDAR_DELETED,
+    INDEX_CHANGELOG,
     INDEX_RDATES,
     INDEX_CUSTOMPROPERTIES,
     INDEX_RECURSIVE,
@@ -83,8 +104,7 @@ static const char *createStatements[] =
     INDEX_ATTENDEE,
     INDEX_ATTACHMENTS,
     INDEX_CALENDARPROPERTIES,
-    "PRAGMA foreign_keys = ON",
-    "PRAGMA user_version = 2"
+    INDEX_ALARMINDEX
 };
 
 /**
@@ -106,11 +126,18 @@ public:
           mSem(databaseName, 1, QSystemSemaphore::Open),
 #endif
           mChanged(databaseName + gChanged),
+          mAlarms(databaseName + gAlarms),
           mWatcher(0),
           mFormat(0),
           mIsLoading(false),
           mIsSaved(false)
     {
+        bool ok = false;
+        int threshold = qEnvironmentVariableIntValue("MKCAL_SLOW_QUERY_MS", &ok);
+        if (ok) {
+            mSlowQueryThreshold = threshold;
+        }
+        mExplainQueries = qEnvironmentVariableIsSet("MKCAL_EXPLAIN_QUERIES");
     }
 
     ~Private()
@@ -127,6 +154,9 @@ public:
 #endif
 
     QFile mChanged;
+    QFile mAlarms;
+    // Set when this process is the one that touched mAlarms.
+    bool mAlarmsTouched = false;
     QFileSystemWatcher *mWatcher;
     int mSavedTransactionId;
     sqlite3 *mDatabase = nullptr;
@@ -134,17 +164,134 @@ public:
     QHash<QString, Incidence::Ptr> mIncidencesToInsert;
     QHash<QString, Incidence::Ptr> mIncidencesToUpdate;
     QHash<QString, Incidence::Ptr> mIncidencesToDelete;
+    // Hashes of the stored values of the loaded incidences, by
+    // instance identifier, so that updates only write changed columns.
+    QHash<QString, SqliteFormat::ColumnHashes> mColumnHashes;
     bool mIsLoading;
     bool mIsSaved;
+    int mSlowQueryThreshold = -1;
+    bool mExplainQueries = false;
+    QTimer mTombstoneTimer;
+    int mBatchDepth = 0;
+    bool mPendingNotification = false;
+    QTimer mNotificationTimer;
+    QTimer mChangedTimer;
+    QString mChangedPath;
+    bool mWriteBehind = false;
+    SqliteWriter *mWriter = nullptr;
+    bool mLazyNotebooks = false;
+    // Set when open() deferred the creation of the default notebook.
+    bool mDefaultNotebookPending = false;
+    // A read-only connection to compute query plans, since the
+    // traced connection cannot be used from the trace callback.
+    sqlite3 *mExplainDatabase = nullptr;
+    QSet<QByteArray> mExplainedQueries;
+
+    // Maximum number of modifications kept for other processes.
+    static const int CHANGELOG_SIZE = 1000;
 
     bool addIncidence(const Incidence::Ptr &incidence, const QString &notebookUid);
+    int schemaVersion();
+    bool ensureDefaultNotebook();
     bool loadRecurringIncidences();
     bool saveNotebook(const Notebook::Ptr &nb, DBOperation dbop);
     int loadIncidences(sqlite3_stmt *stmt1);
     int loadIncidencesBySeries(sqlite3_stmt *stmt1, QStringList *identifiers = nullptr, int limit = 0);
     bool saveIncidences(QHash<QString, Incidence::Ptr> &list, DBOperation dbop,
                         Incidence::List *savedIncidences);
+    bool acquireLock();
+    void waitForWrites();
+    bool saveBehind(ExtendedStorage::DeleteAction deleteAction);
+    bool processCommitted();
+    bool flushWrites();
+    void notify();
+    void touchChanged();
+    void checkChanged();
+    void appendChanges(StorageChange::List *changes, const Incidence::List &list,
+                       StorageChange::Operation operation,
+                       const QString &notebookUid = QString());
+    bool logChanges(const StorageChange::List &changes);
+    void installTrace();
+    void explain(sqlite3_stmt *stmt);
+    static int trace(unsigned int type, void *context, void *p, void *x);
 };
+
+void SqliteStorage::Private::installTrace()
+{
+    if (!mDatabase) {
+        return;
+    }
+
+    if (mSlowQueryThreshold >= 0 || mExplainQueries) {
+        sqlite3_trace_v2(mDatabase, SQLITE_TRACE_PROFILE, trace, this);
+    } else {
+        sqlite3_trace_v2(mDatabase, 0, nullptr, nullptr);
+    }
+}
+
+int SqliteStorage::Private::trace(unsigned int type, void *context, void *p, void *x)
+{
+    if (type != SQLITE_TRACE_PROFILE) {
+        return 0;
+    }
+
+    Private *d = static_cast<Private*>(context);
+    sqlite3_stmt *stmt = static_cast<sqlite3_stmt*>(p);
+    const sqlite3_int64 ns = *static_cast<sqlite3_int64*>(x);
+    if (d->mSlowQueryThreshold >= 0
+        && ns >= sqlite3_int64(d->mSlowQueryThreshold) * 1000000) {
+        char *sql = sqlite3_expanded_sql(stmt);
+        qCWarning(lcMkcal) << "slow query," << ns / 1000 << "us:"
+                           << (sql ? sql : sqlite3_sql(stmt));
+        sqlite3_free(sql);
+    }
+    if (d->mExplainQueries) {
+        d->explain(stmt);
+    }
+
+    return 0;
+}
+
+void SqliteStorage::Private::explain(sqlite3_stmt *stmt)
+{
+    const char *sql = sqlite3_sql(stmt);
+    if (!sql || mExplainedQueries.contains(QByteArray(sql))) {
+        return;
+    }
+    mExplainedQueries.insert(QByteArray(sql));
+
+    if (!mExplainDatabase) {
+        if (sqlite3_open_v2(mDatabaseName.toUtf8(), &mExplainDatabase,
+                            SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            qCWarning(lcMkcal) << "cannot open" << mDatabaseName << "to explain queries";
+            sqlite3_close(mExplainDatabase);
+            mExplainDatabase = nullptr;
+            mExplainQueries = false;
+            installTrace();
+            return;
+        }
+        sqlite3_busy_timeout(mExplainDatabase, 1500);
+    }
+
+    // Statements on tables created in a pending transaction
+    // cannot be explained, this is not an error.
+    sqlite3_stmt *plan = nullptr;
+    const QByteArray query = QByteArray("EXPLAIN QUERY PLAN ") + sql;
+    if (sqlite3_prepare_v2(mExplainDatabase, query.constData(), -1, &plan, nullptr) != SQLITE_OK) {
+        qCDebug(lcMkcal) << "cannot explain" << sql << sqlite3_errmsg(mExplainDatabase);
+        sqlite3_finalize(plan);
+        return;
+    }
+    // Older sqlite versions report "SCAN TABLE Components".
+    static const QRegularExpression fullScan(QStringLiteral("^SCAN (TABLE )?Components\\b"));
+    while (sqlite3_step(plan) == SQLITE_ROW) {
+        const QString detail = QString::fromUtf8((const char *)sqlite3_column_text(plan, 3));
+        if (fullScan.match(detail).hasMatch()) {
+            qCWarning(lcMkcal) << "full scan of Components," << detail << "in:" << sql;
+        }
+    }
+    sqlite3_finalize(plan);
+}
 //@endcond
 
 SqliteStorage::SqliteStorage(const ExtendedCalendar::Ptr &cal, const QString &databaseName,
@@ -152,6 +299,36 @@ SqliteStorage::SqliteStorage(const ExtendedCalendar::Ptr &cal, const QString &da
     : ExtendedStorage(cal, validateNotebooks),
       d(new Private(cal, this, databaseName))
 {
+    connect(&d->mTombstoneTimer, &QTimer::timeout, this, [this] {
+        if (d->mDatabase) {
+            purgeExpiredTombstones();
+        }
+    });
+
+    d->mNotificationTimer.setSingleShot(true);
+    connect(&d->mNotificationTimer, &QTimer::timeout, this, [this] {
+        if (d->mBatchDepth == 0 && d->mPendingNotification) {
+            d->touchChanged();
+        }
+    });
+    // Changes signaled in a row are checked at once.
+    d->mChangedTimer.setSingleShot(true);
+    d->mChangedTimer.setInterval(0);
+    connect(&d->mChangedTimer, &QTimer::timeout, this, [this] {
+        d->checkChanged();
+    });
+
+    bool ok = false;
+    int interval = qEnvironmentVariableIntValue("MKCAL_TOMBSTONE_GC_INTERVAL", &ok);
+    if (ok && interval > 0) {
+        setTombstoneCollectionInterval(interval * 1000);
+    }
+    int delay = qEnvironmentVariableIntValue("MKCAL_NOTIFY_DELAY_MS", &ok);
+    if (ok && delay > 0) {
+        setNotificationDelay(delay);
+    }
+    d->mWriteBehind = qEnvironmentVariableIntValue("MKCAL_WRITE_BEHIND") > 0;
+    d->mLazyNotebooks = qEnvironmentVariableIntValue("MKCAL_LAZY_NOTEBOOKS") > 0;
 }
 
 // QDir::isReadable() doesn't support group permissions, only user permissions.
@@ -207,21 +384,24 @@ QString SqliteStorage::databaseName() const
     return d->mDatabaseName;
 }
 
+QString SqliteStorage::defaultDatabaseName()
+{
+    return defaultLocation();
+}
+
 bool SqliteStorage::open()
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::Open);
     int rv;
     char *errmsg = NULL;
     const char *query = NULL;
+    int version = 0;
+    bool locked = false;
 
     if (d->mDatabase) {
         return false;
     }
 
-    if (!d->mSem.acquire()) {
-        qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
-        return false;
-    }
-
     rv = sqlite3_open(d->mDatabaseName.toUtf8(), &d->mDatabase);
     if (rv) {
         qCWarning(lcMkcal) << "sqlite3_open error:" << rv << "on database" << d->mDatabaseName;
@@ -229,39 +409,125 @@ bool SqliteStorage::open()
         goto error;
     }
     qCDebug(lcMkcal) << "database" << d->mDatabaseName << "opened";
+    d->installTrace();
 
     // Set one and half second busy timeout for waiting for internal sqlite locks
     sqlite3_busy_timeout(d->mDatabase, 1500);
 
-    {
-        sqlite3_stmt *dbVersion = nullptr;
-        SL3_prepare_v2(d->mDatabase, "PRAGMA user_version", -1, &dbVersion, nullptr);
-        SL3_step(dbVersion);
-        int version = 0;
-        if (rv == SQLITE_ROW) {
-            version = sqlite3_column_int(dbVersion, 0);
-        }
-        sqlite3_finalize(dbVersion);
-
-        if (version == 1) {
-            qCWarning(lcMkcal) << "Migrating mkcal database to version 2";
-            query = BEGIN_TRANSACTION;
-            SL3_exec(d->mDatabase);
-            query = "ALTER TABLE Components ADD COLUMN thisAndFuture INTEGER";
-            SL3_try_exec(d->mDatabase); // Ignore error if any, consider that column already exists.
-            query = "PRAGMA user_version = 2";
-            SL3_exec(d->mDatabase);
-            query = COMMIT_TRANSACTION;
-            SL3_exec(d->mDatabase);
-
-            version = 2;
+    // Opening a database with a current schema needs neither
+    // the lock nor any DDL.
+    version = d->schemaVersion();
+    if (version != gSchemaVersion) {
+        if (!d->acquireLock()) {
+            qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+            goto error;
         }
+        locked = true;
+        // Another process may have upgraded it meanwhile.
+        version = d->schemaVersion();
+    }
+    if (version < 0) {
+        goto error;
     }
 
-    for (unsigned int i = 0; i < (sizeof(createStatements)/sizeof(createStatements[0])); i++) {
-         query = createStatements[i];
-         SL3_exec(d->mDatabase);
+    if (version == 1) {
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 2";
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        query = "ALTER TABLE Components ADD COLUMN thisAndFuture INTEGER";
+        SL3_try_exec(d->mDatabase); // Ignore error if any, consider that column already exists.
+        query = "PRAGMA user_version = 2";
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+
+        version = 2;
+    }
+    if (version == 2) {
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 3";
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        query = CREATE_ALARMINDEX;
+        SL3_exec(d->mDatabase);
+        query = MIGRATE_ALARMINDEX;
+        SL3_exec(d->mDatabase);
+        query = "PRAGMA user_version = 3";
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+
+        version = 3;
+    }
+    if (version == 3) {
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 4";
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        query = "ALTER TABLE Components ADD COLUMN CreatedSeq INTEGER DEFAULT 0";
+        SL3_try_exec(d->mDatabase); // Ignore error if any, consider that column already exists.
+        query = "ALTER TABLE Components ADD COLUMN ChangeSeq INTEGER DEFAULT 0";
+        SL3_try_exec(d->mDatabase);
+        query = "PRAGMA user_version = 4";
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+
+        version = 4;
+    }
+    if (version == 4) {
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 5";
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        query = CREATE_NOTEBOOKCHANGES;
+        SL3_exec(d->mDatabase);
+        query = "PRAGMA user_version = 5";
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+
+        version = 5;
+    }
+    if (version == 5) {
+        // The changelog is created with the other tables below.
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 6";
+        version = 6;
+    }
+    if (version == 6) {
+        // The component triggers are created again below,
+        // without updating the rows they are fired for.
+        qCWarning(lcMkcal) << "Migrating mkcal database to version 7";
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        query = "DROP TRIGGER IF EXISTS ComponentCreated";
+        SL3_exec(d->mDatabase);
+        query = "DROP TRIGGER IF EXISTS ComponentChanged";
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+    }
+
+    // Migrations rely on these to create new tables, indexes and triggers.
+    // An interrupted migration leaves a previous version, so they are
+    // created again on next open.
+    if (locked) {
+        if (version == 0) {
+            // Only applies to new databases, mkcaltool --vacuum
+            // can then release free pages without a full vacuum.
+            query = "PRAGMA auto_vacuum = INCREMENTAL";
+            SL3_exec(d->mDatabase);
+        }
+        query = BEGIN_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        for (unsigned int i = 0; i < (sizeof(createStatements)/sizeof(createStatements[0])); i++) {
+            query = createStatements[i];
+            SL3_exec(d->mDatabase);
+        }
+        query = gSetSchemaVersion;
+        SL3_exec(d->mDatabase);
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
     }
+    query = "PRAGMA foreign_keys = ON";
+    SL3_exec(d->mDatabase);
 
     d->mFormat = new SqliteFormat(d->mDatabase);
     d->mFormat->selectMetadata(&d->mSavedTransactionId);
@@ -272,12 +538,26 @@ bool SqliteStorage::open()
     }
     d->mWatcher = new QFileSystemWatcher();
     d->mWatcher->addPath(d->mChanged.fileName());
+    if (d->mAlarms.open(QIODevice::Append)) {
+        d->mWatcher->addPath(d->mAlarms.fileName());
+    } else {
+        qCWarning(lcMkcal) << "cannot open alarms file for" << d->mDatabaseName;
+    }
     connect(d->mWatcher, &QFileSystemWatcher::fileChanged,
             this, &SqliteStorage::fileChanged);
 
-    if (!d->mSem.release()) {
-        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
-        goto error;
+    if (locked) {
+        locked = false;
+        if (!d->mSem.release()) {
+            qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+            goto error;
+        }
+    }
+
+    if (d->mLazyNotebooks) {
+        deferNotebookLoading();
+        d->mDefaultNotebookPending = true;
+        return true;
     }
 
     if (!loadNotebooks()) {
@@ -285,33 +565,140 @@ bool SqliteStorage::open()
         goto error;
     }
 
-    if (notebooks().isEmpty() || !defaultNotebook()) {
+    if (!d->ensureDefaultNotebook()) {
+        close();
+        return false;
+    }
+
+    return true;
+
+error:
+    if (locked && !d->mSem.release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    }
+    close();
+    return false;
+}
+
+void SqliteStorage::setLazyNotebooks(bool enabled)
+{
+    d->mLazyNotebooks = enabled;
+}
+
+bool SqliteStorage::lazyNotebooks() const
+{
+    return d->mLazyNotebooks;
+}
+
+//@cond PRIVATE
+// Returns the user_version of the database, -1 on error.
+int SqliteStorage::Private::schemaVersion()
+{
+    int rv = 0;
+    int version = -1;
+    sqlite3_stmt *stmt = nullptr;
+
+    SL3_prepare_v2(mDatabase, "PRAGMA user_version", -1, &stmt, nullptr);
+    SL3_step(stmt);
+    version = (rv == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : 0;
+
+error:
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+bool SqliteStorage::Private::ensureDefaultNotebook()
+{
+    if (mStorage->notebooks().isEmpty() || !mStorage->defaultNotebook()) {
         qCDebug(lcMkcal) << "Storage has no default notebook, adding one";
         Notebook::Ptr defaultNb(new Notebook(QString::fromLatin1("Default"),
                                              QString(),
                                              QString::fromLatin1("#0000FF")));
-        if (!setDefaultNotebook(defaultNb)) {
+        if (!mStorage->setDefaultNotebook(defaultNb)) {
             qCWarning(lcMkcal) << "Unable to add a default notebook.";
-            close();
             return false;
         }
     }
-
     return true;
+}
+//@endcond
 
-error:
-    if (!d->mSem.release()) {
-        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+void SqliteStorage::setSlowQueryThreshold(int msec)
+{
+    d->mSlowQueryThreshold = msec;
+    d->installTrace();
+}
+
+int SqliteStorage::slowQueryThreshold() const
+{
+    return d->mSlowQueryThreshold;
+}
+
+void SqliteStorage::setExplainQueries(bool explain)
+{
+    d->mExplainQueries = explain;
+    d->installTrace();
+}
+
+bool SqliteStorage::explainQueries() const
+{
+    return d->mExplainQueries;
+}
+
+static void addPending(MemoryUsage::Private::Usage *usage, const QHash<QString, Incidence::Ptr> &hash)
+{
+    for (QHash<QString, Incidence::Ptr>::ConstIterator it = hash.constBegin();
+         it != hash.constEnd(); it++) {
+        // A hash node holds the key, the value, a hash and a next pointer.
+        usage->add(sizeof(QString) + sizeof(Incidence::Ptr) + 2 * sizeof(void*)
+                   + quint64(it.key().capacity() + 1) * sizeof(QChar));
     }
-    close();
-    return false;
+}
+
+MemoryUsage SqliteStorage::memoryUsage() const
+{
+    MemoryUsage usage = d->mCalendar->memoryUsage();
+    MemoryUsage::Private *values = MemoryUsage::Private::get(&usage);
+
+    addPending(&values->usages[MemoryUsage::PendingInserts], d->mIncidencesToInsert);
+    addPending(&values->usages[MemoryUsage::PendingUpdates], d->mIncidencesToUpdate);
+    addPending(&values->usages[MemoryUsage::PendingDeletes], d->mIncidencesToDelete);
+    values->sizes[MemoryUsage::SqliteHeapBytes] = quint64(sqlite3_memory_used());
+
+    if (d->mDatabase) {
+        int current = 0;
+        int highwater = 0;
+        MemoryUsage::Private::Usage &statements = values->usages[MemoryUsage::Statements];
+        if (sqlite3_db_status(d->mDatabase, SQLITE_DBSTATUS_STMT_USED,
+                              &current, &highwater, 0) == SQLITE_OK) {
+            statements.bytes = quint64(current);
+        }
+        for (sqlite3_stmt *stmt = sqlite3_next_stmt(d->mDatabase, nullptr);
+             stmt; stmt = sqlite3_next_stmt(d->mDatabase, stmt)) {
+            statements.count += 1;
+        }
+        if (sqlite3_db_status(d->mDatabase, SQLITE_DBSTATUS_CACHE_USED,
+                              &current, &highwater, 0) == SQLITE_OK) {
+            values->sizes[MemoryUsage::PageCacheBytes] = quint64(current);
+        }
+        if (sqlite3_db_status(d->mDatabase, SQLITE_DBSTATUS_SCHEMA_USED,
+                              &current, &highwater, 0) == SQLITE_OK) {
+            values->sizes[MemoryUsage::SchemaBytes] = quint64(current);
+        }
+    }
+
+    return usage;
 }
 
 bool SqliteStorage::load()
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::Load);
     if (!d->mDatabase) {
         return false;
     }
+    // The calendar needs the notebooks of the loaded incidences,
+    // they are loaded before locking the database.
+    loadDeferredNotebooks();
 
     int rv = 0;
     int count = -1;
@@ -342,10 +729,13 @@ error:
 
 bool SqliteStorage::load(const QString &uid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::LoadUid);
     if (!d->mDatabase) {
         return false;
     }
 
+    loadDeferredNotebooks();
+
     // Don't reload an existing incidence from DB.
     // Either the calendar is already in sync with
     // the calendar or the database has been externally
@@ -383,10 +773,13 @@ error:
 
 bool SqliteStorage::load(const QDate &start, const QDate &end)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::LoadRange);
     if (!d->mDatabase) {
         return false;
     }
 
+    loadDeferredNotebooks();
+
     // We have no way to know if a recurring incidence
     // is happening within [start, end[, so load them all.
     if ((start.isValid() || end.isValid())
@@ -452,15 +845,22 @@ bool SqliteStorage::load(const QDate &start, const QDate &end)
 error:
     d->mIsLoading = false;
 
+    if (count > 0) {
+        evictLoadedRanges(start, end);
+    }
+
     return count >= 0;
 }
 
 bool SqliteStorage::loadNotebookIncidences(const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::LoadNotebook);
     if (!d->mDatabase) {
         return false;
     }
 
+    loadDeferredNotebooks();
+
     int rv = 0;
     int count = -1;
     d->mIsLoading = true;
@@ -485,11 +885,16 @@ bool SqliteStorage::loadNotebookIncidences(const QString &notebookUid)
 error:
     d->mIsLoading = false;
 
+    if (count >= 0) {
+        addLoadedNotebook(notebookUid);
+    }
+
     return count >= 0;
 }
 
 bool SqliteStorage::Private::loadRecurringIncidences()
 {
+    MetricsScope scope(mStorage->metricsCollector(), StorageMetrics::LoadRecurring);
     if (!mDatabase) {
         return false;
     }
@@ -524,9 +929,11 @@ error:
 
 bool SqliteStorage::search(const QString &key, QStringList *identifiers, int limit)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::Search);
     if (!d->mDatabase || key.isEmpty())
         return false;
 
+    loadDeferredNotebooks();
     d->mIsLoading = true;
     const char *query1 = SEARCH_COMPONENTS;
     int qsize1 = sizeof(SEARCH_COMPONENTS);
@@ -587,14 +994,17 @@ int SqliteStorage::Private::loadIncidences(sqlite3_stmt *stmt1)
     int count = 0;
     Incidence::Ptr incidence;
     QString notebookUid;
+    SqliteFormat::ColumnHashes hashes;
 
-    if (!mSem.acquire()) {
+    waitForWrites();
+    if (!acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << mDatabaseName << "error" << mSem.errorString();
         return -1;
     }
 
-    while ((incidence = mFormat->selectComponents(stmt1, notebookUid))) {
+    while ((incidence = mFormat->selectComponents(stmt1, notebookUid, &hashes))) {
         if (addIncidence(incidence, notebookUid)) {
+            mColumnHashes.insert(incidence->instanceIdentifier(), hashes);
             // qCDebug(lcMkcal) << "updating incidence" << incidence->uid()
             //                  << incidence->dtStart() << endDateTime
             //                  << "in calendar";
@@ -618,15 +1028,18 @@ int SqliteStorage::Private::loadIncidencesBySeries(sqlite3_stmt *stmt1, QStringL
     Incidence::Ptr incidence;
     QString notebookUid;
     QSet<QString> recurringUids;
+    SqliteFormat::ColumnHashes hashes;
 
-    if (!mSem.acquire()) {
+    waitForWrites();
+    if (!acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << mDatabaseName << "error" << mSem.errorString();
         return -1;
     }
 
-    while ((incidence = mFormat->selectComponents(stmt1, notebookUid))
+    while ((incidence = mFormat->selectComponents(stmt1, notebookUid, &hashes))
            && (limit <= 0 || count < limit)) {
         if (addIncidence(incidence, notebookUid)) {
+            mColumnHashes.insert(incidence->instanceIdentifier(), hashes);
             if (incidence->recurs() || incidence->hasRecurrenceId()) {
                 recurringUids.insert(incidence->uid());
             } else {
@@ -675,9 +1088,30 @@ int SqliteStorage::Private::loadIncidencesBySeries(sqlite3_stmt *stmt1, QStringL
 }
 //@endcond
 
+bool SqliteStorage::unloadIncidences(const Incidence::List &list)
+{
+    d->mIsLoading = true;
+    for (const Incidence::Ptr &incidence : list) {
+        const QString key = incidence->instanceIdentifier();
+        if (d->mIncidencesToInsert.contains(key)
+            || d->mIncidencesToUpdate.contains(key)
+            || d->mIncidencesToDelete.contains(key)) {
+            qCDebug(lcMkcal) << "not unloading" << key << "(local changes)";
+        } else if (!d->mCalendar->unloadIncidence(incidence)) {
+            qCDebug(lcMkcal) << "cannot unload" << key;
+        } else {
+            d->mColumnHashes.remove(key);
+        }
+    }
+    d->mIsLoading = false;
+
+    return true;
+}
+
 bool SqliteStorage::purgeDeletedIncidences(const KCalendarCore::Incidence::List &list,
                                            const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::Purge);
     if (!d->mDatabase) {
         return false;
     }
@@ -686,35 +1120,189 @@ bool SqliteStorage::purgeDeletedIncidences(const KCalendarCore::Incidence::List
         qCWarning(lcMkcal) << "Deprecated call to purgeDeletedIncidences() with an empty notebook uid,";
     }
 
-    if (!d->mSem.acquire()) {
+    d->waitForWrites();
+    if (!d->acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
         return false;
     }
 
     int rv = 0;
     unsigned int error = 1;
+    int purged = 0;
+
+    char *errmsg = NULL;
+    const char *query = NULL;
+
+    query = BEGIN_TRANSACTION;
+    SL3_exec(d->mDatabase);
+
+    if (d->mFormat->purgeDeletedComponents(list, notebookUid, &purged)) {
+        query = COMMIT_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        error = 0;
+        // The deletion triggers touched the notebooks with the
+        // next transaction id, make it visible to other processes.
+        if (purged > 0) {
+            d->mFormat->incrementTransactionId(&d->mSavedTransactionId);
+        }
+    } else {
+        query = ROLLBACK_TRANSACTION;
+        SL3_exec(d->mDatabase);
+    }
+
+ error:
+    if (!d->mSem.release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    }
+    if (error == 0 && purged > 0) {
+        d->notify();
+    }
+    return error == 0;
+}
+
+int SqliteStorage::purgeExpiredTombstones(int batchSize)
+{
+    MetricsScope scope(metricsCollector(), StorageMetrics::Purge);
+    if (!d->mDatabase || batchSize <= 0) {
+        return -1;
+    }
+
+    // Read notebooks before taking the lock.
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<QPair<QString, QDateTime>> expirations;
+    for (const Notebook::Ptr &notebook : notebooks()) {
+        if (notebook->tombstoneRetentionDays() < 0) {
+            continue;
+        }
+        // Synchronized notebooks keep their tombstones until they
+        // have been synchronized, whatever the time spent offline.
+        QDateTime reference = now;
+        if (!notebook->pluginName().isEmpty() || !notebook->account().isEmpty()) {
+            if (!notebook->syncDate().isValid()) {
+                continue;
+            }
+            reference = qMin(now, notebook->syncDate().toUTC());
+        }
+        expirations.append(QPair<QString, QDateTime>
+                           (notebook->uid(), reference.addDays(-notebook->tombstoneRetentionDays())));
+    }
+    if (expirations.isEmpty()) {
+        return 0;
+    }
+
+    d->waitForWrites();
+    if (!d->acquireLock()) {
+        qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+        return -1;
+    }
 
+    int rv = 0;
     char *errmsg = NULL;
     const char *query = NULL;
+    int count = 0;
+    int purged = -1;
 
     query = BEGIN_TRANSACTION;
     SL3_exec(d->mDatabase);
 
-    error = 0;
-    for (const KCalendarCore::Incidence::Ptr &incidence: list) {
-        if (!d->mFormat->purgeDeletedComponents(*incidence, notebookUid)) {
-            error += 1;
+    for (const QPair<QString, QDateTime> &expiration : expirations) {
+        const int n = d->mFormat->purgeExpiredComponents(expiration.first, expiration.second,
+                                                         batchSize - count);
+        if (n < 0) {
+            count = -1;
+            break;
+        }
+        count += n;
+        if (count >= batchSize) {
+            break;
         }
     }
 
+    if (count < 0) {
+        query = ROLLBACK_TRANSACTION;
+        SL3_exec(d->mDatabase);
+        goto error;
+    }
     query = COMMIT_TRANSACTION;
     SL3_exec(d->mDatabase);
+    purged = count;
+    if (purged > 0) {
+        qCDebug(lcMkcal) << "purged" << purged << "expired deleted incidences";
+        d->mFormat->incrementTransactionId(&d->mSavedTransactionId);
+    }
 
  error:
     if (!d->mSem.release()) {
         qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
     }
-    return error == 0;
+    if (purged > 0) {
+        d->notify();
+    }
+    return purged;
+}
+
+void SqliteStorage::setTombstoneCollectionInterval(int msec)
+{
+    if (msec > 0) {
+        d->mTombstoneTimer.start(msec);
+    } else {
+        d->mTombstoneTimer.stop();
+    }
+}
+
+int SqliteStorage::tombstoneCollectionInterval() const
+{
+    return d->mTombstoneTimer.isActive() ? d->mTombstoneTimer.interval() : 0;
+}
+
+void SqliteStorage::beginBatch()
+{
+    d->mBatchDepth += 1;
+}
+
+void SqliteStorage::endBatch()
+{
+    if (d->mBatchDepth == 0) {
+        qCWarning(lcMkcal) << "endBatch() called without beginBatch()";
+        return;
+    }
+    d->mBatchDepth -= 1;
+    if (d->mBatchDepth == 0 && d->mPendingNotification) {
+        d->touchChanged();
+    }
+}
+
+void SqliteStorage::setWriteBehind(bool enabled)
+{
+    if (!enabled && d->mWriter) {
+        d->flushWrites();
+        delete d->mWriter;
+        d->mWriter = nullptr;
+    }
+    d->mWriteBehind = enabled;
+}
+
+bool SqliteStorage::writeBehind() const
+{
+    return d->mWriteBehind;
+}
+
+bool SqliteStorage::flush()
+{
+    return d->flushWrites();
+}
+
+void SqliteStorage::setNotificationDelay(int msec)
+{
+    d->mNotificationTimer.setInterval(qMax(0, msec));
+    if (msec <= 0 && d->mBatchDepth == 0 && d->mPendingNotification) {
+        d->touchChanged();
+    }
+}
+
+int SqliteStorage::notificationDelay() const
+{
+    return d->mNotificationTimer.interval();
 }
 
 bool SqliteStorage::save()
@@ -724,13 +1312,21 @@ bool SqliteStorage::save()
 
 bool SqliteStorage::save(ExtendedStorage::DeleteAction deleteAction)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::Save);
     d->mIsSaved = false;
 
     if (!d->mDatabase) {
         return false;
     }
 
-    if (!d->mSem.acquire()) {
+    if (d->mWriteBehind) {
+        return d->saveBehind(deleteAction);
+    }
+
+    // Saved incidences are checked against their notebook.
+    loadDeferredNotebooks();
+    d->waitForWrites();
+    if (!d->acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
         return false;
     }
@@ -760,8 +1356,14 @@ bool SqliteStorage::save(ExtendedStorage::DeleteAction deleteAction)
         }
     }
 
-    if (d->mIsSaved)
+    if (d->mIsSaved) {
+        StorageChange::List changes;
+        d->appendChanges(&changes, added, StorageChange::Added);
+        d->appendChanges(&changes, modified, StorageChange::Modified);
+        d->appendChanges(&changes, deleted, StorageChange::Deleted);
+        d->logChanges(changes);
         d->mFormat->incrementTransactionId(&d->mSavedTransactionId);
+    }
 
     if (!d->mSem.release()) {
         qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
@@ -769,7 +1371,7 @@ bool SqliteStorage::save(ExtendedStorage::DeleteAction deleteAction)
 
     if (d->mIsSaved) {
         emitStorageUpdated(added, modified, deleted);
-        d->mChanged.resize(0);   // make a change to create signal
+        d->notify();
     }
 
     if (errors == 0) {
@@ -781,9 +1383,257 @@ bool SqliteStorage::save(ExtendedStorage::DeleteAction deleteAction)
     return errors == 0;
 }
 
+bool SqliteStorage::upsertIncidences(const Incidence::List &list, const QString &notebookUid)
+{
+    MetricsScope scope(metricsCollector(), StorageMetrics::Save);
+    if (!d->mDatabase) {
+        return false;
+    }
+    if (list.isEmpty()) {
+        return true;
+    }
+
+    const Notebook::Ptr nb = notebook(notebookUid);
+    if ((nb && nb->isRunTimeOnly()) || (!nb && validateNotebooks())) {
+        qCWarning(lcMkcal) << "invalid notebook - not saving incidences in" << notebookUid;
+        return false;
+    }
+
+    d->waitForWrites();
+    if (!d->acquireLock()) {
+        qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+        return false;
+    }
+
+    int rv = 0;
+    int errors = 0;
+    bool saved = false;
+    char *errmsg = NULL;
+    const char *query = NULL;
+    Incidence::List added;
+    Incidence::List modified;
+    StorageChange::List changes;
+
+    query = BEGIN_TRANSACTION;
+    SL3_exec(d->mDatabase);
+
+    for (const Incidence::Ptr &incidence : list) {
+        bool inserted = false;
+        qCDebug(lcMkcal) << "upserting incidence" << incidence->uid() << "notebook" << notebookUid;
+        d->mColumnHashes.remove(incidence->instanceIdentifier());
+        if (!d->mFormat->modifyComponents(*incidence, notebookUid, DBUpsert, &inserted)) {
+            qCWarning(lcMkcal) << QString::fromLatin1("Sqlite error status: '%1'").arg(sqlite3_errmsg(d->mDatabase))
+                               << "for error while upserting incidence" << incidence->uid();
+            errors++;
+        } else if (inserted) {
+            added << incidence;
+        } else {
+            modified << incidence;
+        }
+    }
+
+    query = COMMIT_TRANSACTION;
+    SL3_exec(d->mDatabase);
+
+    saved = !added.isEmpty() || !modified.isEmpty();
+    if (saved) {
+        d->appendChanges(&changes, added, StorageChange::Added, notebookUid);
+        d->appendChanges(&changes, modified, StorageChange::Modified, notebookUid);
+        d->logChanges(changes);
+        d->mFormat->incrementTransactionId(&d->mSavedTransactionId);
+    }
+
+ error:
+    if (!d->mSem.release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    }
+
+    if (saved) {
+        emitStorageUpdated(added, modified, Incidence::List(), notebookUid);
+        d->notify();
+    }
+
+    return saved && errors == 0;
+}
+
 //@cond PRIVATE
+bool SqliteStorage::Private::acquireLock()
+{
+    return mSem.acquire();
+}
+
+// Reads need to see the saves done in write-behind mode,
+// and saves need to be done in order. Their notifications
+// are delivered later, from the event loop, so callers are
+// not re-entered.
+void SqliteStorage::Private::waitForWrites()
+{
+    if (mWriter) {
+        mWriter->flush();
+    }
+}
+
+bool SqliteStorage::Private::saveBehind(ExtendedStorage::DeleteAction deleteAction)
+{
+    WriteJob job;
+    const DBOperation deleteOperation = deleteAction == ExtendedStorage::PurgeDeleted
+        ? DBDelete : DBMarkDeleted;
+    const QList<QPair<QHash<QString, Incidence::Ptr>*, DBOperation>> lists
+        = {{&mIncidencesToInsert, DBInsert},
+           {&mIncidencesToUpdate, DBUpdate},
+           {&mIncidencesToDelete, deleteOperation}};
+    for (const QPair<QHash<QString, Incidence::Ptr>*, DBOperation> &list : lists) {
+        const DBOperation dbop = list.second;
+        Incidence::List *saved = (dbop == DBInsert) ? &job.added
+            : (dbop == DBUpdate) ? &job.modified : &job.deleted;
+        for (QHash<QString, Incidence::Ptr>::ConstIterator it = list.first->constBegin();
+             it != list.first->constEnd(); ++it) {
+            const QString notebookUid = mCalendar->notebook(*it);
+            if (dbop == DBInsert || dbop == DBUpdate) {
+                const Notebook::Ptr notebook = mStorage->notebook(notebookUid);
+                if ((notebook && notebook->isRunTimeOnly())
+                    || (!notebook && mStorage->validateNotebooks())) {
+                    qCWarning(lcMkcal) << "invalid notebook - not saving incidence" << (*it)->uid();
+                    continue;
+                }
+            }
+            saved->append(*it);
+            // Written as a whole by the writer.
+            mColumnHashes.remove((*it)->instanceIdentifier());
+            // The calendar may be modified while the copy is saved.
+            WriteJob::Item item;
+            item.incidence = Incidence::Ptr((*it)->clone());
+            item.notebookUid = notebookUid;
+            item.operation = dbop;
+            job.items.append(item);
+        }
+        list.first->clear();
+    }
+
+    if (job.items.isEmpty()) {
+        mStorage->emitStorageFinished(false, "save completed");
+        return true;
+    }
+
+    appendChanges(&job.changes, job.added, StorageChange::Added);
+    appendChanges(&job.changes, job.modified, StorageChange::Modified);
+    appendChanges(&job.changes, job.deleted, StorageChange::Deleted);
+
+    if (!mWriter) {
+        mWriter = new SqliteWriter(mDatabaseName, CHANGELOG_SIZE);
+        QObject::connect(mWriter, &SqliteWriter::committed,
+                         mStorage, [this] {processCommitted();});
+        mWriter->start();
+    }
+    qCDebug(lcMkcal) << "queuing" << job.items.count() << "modifications";
+    mWriter->enqueue(job);
+
+    return true;
+}
+
+// Deliver the notifications of the saves committed by the writer.
+bool SqliteStorage::Private::processCommitted()
+{
+    if (!mWriter) {
+        return true;
+    }
+
+    bool success = true;
+    const QList<WriteJob> jobs = mWriter->takeCommitted();
+    for (const WriteJob &job : jobs) {
+        // Synchronous saves may have been done meanwhile.
+        if (job.transactionId > mSavedTransactionId) {
+            mSavedTransactionId = job.transactionId;
+        }
+        mStorage->emitStorageUpdated(job.added, job.modified, job.deleted);
+        notify();
+        if (job.success) {
+            mStorage->emitStorageFinished(false, "save completed");
+        } else {
+            mStorage->emitStorageFinished(true, "errors saving incidences");
+        }
+        success = success && job.success;
+    }
+    return success;
+}
+
+bool SqliteStorage::Private::flushWrites()
+{
+    if (!mWriter) {
+        return true;
+    }
+    mWriter->flush();
+    return processCommitted();
+}
+
+void SqliteStorage::Private::notify()
+{
+    mPendingNotification = true;
+    if (mBatchDepth > 0) {
+        return;
+    }
+    if (mNotificationTimer.interval() > 0) {
+        // Not restarted on later saves, to bound the delay
+        // during long sequences of saves.
+        if (!mNotificationTimer.isActive()) {
+            mNotificationTimer.start();
+        }
+        return;
+    }
+    touchChanged();
+}
+
+void SqliteStorage::Private::touchChanged()
+{
+    mNotificationTimer.stop();
+    mPendingNotification = false;
+    mChanged.resize(0);   // make a change to create signal
+}
+
+void SqliteStorage::Private::appendChanges(StorageChange::List *changes,
+                                           const Incidence::List &list,
+                                           StorageChange::Operation operation,
+                                           const QString &notebookUid)
+{
+    for (const Incidence::Ptr &incidence : list) {
+        StorageChange change;
+        change.transactionId = -1;
+        change.notebookUid = notebookUid.isEmpty() ? mCalendar->notebook(incidence) : notebookUid;
+        change.instanceIdentifier = incidence->instanceIdentifier();
+        change.operation = operation;
+        changes->append(change);
+    }
+}
+
+// Other processes use the log to update their calendar, instead of
+// reloading it. A failure only makes them reload.
+bool SqliteStorage::Private::logChanges(const StorageChange::List &changes)
+{
+    int rv = 0;
+    char *errmsg = NULL;
+    const char *query = NULL;
+
+    query = BEGIN_TRANSACTION;
+    SL3_exec(mDatabase);
+    if (!mFormat->insertChanges(changes, CHANGELOG_SIZE)) {
+        query = ROLLBACK_TRANSACTION;
+        SL3_exec(mDatabase);
+        return false;
+    }
+    query = COMMIT_TRANSACTION;
+    SL3_exec(mDatabase);
+
+    return true;
+
+error:
+    return false;
+}
+
 bool SqliteStorage::Private::saveIncidences(QHash<QString, Incidence::Ptr> &list, DBOperation dbop, Incidence::List *savedIncidences)
 {
+    MetricsScope scope(mStorage->metricsCollector(),
+                       (dbop == DBInsert) ? StorageMetrics::SaveInsert :
+                       (dbop == DBUpdate) ? StorageMetrics::SaveUpdate : StorageMetrics::SaveDelete);
     int rv = 0;
     int errors = 0;
     const char *operation = (dbop == DBInsert) ? "inserting" :
@@ -812,9 +1662,17 @@ bool SqliteStorage::Private::saveIncidences(QHash<QString, Incidence::Ptr> &list
         (*savedIncidences) << *it;
 
         qCDebug(lcMkcal) << operation << "incidence" << (*it)->uid() << "notebook" << notebookUid;
-        if (!mFormat->modifyComponents(**it, notebookUid, dbop)) {
+        const QString key = (*it)->instanceIdentifier();
+        SqliteFormat::ColumnHashes *hashes = nullptr;
+        if (dbop == DBInsert || dbop == DBUpdate) {
+            hashes = &mColumnHashes[key];
+        } else {
+            mColumnHashes.remove(key);
+        }
+        if (!mFormat->modifyComponents(**it, notebookUid, dbop, nullptr, hashes)) {
             qCWarning(lcMkcal) << QString::fromLatin1("Sqlite error status: '%1'").arg(sqlite3_errmsg(mDatabase))
                                << "for error while modifying incidence" << (*it)->uid();
+            mColumnHashes.remove(key);
             errors++;
         }
     }
@@ -831,6 +1689,8 @@ bool SqliteStorage::Private::saveIncidences(QHash<QString, Incidence::Ptr> &list
     return errors == 0;
 
 error:
+    // The hashes of values that may not be committed.
+    mColumnHashes.clear();
     return false;
 }
 //@endcond
@@ -838,6 +1698,11 @@ error:
 bool SqliteStorage::close()
 {
     if (d->mDatabase) {
+        if (d->mWriter) {
+            d->flushWrites();
+            delete d->mWriter;
+            d->mWriter = nullptr;
+        }
         if (d->mWatcher) {
             d->mWatcher->removePaths(d->mWatcher->files());
             // This should work, as storage should be closed before
@@ -845,12 +1710,22 @@ bool SqliteStorage::close()
             delete d->mWatcher;
             d->mWatcher = NULL;
         }
+        if (d->mPendingNotification) {
+            d->touchChanged();
+        }
+        d->mChangedTimer.stop();
         d->mChanged.close();
+        d->mAlarms.close();
+        d->mColumnHashes.clear();
         delete d->mFormat;
         d->mFormat = 0;
         sqlite3_close(d->mDatabase);
         d->mDatabase = 0;
+        sqlite3_close(d->mExplainDatabase);
+        d->mExplainDatabase = nullptr;
+        d->mExplainedQueries.clear();
     }
+    d->mDefaultNotebookPending = false;
     return ExtendedStorage::close();
 }
 
@@ -915,6 +1790,7 @@ void SqliteStorage::calendarIncidenceAdditionCanceled(const Incidence::Ptr &inci
 bool SqliteStorage::insertedIncidences(Incidence::List *list, const QDateTime &after,
                                        const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::InsertedIncidences);
     if (d->mDatabase && list && after.isValid()) {
         const char *query1 = NULL;
         int qsize1 = 0;
@@ -936,7 +1812,8 @@ bool SqliteStorage::insertedIncidences(Incidence::List *list, const QDateTime &a
         }
 
         qCDebug(lcMkcal) << "incidences inserted since" << after;
-        if (!d->mSem.acquire()) {
+        d->waitForWrites();
+        if (!d->acquireLock()) {
             qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
             return false;
         }
@@ -966,6 +1843,7 @@ bool SqliteStorage::insertedIncidences(Incidence::List *list, const QDateTime &a
 bool SqliteStorage::modifiedIncidences(Incidence::List *list, const QDateTime &after,
                                        const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::ModifiedIncidences);
     if (d->mDatabase && list && after.isValid()) {
         const char *query1 = NULL;
         int qsize1 = 0;
@@ -987,7 +1865,8 @@ bool SqliteStorage::modifiedIncidences(Incidence::List *list, const QDateTime &a
         }
 
         qCDebug(lcMkcal) << "incidences updated since" << after;
-        if (!d->mSem.acquire()) {
+        d->waitForWrites();
+        if (!d->acquireLock()) {
             qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
             return false;
         }
@@ -1018,6 +1897,7 @@ bool SqliteStorage::modifiedIncidences(Incidence::List *list, const QDateTime &a
 bool SqliteStorage::deletedIncidences(Incidence::List *list, const QDateTime &after,
                                       const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::DeletedIncidences);
     if (d->mDatabase && list) {
         const char *query1 = NULL;
         int qsize1 = 0;
@@ -1049,7 +1929,8 @@ bool SqliteStorage::deletedIncidences(Incidence::List *list, const QDateTime &af
         }
 
         qCDebug(lcMkcal) << "incidences deleted since" << after;
-        if (!d->mSem.acquire()) {
+        d->waitForWrites();
+        if (!d->acquireLock()) {
             qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
             return false;
         }
@@ -1079,8 +1960,85 @@ bool SqliteStorage::deletedIncidences(Incidence::List *list, const QDateTime &af
     return false;
 }
 
+bool SqliteStorage::changesSince(int sequence, const QString &notebookUid,
+                                 Incidence::List *added,
+                                 Incidence::List *modified,
+                                 Incidence::List *deleted,
+                                 int *latest)
+{
+    MetricsScope scope(metricsCollector(), StorageMetrics::ChangesSince);
+    if (!d->mDatabase) {
+        return false;
+    }
+
+    const char *query1 = NULL;
+    int qsize1 = 0;
+    int rv = 0;
+    sqlite3_stmt *stmt1 = NULL;
+    int index = 1;
+    QByteArray n;
+    Incidence::Ptr incidence;
+    QString nbook;
+    bool success = false;
+    int current = -1;
+
+    if (!notebookUid.isEmpty()) {
+        query1 = SELECT_COMPONENTS_BY_CHANGE_AND_NOTEBOOK;
+        qsize1 = sizeof(SELECT_COMPONENTS_BY_CHANGE_AND_NOTEBOOK);
+    } else {
+        query1 = SELECT_COMPONENTS_BY_CHANGE;
+        qsize1 = sizeof(SELECT_COMPONENTS_BY_CHANGE);
+    }
+
+    qCDebug(lcMkcal) << "incidences changed since" << sequence;
+    d->waitForWrites();
+    if (!d->acquireLock()) {
+        qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+        return false;
+    }
+
+    if (!d->mFormat->selectMetadata(&current)) {
+        goto error;
+    }
+    if (added || modified || deleted) {
+        SL3_prepare_v2(d->mDatabase, query1, qsize1, &stmt1, nullptr);
+        SL3_bind_int64(stmt1, index, sequence);
+        if (!notebookUid.isEmpty()) {
+            n = notebookUid.toUtf8();
+            SL3_bind_text(stmt1, index, n.constData(), n.length(), SQLITE_STATIC);
+        }
+        // The created sequence and the deletion date are
+        // the last two columns of the current row.
+        while ((incidence = d->mFormat->selectComponents(stmt1, nbook))) {
+            const int columns = sqlite3_column_count(stmt1);
+            const bool isNew = sqlite3_column_int64(stmt1, columns - 2) > sequence;
+            const bool isDeleted = sqlite3_column_int64(stmt1, columns - 1) != 0;
+            if (isNew && isDeleted) {
+                // Created and deleted since sequence, never seen by the caller.
+                continue;
+            }
+            Incidence::List *list = isNew ? added : (isDeleted ? deleted : modified);
+            if (list) {
+                list->append(incidence);
+            }
+        }
+    }
+    if (latest) {
+        *latest = current;
+    }
+    success = true;
+
+error:
+    sqlite3_finalize(stmt1);
+    if (!d->mSem.release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    }
+    return success;
+}
+
 bool SqliteStorage::allIncidences(Incidence::List *list, const QString &notebookUid)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::AllIncidences);
     if (d->mDatabase && list) {
         const char *query1 = NULL;
         int qsize1 = 0;
@@ -1101,7 +2059,8 @@ bool SqliteStorage::allIncidences(Incidence::List *list, const QString &notebook
         }
 
         qCDebug(lcMkcal) << "all incidences";
-        if (!d->mSem.acquire()) {
+        d->waitForWrites();
+        if (!d->acquireLock()) {
             qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
             return false;
         }
@@ -1126,8 +2085,52 @@ bool SqliteStorage::allIncidences(Incidence::List *list, const QString &notebook
     return false;
 }
 
+bool SqliteStorage::alarmIncidences(Incidence::List *list, const QString &notebookUid,
+                                    const QDateTime &after)
+{
+    MetricsScope scope(metricsCollector(), StorageMetrics::AlarmIncidences);
+    if (d->mDatabase && list && !notebookUid.isEmpty()) {
+        const char *query1 = SELECT_COMPONENTS_BY_ALARMS;
+        int qsize1 = sizeof(SELECT_COMPONENTS_BY_ALARMS);
+        int rv = 0;
+        sqlite3_stmt *stmt1 = NULL;
+        int index = 1;
+        QByteArray n = notebookUid.toUtf8();
+        sqlite3_int64 secs;
+        Incidence::Ptr incidence;
+        QString nbook;
+        bool success = false;
+
+        qCDebug(lcMkcal) << "incidences with alarms after" << after;
+        d->waitForWrites();
+        if (!d->acquireLock()) {
+            qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+            return false;
+        }
+
+        SL3_prepare_v2(d->mDatabase, query1, qsize1, &stmt1, nullptr);
+        SL3_bind_text(stmt1, index, n.constData(), n.length(), SQLITE_STATIC);
+        secs = after.isValid() ? d->mFormat->toOriginTime(after) : 0;
+        SL3_bind_int64(stmt1, index, secs);
+        SL3_bind_text(stmt1, index, n.constData(), n.length(), SQLITE_STATIC);
+        while ((incidence = d->mFormat->selectComponents(stmt1, nbook))) {
+            list->append(incidence);
+        }
+        success = true;
+
+    error:
+        sqlite3_finalize(stmt1);
+        if (!d->mSem.release()) {
+            qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+        }
+        return success;
+    }
+    return false;
+}
+
 QDateTime SqliteStorage::incidenceDeletedDate(const Incidence::Ptr &incidence)
 {
+    MetricsScope scope(metricsCollector(), StorageMetrics::IncidenceDeletedDate);
     int index;
     QByteArray u;
     int rv = 0;
@@ -1159,7 +2162,8 @@ QDateTime SqliteStorage::incidenceDeletedDate(const Incidence::Ptr &incidence)
         SL3_bind_int64(stmt, index, 0);
     }
 
-    if (!d->mSem.acquire()) {
+    d->waitForWrites();
+    if (!d->acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
         return deletionDate;
     }
@@ -1188,6 +2192,9 @@ bool SqliteStorage::loadNotebooks()
     int rv = 0;
     sqlite3_stmt *stmt = NULL;
     bool isDefault;
+    SqliteFormat::CalendarProperties properties;
+    // Deferred notebooks may be loaded while loading incidences.
+    const bool wasLoading = d->mIsLoading;
 
     Notebook::Ptr nb;
 
@@ -1195,16 +2202,22 @@ bool SqliteStorage::loadNotebooks()
         return false;
     }
 
-    if (!d->mSem.acquire()) {
+    d->waitForWrites();
+    if (!d->acquireLock()) {
         qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
         return false;
     }
 
     d->mIsLoading = true;
 
+    if (!d->mFormat->selectCalendarProperties(&properties)) {
+        qCWarning(lcMkcal) << "cannot load notebook properties";
+        goto error;
+    }
+
     SL3_prepare_v2(d->mDatabase, query, qsize, &stmt, nullptr);
 
-    while ((nb = d->mFormat->selectCalendars(stmt, &isDefault))) {
+    while ((nb = d->mFormat->selectCalendars(stmt, &isDefault, &properties))) {
         qCDebug(lcMkcal) << "loaded notebook" << nb->uid() << nb->name() << "from database";
         if (isDefault && !setDefaultNotebook(nb)) {
             qCWarning(lcMkcal) << "cannot add default notebook" << nb->uid() << nb->name() << "to storage";
@@ -1220,14 +2233,19 @@ bool SqliteStorage::loadNotebooks()
     if (!d->mSem.release()) {
         qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
     }
-    d->mIsLoading = false;
+    d->mIsLoading = wasLoading;
+
+    if (d->mDefaultNotebookPending) {
+        d->mDefaultNotebookPending = false;
+        d->ensureDefaultNotebook();
+    }
     return true;
 
 error:
     if (!d->mSem.release()) {
         qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
     }
-    d->mIsLoading = false;
+    d->mIsLoading = wasLoading;
     return false;
 }
 
@@ -1278,20 +2296,28 @@ bool SqliteStorage::Private::saveNotebook(const Notebook::Ptr &nb, DBOperation d
             return false;
         }
 
-        if (!mSem.acquire()) {
+        const bool isDefault = (nb == mStorage->defaultNotebook());
+        waitForWrites();
+        if (!acquireLock()) {
             qCWarning(lcMkcal) << "cannot lock" << mDatabaseName << "error" << mSem.errorString();
             return false;
         }
 
         SL3_prepare_v2(mDatabase, query, qsize, &stmt, &tail);
 
-        if ((success = mFormat->modifyCalendars(*nb, dbop, stmt, nb == mStorage->defaultNotebook()))) {
+        if ((success = mFormat->modifyCalendars(*nb, dbop, stmt, isDefault))) {
             qCDebug(lcMkcal) << operation << "notebook" << nb->uid() << nb->name() << "in database";
         }
 
         sqlite3_finalize(stmt);
 
         if (success) {
+            StorageChange change;
+            change.transactionId = -1;
+            change.notebookUid = nb->uid();
+            change.operation = (dbop == DBInsert) ? StorageChange::Added :
+                               (dbop == DBUpdate) ? StorageChange::Modified : StorageChange::Deleted;
+            logChanges(StorageChange::List() << change);
             mFormat->incrementTransactionId(&mSavedTransactionId);
         }
 
@@ -1300,7 +2326,7 @@ bool SqliteStorage::Private::saveNotebook(const Notebook::Ptr &nb, DBOperation d
         }
 
         if (success) {
-            mChanged.resize(0);   // make a change to create signal
+            notify();
         }
     }
     return success;
@@ -1313,29 +2339,102 @@ error:
 }
 //@endcond
 
+void SqliteStorage::notifyAlarmsChanged()
+{
+    if (d->mAlarms.isOpen()) {
+        d->mAlarmsTouched = true;
+        d->mAlarms.resize(0);   // make a change to create signal
+    }
+}
+
 void SqliteStorage::fileChanged(const QString &path)
 {
-    if (!d->mSem.acquire()) {
-        qCWarning(lcMkcal) << "cannot lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    if (path == d->mAlarms.fileName()) {
+        if (!d->mAlarmsTouched) {
+            qCDebug(lcMkcal) << "alarms have been modified by another process";
+            invalidateAlarms();
+        }
+        d->mAlarmsTouched = false;
+        return;
+    }
+    d->mChangedPath = path;
+    if (!d->mChangedTimer.isActive()) {
+        d->mChangedTimer.start();
+    }
+}
+
+//@cond PRIVATE
+void SqliteStorage::Private::checkChanged()
+{
+    if (!mFormat) {
+        return;
+    }
+
+    // Saves committed by the writer are not modifications
+    // from another process.
+    waitForWrites();
+    processCommitted();
+    if (!acquireLock()) {
+        qCWarning(lcMkcal) << "cannot lock" << mDatabaseName << "error" << mSem.errorString();
         return;
     }
     int transactionId;
-    if (!d->mFormat->selectMetadata(&transactionId))
-        transactionId = d->mSavedTransactionId - 1; // Ensure reload on error
-    if (!d->mSem.release()) {
-        qCWarning(lcMkcal) << "cannot release lock" << d->mDatabaseName << "error" << d->mSem.errorString();
+    QStringList notebookUids;
+    if (!mFormat->selectMetadata(&transactionId))
+        transactionId = mSavedTransactionId - 1; // Ensure reload on error
+    // An empty list, when the database went back in time for instance,
+    // means that every notebook should be considered as modified.
+    if (transactionId > mSavedTransactionId
+        && !mFormat->selectNotebookChanges(mSavedTransactionId, &notebookUids)) {
+        notebookUids.clear();
+    }
+    // The log is only usable if no transaction is missing, removed from
+    // the log or done by a version of the library not filling it.
+    StorageChange::List changes;
+    if (!notebookUids.isEmpty()
+        && mFormat->selectChanges(mSavedTransactionId, &changes)) {
+        QSet<int> transactions;
+        for (const StorageChange &change : changes) {
+            transactions.insert(change.transactionId);
+        }
+        if (transactions.count() != transactionId - mSavedTransactionId) {
+            changes.clear();
+        }
+    }
+    if (!mSem.release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << mDatabaseName << "error" << mSem.errorString();
     }
 
-    if (transactionId != d->mSavedTransactionId) {
-        d->mSavedTransactionId = transactionId;
-        emitStorageModified(path);
-        qCDebug(lcMkcal) << path << "has been modified";
+    if (transactionId != mSavedTransactionId) {
+        mSavedTransactionId = transactionId;
+        mStorage->emitStorageModified(mChangedPath, notebookUids, changes);
+        qCDebug(lcMkcal) << mChangedPath << "has been modified in" << notebookUids;
     }
 }
+//@endcond
 
 void SqliteStorage::virtual_hook(int id, void *data)
 {
-    Q_UNUSED(id);
-    Q_UNUSED(data);
-    Q_ASSERT(false);
+    switch (id) {
+    case UnloadIncidencesHook: {
+        UnloadIncidencesHookData *args = static_cast<UnloadIncidencesHookData*>(data);
+        args->result = unloadIncidences(*args->list);
+        break;
+    }
+    case AlarmIncidencesHook: {
+        AlarmIncidencesHookData *args = static_cast<AlarmIncidencesHookData*>(data);
+        args->result = alarmIncidences(args->list, *args->notebookUid, *args->after);
+        args->handled = true;
+        break;
+    }
+    case ChangesSinceHook: {
+        ChangesSinceHookData *args = static_cast<ChangesSinceHookData*>(data);
+        args->result = changesSince(args->sequence, *args->notebookUid,
+                                    args->added, args->modified, args->deleted,
+                                    args->latest);
+        break;
+    }
+    default:
+        break;
+    }
 }
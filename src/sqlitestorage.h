@@ -91,12 +91,67 @@ public:
     */
     QString databaseName() const;
 
+    /**
+      Returns the name of the database used when none is given
+      at construction, see SqliteStorage(const ExtendedCalendar::Ptr &, bool).
+    */
+    static QString defaultDatabaseName();
+
     /**
       @copydoc
       CalStorage::open()
     */
     bool open();
 
+    /**
+      Set a duration above which the sqlite statements run by
+      this storage are reported in the logs with their bound
+      values. The initial value is read from the
+      MKCAL_SLOW_QUERY_MS environment variable.
+
+      @param msec the threshold in milliseconds, a negative value
+             (default) disables the report, 0 reports all statements.
+    */
+    void setSlowQueryThreshold(int msec);
+
+    /**
+      Returns the duration above which statements are reported,
+      a negative value when disabled.
+
+      @see setSlowQueryThreshold()
+    */
+    int slowQueryThreshold() const;
+
+    /**
+      When set, the query plan of every statement is computed
+      the first time it is run, and a warning is reported if the
+      statement does a full scan of the incidence table. This is
+      meant to catch missing or unusable indexes. The initial value
+      is true if the MKCAL_EXPLAIN_QUERIES environment variable is
+      set.
+
+      @param explain true to check query plans
+    */
+    void setExplainQueries(bool explain);
+
+    /**
+      Returns true if query plans are checked.
+
+      @see setExplainQueries()
+    */
+    bool explainQueries() const;
+
+    /**
+      Estimates the memory held by the calendar, see
+      ExtendedCalendar::memoryUsage(), and by this storage:
+      prepared statements, sqlite page cache and schema of the
+      connection, and incidences waiting to be saved.
+
+      @return the memory usage, the storage fields are empty if
+      the storage is not opened.
+    */
+    MemoryUsage memoryUsage() const;
+
     /**
       @copydoc
       CalStorage::load()
@@ -128,6 +183,137 @@ public:
     bool purgeDeletedIncidences(const KCalendarCore::Incidence::List &list,
                                 const QString &notebookUid = QString());
 
+    /**
+      Removes from the database incidences that have been marked
+      as deleted for longer than the retention period of their notebook,
+      see Notebook::tombstoneRetentionDays(). For synchronized
+      notebooks, the period ends at their last synchronization. At most @p batchSize
+      incidences are removed, so the database is locked for a bounded
+      time, call it again until it returns 0 to remove all of them.
+
+      @param batchSize the maximum number of incidences to remove
+      @return the number of removed incidences, or -1 on error.
+    */
+    int purgeExpiredTombstones(int batchSize = 100);
+
+    /**
+      Runs purgeExpiredTombstones() periodically, one batch at a time,
+      while the storage is opened. The initial interval is read from the
+      MKCAL_TOMBSTONE_GC_INTERVAL environment variable, in seconds.
+
+      @param msec the interval between two batches, 0 to disable.
+    */
+    void setTombstoneCollectionInterval(int msec);
+
+    /**
+      Returns the interval between two removals of expired
+      tombstones, or 0 if they are not removed automatically.
+
+      @see setTombstoneCollectionInterval()
+    */
+    int tombstoneCollectionInterval() const;
+
+    /**
+      Starts a batch of modifications, like the saves of a sync session.
+      Other processes are notified once, when the outermost batch ends,
+      instead of after each save. Batches can be nested.
+
+      @see endBatch()
+    */
+    void beginBatch();
+
+    /**
+      Ends a batch of modifications started with beginBatch(), and
+      notifies other processes if the database has been modified
+      during the batch.
+    */
+    void endBatch();
+
+    /**
+      Enables the write-behind mode. In this mode, save() returns as soon as
+      the pending modifications are copied, and they are committed in order
+      by a background thread with its own connection. The completion of each
+      save is reported with storageUpdated() and storageFinished(), from the
+      event loop or from flush(). Later operations on the database wait for
+      the copied modifications to be committed first, so they always see
+      them, but they don't deliver these notifications.
+
+      The initial mode is read from the MKCAL_WRITE_BEHIND environment
+      variable.
+
+      @param enabled true to save in the background.
+      @see flush()
+    */
+    void setWriteBehind(bool enabled);
+
+    /**
+      Returns true if saves are committed in the background.
+
+      @see setWriteBehind()
+    */
+    bool writeBehind() const;
+
+    /**
+      Blocks until all the saves done in write-behind mode are committed
+      to the database and notified.
+
+      @return false if one of these saves failed.
+    */
+    bool flush();
+
+    /**
+      Enables the lazy mode, to be set before open(). In this mode, open()
+      doesn't load the notebooks. They are loaded, and the default notebook
+      is created if missing, when they are first used through the notebook
+      methods of the storage or when incidences are loaded. Until then, the
+      calendar contains no notebook. This makes opening faster for short-lived
+      processes that may not need them.
+
+      The initial mode is read from the MKCAL_LAZY_NOTEBOOKS environment
+      variable.
+
+      @param enabled true to load notebooks on first use.
+    */
+    void setLazyNotebooks(bool enabled);
+
+    /**
+      Returns true if notebooks are loaded on first use.
+
+      @see setLazyNotebooks()
+    */
+    bool lazyNotebooks() const;
+
+    /**
+      Delays the notification of other processes after a save, so that
+      all saves done within @p msec of the first one are notified at once.
+      The initial delay is read from the MKCAL_NOTIFY_DELAY_MS environment
+      variable.
+
+      @param msec the delay, 0 to notify after each save.
+    */
+    void setNotificationDelay(int msec);
+
+    /**
+      Returns the delay before notifying other processes of a save.
+
+      @see setNotificationDelay()
+    */
+    int notificationDelay() const;
+
+    /**
+      @copydoc
+      ExtendedStorage::unloadIncidences()
+    */
+    bool unloadIncidences(const KCalendarCore::Incidence::List &list);
+
+    /**
+      Notifies the other processes using this database that alarms
+      have been scheduled outside of their alarm handler, like with
+      mkcaltool --reset-alarms. They fetch the alarms again from the
+      alarm backend the next time they schedule some.
+    */
+    void notifyAlarmsChanged();
+
     /**
       @copydoc
       CalStorage::save()
@@ -140,6 +326,23 @@ public:
     */
     bool save(ExtendedStorage::DeleteAction deleteAction);
 
+    /**
+      Writes @p list to the database in @p notebookUid in one transaction,
+      inserting the incidences that are not stored yet and updating the
+      others, without loading them first. The incidences do not need to
+      be in the calendar, and the calendar is not modified: incidences
+      with the same identifiers loaded in it are not updated.
+
+      Incidences already stored in another notebook are not written,
+      and make the call fail.
+
+      @param list the incidences to write
+      @param notebookUid the notebook of the incidences
+      @return true if all incidences were written.
+    */
+    bool upsertIncidences(const KCalendarCore::Incidence::List &list,
+                          const QString &notebookUid);
+
     /**
       @copydoc
       CalStorage::close()
@@ -204,12 +407,30 @@ public:
                            const QDateTime &after = QDateTime(),
                            const QString &notebookUid = QString());
 
+    /**
+      @copydoc
+      ExtendedStorage::changesSince()
+    */
+    bool changesSince(int sequence, const QString &notebookUid,
+                      KCalendarCore::Incidence::List *added,
+                      KCalendarCore::Incidence::List *modified,
+                      KCalendarCore::Incidence::List *deleted,
+                      int *latest);
+
     /**
       @copydoc
       ExtendedStorage::allIncidences()
     */
     bool allIncidences(KCalendarCore::Incidence::List *list, const QString &notebookUid = QString());
 
+    /**
+      @copydoc
+      ExtendedStorage::alarmIncidences()
+    */
+    bool alarmIncidences(KCalendarCore::Incidence::List *list,
+                         const QString &notebookUid,
+                         const QDateTime &after);
+
     /**
       @copydoc
       ExtendedStorage::search()
@@ -0,0 +1,160 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "sqlitewriter_p.h"
+#include "semaphore_p.h"
+#include "logging_p.h"
+
+using namespace mKCal;
+
+SqliteWriter::SqliteWriter(const QString &databaseName, int changelogSize)
+    : mDatabaseName(databaseName)
+    , mChangelogSize(changelogSize)
+{
+}
+
+SqliteWriter::~SqliteWriter()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mStop = true;
+        mQueued.wakeAll();
+    }
+    wait();
+}
+
+void SqliteWriter::enqueue(const WriteJob &job)
+{
+    QMutexLocker locker(&mMutex);
+    mQueue.append(job);
+    mQueued.wakeAll();
+}
+
+void SqliteWriter::flush()
+{
+    QMutexLocker locker(&mMutex);
+    while (!mQueue.isEmpty() || mBusy) {
+        mIdle.wait(&mMutex);
+    }
+}
+
+QList<WriteJob> SqliteWriter::takeCommitted()
+{
+    QMutexLocker locker(&mMutex);
+    QList<WriteJob> jobs = mCommitted;
+    mCommitted.clear();
+    return jobs;
+}
+
+void SqliteWriter::run()
+{
+    sqlite3 *database = nullptr;
+    SqliteFormat *format = nullptr;
+    if (sqlite3_open_v2(mDatabaseName.toUtf8().constData(), &database,
+                        SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        qCWarning(lcMkcal) << "cannot open database" << mDatabaseName
+                           << "for writing:" << sqlite3_errmsg(database);
+        sqlite3_close(database);
+        database = nullptr;
+    } else {
+        sqlite3_busy_timeout(database, 1500);
+        sqlite3_exec(database, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr);
+        format = new SqliteFormat(database);
+    }
+    ProcessMutex mutex(mDatabaseName);
+
+    mMutex.lock();
+    for (;;) {
+        while (mQueue.isEmpty() && !mStop) {
+            mQueued.wait(&mMutex);
+        }
+        if (mQueue.isEmpty()) {
+            break;
+        }
+        WriteJob job = mQueue.takeFirst();
+        mBusy = true;
+        mMutex.unlock();
+
+        job.success = format && commit(&job, database, format, &mutex);
+
+        mMutex.lock();
+        mBusy = false;
+        mCommitted.append(job);
+        mIdle.wakeAll();
+        mMutex.unlock();
+        emit committed();
+        mMutex.lock();
+    }
+    mMutex.unlock();
+
+    delete format;
+    sqlite3_close(database);
+}
+
+bool SqliteWriter::commit(WriteJob *job, sqlite3 *database, SqliteFormat *format,
+                          ProcessMutex *mutex)
+{
+    int rv = 0;
+    int errors = 0;
+    char *errmsg = NULL;
+    const char *query = NULL;
+
+    if (!mutex->acquire()) {
+        qCWarning(lcMkcal) << "cannot lock" << mDatabaseName << "error" << mutex->errorString();
+        return false;
+    }
+
+    query = BEGIN_TRANSACTION;
+    SL3_exec(database);
+    for (const WriteJob::Item &item : job->items) {
+        if (!format->modifyComponents(*item.incidence, item.notebookUid, item.operation)) {
+            qCWarning(lcMkcal) << QString::fromLatin1("Sqlite error status: '%1'").arg(sqlite3_errmsg(database))
+                               << "for error while modifying incidence" << item.incidence->uid();
+            errors++;
+        }
+    }
+    query = COMMIT_TRANSACTION;
+    SL3_exec(database);
+
+    // As in SqliteStorage::save(), a failure to log
+    // only makes other processes reload.
+    query = BEGIN_TRANSACTION;
+    SL3_exec(database);
+    if (format->insertChanges(job->changes, mChangelogSize)) {
+        query = COMMIT_TRANSACTION;
+    } else {
+        query = ROLLBACK_TRANSACTION;
+    }
+    SL3_exec(database);
+
+    format->incrementTransactionId(&job->transactionId);
+
+    if (!mutex->release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << mDatabaseName << "error" << mutex->errorString();
+    }
+    return errors == 0;
+
+error:
+    if (!mutex->release()) {
+        qCWarning(lcMkcal) << "cannot release lock" << mDatabaseName << "error" << mutex->errorString();
+    }
+    return false;
+}
@@ -0,0 +1,123 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the thread committing saves in write-behind mode.
+
+  @author agent \<agent@local\>
+*/
+
+#ifndef MKCAL_SQLITEWRITER_H
+#define MKCAL_SQLITEWRITER_H
+
+#include "sqliteformat.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+class ProcessMutex;
+
+namespace mKCal {
+
+/**
+  A save, as copied from the pending changes of a SqliteStorage.
+*/
+struct WriteJob
+{
+    struct Item {
+        // A copy of the incidence, only used by the writer thread.
+        KCalendarCore::Incidence::Ptr incidence;
+        QString notebookUid;
+        DBOperation operation;
+    };
+    QList<Item> items;
+    StorageChange::List changes;
+
+    // The saved incidences, as they are in the calendar,
+    // for the notifications.
+    KCalendarCore::Incidence::List added;
+    KCalendarCore::Incidence::List modified;
+    KCalendarCore::Incidence::List deleted;
+
+    bool success = false;
+    int transactionId = -1;
+};
+
+/**
+  A thread committing saves to the database in order,
+  with its own connection.
+*/
+class SqliteWriter : public QThread
+{
+    Q_OBJECT
+public:
+    SqliteWriter(const QString &databaseName, int changelogSize);
+
+    /**
+      Commits the jobs still queued, then stops the thread.
+    */
+    ~SqliteWriter();
+
+    /**
+      Queues a job, to be committed after the previous ones.
+    */
+    void enqueue(const WriteJob &job);
+
+    /**
+      Blocks until every queued job is committed.
+    */
+    void flush();
+
+    /**
+      Returns the committed jobs that have not been taken yet,
+      in order.
+    */
+    QList<WriteJob> takeCommitted();
+
+signals:
+    /**
+      Emitted from the writer thread when a job has been committed.
+    */
+    void committed();
+
+protected:
+    void run() override;
+
+private:
+    bool commit(WriteJob *job, sqlite3 *database, SqliteFormat *format,
+                ProcessMutex *mutex);
+
+    QString mDatabaseName;
+    int mChangelogSize;
+    QMutex mMutex;
+    QWaitCondition mQueued;
+    QWaitCondition mIdle;
+    QList<WriteJob> mQueue;
+    QList<WriteJob> mCommitted;
+    bool mBusy = false;
+    bool mStop = false;
+};
+
+}
+
+#endif
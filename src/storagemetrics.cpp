@@ -0,0 +1,227 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "storagemetrics.h"
+#include "storagemetrics_p.h"
+
+#include <QtCore/QtMath>
+
+using namespace mKCal;
+
+void StorageMetrics::Private::Histogram::add(quint64 us)
+{
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && (quint64(1) << bucket) <= us) {
+        bucket += 1;
+    }
+    buckets[bucket] += 1;
+    count += 1;
+    totalUs += us;
+    maxUs = qMax(maxUs, us);
+}
+
+quint64 StorageMetrics::Private::Histogram::percentile(qreal percent) const
+{
+    if (!count) {
+        return 0;
+    }
+    const quint64 rank = qMax(quint64(1), quint64(qCeil(count * percent / 100.)));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount - 1; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return qMin(quint64(1) << bucket, maxUs);
+        }
+    }
+    return maxUs;
+}
+
+StorageMetrics::StorageMetrics()
+    : d(new StorageMetrics::Private)
+{
+}
+
+StorageMetrics::StorageMetrics(const StorageMetrics &other)
+    : d(new StorageMetrics::Private(*other.d))
+{
+}
+
+StorageMetrics::~StorageMetrics()
+{
+    delete d;
+}
+
+StorageMetrics &StorageMetrics::operator=(const StorageMetrics &other)
+{
+    if (&other == this) {
+        return *this;
+    }
+    *d = *other.d;
+    return *this;
+}
+
+quint64 StorageMetrics::count(Operation operation) const
+{
+    return operation < OperationCount ? d->operations[operation].count : 0;
+}
+
+quint64 StorageMetrics::totalTime(Operation operation) const
+{
+    return operation < OperationCount ? d->operations[operation].totalUs : 0;
+}
+
+quint64 StorageMetrics::maxTime(Operation operation) const
+{
+    return operation < OperationCount ? d->operations[operation].maxUs : 0;
+}
+
+quint64 StorageMetrics::percentile(Operation operation, qreal percent) const
+{
+    return operation < OperationCount ? d->operations[operation].percentile(percent) : 0;
+}
+
+quint64 StorageMetrics::count(Lock lock) const
+{
+    return lock < LockCount ? d->locks[lock].count : 0;
+}
+
+quint64 StorageMetrics::totalTime(Lock lock) const
+{
+    return lock < LockCount ? d->locks[lock].totalUs : 0;
+}
+
+quint64 StorageMetrics::maxTime(Lock lock) const
+{
+    return lock < LockCount ? d->locks[lock].maxUs : 0;
+}
+
+quint64 StorageMetrics::percentile(Lock lock, qreal percent) const
+{
+    return lock < LockCount ? d->locks[lock].percentile(percent) : 0;
+}
+
+quint64 StorageMetrics::counter(Counter counter) const
+{
+    return counter < CounterCount ? d->counters[counter] : 0;
+}
+
+const char *StorageMetrics::operationName(Operation operation)
+{
+    switch (operation) {
+    case Open:
+        return "open";
+    case Load:
+        return "load";
+    case LoadUid:
+        return "load uid";
+    case LoadRange:
+        return "load range";
+    case LoadRecurring:
+        return "load recurring";
+    case LoadNotebook:
+        return "load notebook";
+    case Search:
+        return "search";
+    case Save:
+        return "save";
+    case SaveInsert:
+        return "save insert";
+    case SaveUpdate:
+        return "save update";
+    case SaveDelete:
+        return "save delete";
+    case Purge:
+        return "purge";
+    case InsertedIncidences:
+        return "inserted incidences";
+    case ModifiedIncidences:
+        return "modified incidences";
+    case DeletedIncidences:
+        return "deleted incidences";
+    case AllIncidences:
+        return "all incidences";
+    case AlarmIncidences:
+        return "alarm incidences";
+    case IncidenceDeletedDate:
+        return "incidence deleted date";
+    case ChangesSince:
+        return "changes since";
+    case OperationCount:
+        break;
+    }
+    return "unknown";
+}
+
+QString StorageMetrics::toString() const
+{
+    QString out;
+    for (int i = 0; i < OperationCount; i++) {
+        const Private::Histogram &histogram = d->operations[i];
+        if (!histogram.count) {
+            continue;
+        }
+        out += QString::fromLatin1("%1: %2 calls, total %3 us, mean %4 us, "
+                                   "p50 < %5 us, p99 < %6 us, max %7 us\n")
+            .arg(QString::fromLatin1(operationName(Operation(i))))
+            .arg(histogram.count).arg(histogram.totalUs)
+            .arg(histogram.totalUs / histogram.count)
+            .arg(histogram.percentile(50)).arg(histogram.percentile(99))
+            .arg(histogram.maxUs);
+    }
+    out += QString::fromLatin1("rows stepped: %1, child statements: %2, "
+                               "statements prepared: %3, incidences decoded: %4\n")
+        .arg(d->counters[RowsStepped]).arg(d->counters[ChildStatements])
+        .arg(d->counters[StatementsPrepared]).arg(d->counters[IncidencesDecoded]);
+    const Private::Histogram &wait = d->locks[LockWait];
+    const Private::Histogram &hold = d->locks[LockHold];
+    out += QString::fromLatin1("lock: %1 acquisitions, %2 us waiting, "
+                               "wait p99 < %3 us, max %4 us, hold p99 < %5 us, max %6 us")
+        .arg(wait.count).arg(wait.totalUs)
+        .arg(wait.percentile(99)).arg(wait.maxUs)
+        .arg(hold.percentile(99)).arg(hold.maxUs);
+    return out;
+}
+
+thread_local StorageMetrics::Private *MetricsScope::sCurrent = nullptr;
+thread_local const char *MetricsScope::sOperation = "";
+
+MetricsScope::MetricsScope(StorageMetrics *metrics, StorageMetrics::Operation operation)
+    : mMetrics(StorageMetrics::Private::get(metrics))
+    , mPrevious(sCurrent)
+    , mPreviousOperation(sOperation)
+    , mOperation(operation)
+    , mSpan("storage", StorageMetrics::operationName(operation))
+{
+    sCurrent = mMetrics;
+    sOperation = StorageMetrics::operationName(operation);
+    if (mMetrics) {
+        mTimer.start();
+    }
+}
+
+MetricsScope::~MetricsScope()
+{
+    if (mMetrics) {
+        mMetrics->operations[mOperation].add(quint64(mTimer.nsecsElapsed() / 1000));
+    }
+    sCurrent = mPrevious;
+    sOperation = mPreviousOperation;
+}
@@ -0,0 +1,195 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+/**
+  @file
+  This file is part of the API for handling calendar data and
+  defines the StorageMetrics class.
+*/
+
+#ifndef MKCAL_STORAGEMETRICS_H
+#define MKCAL_STORAGEMETRICS_H
+
+#include "mkcal_export.h"
+
+#include <QtCore/QString>
+
+namespace mKCal {
+
+/**
+  @brief
+  A snapshot of the counters collected by a storage, see
+  ExtendedStorage::setMetricsEnabled().
+
+  Durations are given in microseconds. Latencies are recorded
+  in histograms with power of two buckets, so percentiles are
+  upper bounds.
+*/
+class MKCAL_EXPORT StorageMetrics
+{
+public:
+    /**
+      The storage operations that are timed.
+    */
+    enum Operation {
+        Open,
+        Load,
+        LoadUid,
+        LoadRange,
+        LoadRecurring,
+        LoadNotebook,
+        Search,
+        Save,
+        SaveInsert,
+        SaveUpdate,
+        SaveDelete,
+        Purge,
+        InsertedIncidences,
+        ModifiedIncidences,
+        DeletedIncidences,
+        AllIncidences,
+        AlarmIncidences,
+        IncidenceDeletedDate,
+        ChangesSince,
+        OperationCount
+    };
+
+    /**
+      The timings of the inter-process database lock.
+    */
+    enum Lock {
+        /**
+          Time spent waiting for the lock, for each acquisition.
+        */
+        LockWait,
+        /**
+          Time the lock was held, for each acquisition.
+        */
+        LockHold,
+        LockCount
+    };
+
+    /**
+      The events that are counted.
+    */
+    enum Counter {
+        /**
+          Rows returned by sqlite for any statement.
+        */
+        RowsStepped,
+        /**
+          Statements run on the child tables of incidences,
+          like alarms, attendees or recurrence rules.
+        */
+        ChildStatements,
+        /**
+          Statements compiled by sqlite.
+        */
+        StatementsPrepared,
+        /**
+          Incidences read from the database.
+        */
+        IncidencesDecoded,
+        CounterCount
+    };
+
+    /**
+      Constructs metrics with all counters at zero.
+    */
+    StorageMetrics();
+
+    StorageMetrics(const StorageMetrics &other);
+
+    ~StorageMetrics();
+
+    StorageMetrics &operator=(const StorageMetrics &other);
+
+    /**
+      Number of calls to @p operation.
+    */
+    quint64 count(Operation operation) const;
+
+    /**
+      Total time spent in @p operation.
+    */
+    quint64 totalTime(Operation operation) const;
+
+    /**
+      Longest call to @p operation.
+    */
+    quint64 maxTime(Operation operation) const;
+
+    /**
+      An upper bound of the given percentile of the durations
+      of @p operation.
+
+      @param percent a value between 0 and 100
+    */
+    quint64 percentile(Operation operation, qreal percent) const;
+
+    /**
+      Number of lock acquisitions.
+    */
+    quint64 count(Lock lock) const;
+
+    /**
+      Total time spent waiting for, or holding the lock.
+    */
+    quint64 totalTime(Lock lock) const;
+
+    /**
+      Longest time spent waiting for, or holding the lock.
+    */
+    quint64 maxTime(Lock lock) const;
+
+    /**
+      An upper bound of the given percentile of the time spent
+      waiting for, or holding the lock.
+
+      @param percent a value between 0 and 100
+    */
+    quint64 percentile(Lock lock, qreal percent) const;
+
+    /**
+      The value of @p counter.
+    */
+    quint64 counter(Counter counter) const;
+
+    /**
+      A human readable name for @p operation.
+    */
+    static const char *operationName(Operation operation);
+
+    /**
+      A multi-line human readable summary of the counters,
+      listing only the operations that have been called.
+    */
+    QString toString() const;
+
+private:
+    //@cond PRIVATE
+    class Private;
+    Private *const d;
+    //@endcond
+};
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MKCAL_STORAGEMETRICS_P_H
+#define MKCAL_STORAGEMETRICS_P_H
+
+#include "storagemetrics.h"
+#include "tracer_p.h"
+
+#include <QtCore/QElapsedTimer>
+
+namespace mKCal {
+
+class StorageMetrics::Private
+{
+public:
+    /*
+      Latencies of one operation. Bucket i counts the durations
+      lower than 2^i microseconds and at least 2^(i-1), the last
+      bucket counting all longer ones.
+    */
+    struct Histogram
+    {
+        static const int BucketCount = 25;
+
+        quint64 count = 0;
+        quint64 totalUs = 0;
+        quint64 maxUs = 0;
+        quint64 buckets[BucketCount] = {};
+
+        void add(quint64 us);
+        quint64 percentile(qreal percent) const;
+    };
+
+    Histogram operations[StorageMetrics::OperationCount];
+    Histogram locks[StorageMetrics::LockCount];
+    quint64 counters[StorageMetrics::CounterCount] = {};
+
+    static Private *get(StorageMetrics *metrics)
+    {
+        return metrics ? metrics->d : nullptr;
+    }
+};
+
+/*
+  Times a storage operation and makes its metrics the current
+  ones for the calling thread, so that low level code, like the
+  sqlite format or the process mutex, can update the counters
+  without knowing the storage.
+
+  When metrics are disabled, @p metrics is null and the scope
+  only costs two pointer assignments. The operation is also
+  recorded as a span when tracing is enabled.
+*/
+class MKCAL_EXPORT MetricsScope
+{
+public:
+    MetricsScope(StorageMetrics *metrics, StorageMetrics::Operation operation);
+    ~MetricsScope();
+
+    static StorageMetrics::Private *current()
+    {
+        return sCurrent;
+    }
+
+    /*
+      The name of the innermost operation in progress in the
+      calling thread, an empty string if none.
+    */
+    static const char *currentOperation()
+    {
+        return sOperation;
+    }
+
+private:
+    Q_DISABLE_COPY(MetricsScope)
+
+    StorageMetrics::Private *mMetrics;
+    StorageMetrics::Private *mPrevious;
+    const char *mPreviousOperation;
+    StorageMetrics::Operation mOperation;
+    QElapsedTimer mTimer;
+    TraceSpan mSpan;
+
+    static thread_local StorageMetrics::Private *sCurrent;
+    static thread_local const char *sOperation;
+};
+
+}
+
+#define MKCAL_METRICS_ADD( counter, value )                                   \
+{                                                                             \
+  mKCal::StorageMetrics::Private *metrics_ = mKCal::MetricsScope::current();  \
+  if ( Q_UNLIKELY( metrics_ ) ) {                                             \
+    metrics_->counters[mKCal::StorageMetrics::counter] += (value);            \
+  }                                                                           \
+}
+
+#endif
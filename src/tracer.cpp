@@ -0,0 +1,187 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "tracer_p.h"
+#include "logging_p.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+
+#include <atomic>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+using namespace mKCal;
+
+static QByteArray jsonString(const QString &value)
+{
+    QByteArray out("\"");
+    for (const char c : value.toUtf8()) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uchar(c) < 0x20) {
+            out += "\\u00";
+            out += QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+static QByteArray threadId()
+{
+#ifdef Q_OS_LINUX
+    return QByteArray::number(qlonglong(::syscall(SYS_gettid)));
+#else
+    return QByteArray::number(quintptr(QThread::currentThreadId()));
+#endif
+}
+
+namespace {
+
+class TraceFile
+{
+public:
+    TraceFile()
+    {
+        const QByteArray path = qgetenv("MKCAL_TRACE");
+        if (path.isEmpty()) {
+            return;
+        }
+
+        mFd = ::open(path.constData(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (mFd < 0) {
+            qCWarning(lcMkcal) << "cannot open trace file" << path << ::strerror(errno);
+            return;
+        }
+
+        // The first process to use the file opens the JSON array,
+        // the closing bracket is optional in the trace event format.
+        if (::flock(mFd, LOCK_EX) == 0) {
+            struct stat st;
+            if (::fstat(mFd, &st) == 0 && st.st_size == 0) {
+                write(QByteArray("[\n"));
+            }
+            ::flock(mFd, LOCK_UN);
+        }
+
+        pid();
+    }
+
+    ~TraceFile()
+    {
+        if (mFd >= 0) {
+            ::close(mFd);
+        }
+    }
+
+    bool isValid() const
+    {
+        return mFd >= 0;
+    }
+
+    // Read for each event, since a forked child shares the file
+    // with its parent. The process name is recorded the first
+    // time a process writes an event.
+    QByteArray pid()
+    {
+        const pid_t current = ::getpid();
+        const QByteArray pid = QByteArray::number(qlonglong(current));
+        if (mPid.exchange(current) != current) {
+            QString name = QCoreApplication::applicationName();
+            if (name.isEmpty()) {
+                name = QString::fromLatin1("pid %1").arg(current);
+            }
+            write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid
+                  + ",\"args\":{\"name\":" + jsonString(name) + "}},\n");
+        }
+        return pid;
+    }
+
+    // A single write on a file opened in append mode is not
+    // interleaved with writes from other threads or processes.
+    void write(const QByteArray &data)
+    {
+        if (::write(mFd, data.constData(), data.size()) != data.size()) {
+            qCWarning(lcMkcal) << "cannot write trace event" << ::strerror(errno);
+        }
+    }
+
+private:
+    int mFd = -1;
+    std::atomic<pid_t> mPid{0};
+};
+
+}
+
+static TraceFile *traceFile()
+{
+    static TraceFile file;
+    return &file;
+}
+
+bool Tracer::isEnabled()
+{
+    return traceFile()->isValid();
+}
+
+qint64 Tracer::now()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Tracer::complete(const char *category, const char *name,
+                      qint64 start, const QString &detail)
+{
+    TraceFile *file = traceFile();
+    if (!file->isValid()) {
+        return;
+    }
+
+    const qint64 end = now();
+    QByteArray event("{\"name\":\"");
+    event += name;
+    event += "\",\"cat\":\"";
+    event += category;
+    event += "\",\"ph\":\"X\",\"ts\":" + QByteArray::number(start)
+        + ",\"dur\":" + QByteArray::number(end - start)
+        + ",\"pid\":" + file->pid()
+        + ",\"tid\":" + threadId();
+    if (!detail.isEmpty()) {
+        event += ",\"args\":{\"detail\":" + jsonString(detail) + "}";
+    }
+    event += "},\n";
+    file->write(event);
+}
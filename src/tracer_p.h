@@ -0,0 +1,120 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MKCAL_TRACER_P_H
+#define MKCAL_TRACER_P_H
+
+#include <QtCore/QString>
+
+#include "mkcal_export.h"
+
+namespace mKCal {
+
+/*
+  Writes spans in the Chrome trace event format, to be loaded
+  in Perfetto or about:tracing.
+
+  Tracing is enabled by setting the MKCAL_TRACE environment
+  variable to the path of the output file. Several processes
+  can share the same file, every event being appended with a
+  single write and carrying its process and thread ids.
+  Timestamps come from the monotonic clock, so they are
+  comparable between processes.
+*/
+class MKCAL_EXPORT Tracer
+{
+public:
+    /*
+      Returns true if events are recorded.
+    */
+    static bool isEnabled();
+
+    /*
+      Current time of the monotonic clock, in microseconds.
+    */
+    static qint64 now();
+
+    /*
+      Records a complete event.
+
+      @param category the category of the event, like "storage"
+      @param name the name of the event
+      @param start the starting time, as given by now()
+      @param detail an optional description stored in the event arguments
+    */
+    static void complete(const char *category, const char *name,
+                         qint64 start, const QString &detail = QString());
+};
+
+/*
+  Records a complete event from its construction to its
+  destruction, if tracing is enabled.
+*/
+class TraceSpan
+{
+public:
+    TraceSpan(const char *category, const char *name)
+        : mCategory(category)
+        , mName(Tracer::isEnabled() ? name : nullptr)
+        , mStart(mName ? Tracer::now() : 0)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (mName) {
+            Tracer::complete(mCategory, mName, mStart, mDetail);
+        }
+    }
+
+    bool isEnabled() const
+    {
+        return mName != nullptr;
+    }
+
+    /*
+      Describes the span, like the uid of an incidence. Callers
+      should check isEnabled() before building expensive details.
+    */
+    void setDetail(const QString &detail)
+    {
+        if (mName) {
+            mDetail = detail;
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *mCategory;
+    const char *mName;
+    qint64 mStart;
+    QString mDetail;
+};
+
+}
+
+#define MKCAL_TRACE_CONCAT_( a, b ) a##b
+#define MKCAL_TRACE_CONCAT( a, b ) MKCAL_TRACE_CONCAT_( a, b )
+#define MKCAL_TRACE( category, name ) \
+  mKCal::TraceSpan MKCAL_TRACE_CONCAT( traceSpan_, __LINE__ )( (category), (name) )
+
+#endif
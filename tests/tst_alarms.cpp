@@ -0,0 +1,343 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QTest>
+#include <QDebug>
+
+#include <KCalendarCore/Event>
+
+#include "alarmhandler_p.h"
+#include "alarmbackend_p.h"
+
+using namespace mKCal;
+using namespace KCalendarCore;
+
+class TestAlarmHandler: public AlarmHandler
+{
+public:
+    QHash<QString, Incidence::List> mIncidences;
+
+protected:
+    Incidence::List incidencesWithAlarms(const QString &notebookUid,
+                                         const QString &uid) override
+    {
+        if (uid.isEmpty()) {
+            return mIncidences.value(notebookUid);
+        }
+        Incidence::List list;
+        for (const Incidence::Ptr &incidence : mIncidences.value(notebookUid)) {
+            if (incidence->uid() == uid) {
+                list.append(incidence);
+            }
+        }
+        return list;
+    }
+};
+
+class tst_alarms: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void testSetup();
+    void testReconcile();
+    void testClear();
+    void benchSetup_data();
+    void benchSetup();
+    void benchSetupSeries_data();
+    void benchSetupSeries();
+    void benchClear_data();
+    void benchClear();
+
+private:
+    Incidence::List generate(int count);
+
+    RecordingAlarmBackend mBackend;
+};
+
+void tst_alarms::initTestCase()
+{
+    AlarmBackend::setInstance(&mBackend);
+}
+
+void tst_alarms::cleanupTestCase()
+{
+    AlarmBackend::setInstance(nullptr);
+}
+
+void tst_alarms::init()
+{
+    mBackend.clear();
+}
+
+Incidence::List tst_alarms::generate(int count)
+{
+    const QDateTime start = QDateTime::currentDateTime().addDays(1);
+    Incidence::List list;
+    for (int i = 0; i < count; i++) {
+        Event::Ptr event(new Event);
+        event->setSummary(QString::fromLatin1("Event %1").arg(i));
+        event->setDtStart(start.addSecs(3600 * i));
+        event->setDtEnd(event->dtStart().addSecs(1800));
+        if (i % 10 == 0) {
+            event->recurrence()->setWeekly(1);
+        }
+        Alarm::Ptr alarm = event->newAlarm();
+        alarm->setDisplayAlarm(event->summary());
+        alarm->setStartOffset(Duration(-900));
+        alarm->setEnabled(true);
+        list.append(event);
+    }
+    return list;
+}
+
+void tst_alarms::testSetup()
+{
+    const QDateTime start = QDateTime::currentDateTime().addDays(1);
+    TestAlarmHandler handler;
+
+    Event::Ptr event(new Event);
+    event->setSummary(QString::fromLatin1("Display alarm"));
+    event->setDtStart(start);
+    Alarm::Ptr alarm = event->newAlarm();
+    alarm->setDisplayAlarm(event->summary());
+    alarm->setStartOffset(Duration(-900));
+    alarm->setEnabled(true);
+
+    Event::Ptr recurring(new Event);
+    recurring->setSummary(QString::fromLatin1("Recurring alarm"));
+    recurring->setDtStart(start.addDays(-7));
+    recurring->recurrence()->setDaily(1);
+    alarm = recurring->newAlarm();
+    alarm->setDisplayAlarm(recurring->summary());
+    alarm->setStartOffset(Duration(-900));
+    alarm->setEnabled(true);
+
+    Event::Ptr procedure(new Event);
+    procedure->setSummary(QString::fromLatin1("Procedure alarm"));
+    procedure->setDtStart(start);
+    alarm = procedure->newAlarm();
+    alarm->setProcedureAlarm(QString::fromLatin1("/usr/bin/true"), QString::fromLatin1("--alarm"));
+    alarm->setStartOffset(Duration(-900));
+    alarm->setEnabled(true);
+
+    Event::Ptr disabled(new Event);
+    disabled->setSummary(QString::fromLatin1("Disabled alarm"));
+    disabled->setDtStart(start);
+    alarm = disabled->newAlarm();
+    alarm->setDisplayAlarm(disabled->summary());
+    alarm->setEnabled(false);
+
+    handler.mIncidences.insert(QString::fromLatin1("notebook"),
+                               Incidence::List() << event << recurring << procedure << disabled);
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+
+    QHash<QString, AlarmBackend::Event> events;
+    for (const AlarmBackend::Event &e : mBackend.events()) {
+        QCOMPARE(e.attributes.value(QString::fromLatin1("APPLICATION")), QString::fromLatin1("libextendedkcal"));
+        QCOMPARE(e.attributes.value(QString::fromLatin1("notebook")), QString::fromLatin1("notebook"));
+        events.insert(e.attributes.value(QString::fromLatin1("uid")), e);
+    }
+    QCOMPARE(events.count(), 3);
+
+    QVERIFY(events.contains(event->uid()));
+    QCOMPARE(events[event->uid()].ticker, start.addSecs(-900).toUTC());
+    QVERIFY(events[event->uid()].reminder);
+    QVERIFY(events[event->uid()].actions.isEmpty());
+
+    QVERIFY(events.contains(recurring->uid()));
+    QCOMPARE(events[recurring->uid()].attributes.value(QString::fromLatin1("recurs")), QString::fromLatin1("true"));
+    QCOMPARE(events[recurring->uid()].actions.count(), 1);
+    QCOMPARE(events[recurring->uid()].actions[0].when, AlarmBackend::Action::WhenServed);
+    QVERIFY(events[recurring->uid()].actions[0].command.contains(QString::fromLatin1("--reset-alarms")));
+
+    QVERIFY(events.contains(procedure->uid()));
+    QVERIFY(!events[procedure->uid()].reminder);
+    QCOMPARE(events[procedure->uid()].actions.count(), 1);
+    QCOMPARE(events[procedure->uid()].actions[0].when, AlarmBackend::Action::WhenFinalized);
+    QCOMPARE(events[procedure->uid()].actions[0].command, QString::fromLatin1("/usr/bin/true --alarm"));
+
+    // Setting up again does not touch unchanged alarms.
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+    QCOMPARE(mBackend.events().count(), 3);
+    QCOMPARE(mBackend.addCount(), 1);
+    QCOMPARE(mBackend.cancelCount(), 0);
+    QCOMPARE(mBackend.queryCount(), 1);
+}
+
+void tst_alarms::testReconcile()
+{
+    TestAlarmHandler handler;
+    const Incidence::List list = generate(5);
+    handler.mIncidences.insert(QString::fromLatin1("notebook"), list);
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+    const QHash<uint, AlarmBackend::Event> initial = mBackend.events();
+    QCOMPARE(initial.count(), 5);
+
+    // Only the modified incidence is rescheduled.
+    list[1]->setSummary(QString::fromLatin1("Modified"));
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook"), list[1]->uid()));
+    QCOMPARE(mBackend.cancelCount(), 1);
+    QCOMPARE(mBackend.addCount(), 2);
+    QCOMPARE(mBackend.events().count(), 5);
+    int kept = 0;
+    for (QHash<uint, AlarmBackend::Event>::ConstIterator it = initial.constBegin();
+         it != initial.constEnd(); it++) {
+        if (mBackend.events().contains(it.key())) {
+            kept += 1;
+            QVERIFY(it->attributes.value(QString::fromLatin1("uid")) != list[1]->uid());
+        }
+    }
+    QCOMPARE(kept, 4);
+
+    // Removing alarms from a series does not add anything.
+    list[2]->clearAlarms();
+    QSet<QPair<QString, QString>> uids;
+    uids.insert(QPair<QString, QString>(QString::fromLatin1("notebook"), list[2]->uid()));
+    uids.insert(QPair<QString, QString>(QString::fromLatin1("notebook"), list[3]->uid()));
+    QVERIFY(handler.setupAlarms(uids));
+    QCOMPARE(mBackend.cancelCount(), 2);
+    QCOMPARE(mBackend.addCount(), 2);
+    QCOMPARE(mBackend.events().count(), 4);
+    QCOMPARE(mBackend.queryCount(), 1);
+
+    // Another handler picks up the existing alarms and replaces them.
+    TestAlarmHandler other;
+    other.mIncidences = handler.mIncidences;
+    QVERIFY(other.setupAlarms(QString::fromLatin1("notebook")));
+    QCOMPARE(mBackend.queryCount(), 2);
+    QCOMPARE(mBackend.events().count(), 4);
+
+    // Alarms modified outside of the handler are resynchronized
+    // before adding anything, so they are not duplicated.
+    list[4]->setSummary(QString::fromLatin1("Modified"));
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook"), list[4]->uid()));
+    QCOMPARE(mBackend.queryCount(), 3);
+    QCOMPARE(mBackend.events().count(), 4);
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+    QCOMPARE(mBackend.queryCount(), 3);
+    QCOMPARE(mBackend.events().count(), 4);
+}
+
+void tst_alarms::testClear()
+{
+    TestAlarmHandler handler;
+    const Incidence::List first = generate(5);
+    const Incidence::List second = generate(5);
+    handler.mIncidences.insert(QString::fromLatin1("first"), first);
+    handler.mIncidences.insert(QString::fromLatin1("second"), second);
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("first")));
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("second")));
+    QCOMPARE(mBackend.events().count(), 10);
+
+    QVERIFY(handler.clearAlarms(QString::fromLatin1("first"), first[0]->uid()));
+    QCOMPARE(mBackend.events().count(), 9);
+
+    QSet<QPair<QString, QString>> uids;
+    uids.insert(QPair<QString, QString>(QString::fromLatin1("first"), first[1]->uid()));
+    uids.insert(QPair<QString, QString>(QString::fromLatin1("second"), QString()));
+    QVERIFY(handler.clearAlarms(uids));
+    QCOMPARE(mBackend.events().count(), 3);
+    for (const AlarmBackend::Event &e : mBackend.events()) {
+        QCOMPARE(e.attributes.value(QString::fromLatin1("notebook")), QString::fromLatin1("first"));
+    }
+
+    QVERIFY(handler.clearAlarms(QString::fromLatin1("first")));
+    QVERIFY(mBackend.events().isEmpty());
+}
+
+void tst_alarms::benchSetup_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("1000 incidences") << 1000;
+    QTest::newRow("5000 incidences") << 5000;
+}
+
+void tst_alarms::benchSetup()
+{
+    QFETCH(int, count);
+
+    TestAlarmHandler handler;
+    handler.mIncidences.insert(QString::fromLatin1("notebook"), generate(count));
+
+    QBENCHMARK {
+        handler.setupAlarms(QString::fromLatin1("notebook"));
+    }
+    QCOMPARE(mBackend.events().count(), count);
+}
+
+void tst_alarms::benchSetupSeries_data()
+{
+    benchSetup_data();
+}
+
+void tst_alarms::benchSetupSeries()
+{
+    QFETCH(int, count);
+
+    TestAlarmHandler handler;
+    const Incidence::List list = generate(count);
+    handler.mIncidences.insert(QString::fromLatin1("notebook"), list);
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+
+    // Like after saving a few modified incidences, only
+    // their alarms are replaced.
+    QSet<QPair<QString, QString>> uids;
+    for (int i = 0; i < list.count(); i += list.count() / 10) {
+        uids.insert(QPair<QString, QString>(QString::fromLatin1("notebook"), list[i]->uid()));
+    }
+    int revision = 0;
+    QBENCHMARK {
+        revision += 1;
+        for (int i = 0; i < list.count(); i += list.count() / 10) {
+            list[i]->setSummary(QString::fromLatin1("Modified %1").arg(revision));
+        }
+        handler.setupAlarms(uids);
+    }
+    QCOMPARE(mBackend.events().count(), count);
+}
+
+void tst_alarms::benchClear_data()
+{
+    benchSetup_data();
+}
+
+void tst_alarms::benchClear()
+{
+    QFETCH(int, count);
+
+    TestAlarmHandler handler;
+    handler.mIncidences.insert(QString::fromLatin1("notebook"), generate(count));
+    QVERIFY(handler.setupAlarms(QString::fromLatin1("notebook")));
+    QCOMPARE(mBackend.events().count(), count);
+
+    QBENCHMARK_ONCE {
+        handler.clearAlarms(QString::fromLatin1("notebook"));
+    }
+    QVERIFY(mBackend.events().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_alarms)
+#include "tst_alarms.moc"
@@ -0,0 +1,518 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+/*
+  Benchmarks of the storage operations on synthetic data sets.
+
+  The data sets are generated according to the profiles defined
+  in dataset.h, at the scales given by MKCAL_BENCH_SCALES, a comma
+  separated list of sizes (default 1000). MKCAL_BENCH_PROFILES
+  restricts the profiles (default all) and MKCAL_BENCH_SEED changes
+  the seed (default 1). MKCAL_BENCH_TOMBSTONES sets the number
+  of deletions purged at once by benchPurgeTombstones (default 10000).
+
+  Use the usual QtTest output options to get machine readable
+  results, like -o results.xml,xml or -o results.csv,csv.
+*/
+
+#include <QObject>
+#include <QTest>
+#include <QDebug>
+#include <QTemporaryDir>
+
+#include "extendedcalendar.h"
+#include "sqlitestorage.h"
+#include "alarmbackend_p.h"
+#include "dataset.h"
+
+using namespace mKCal;
+using namespace KCalendarCore;
+
+// Benchmarks should not flood the system alarm service.
+class NullAlarmBackend: public AlarmBackend
+{
+public:
+    bool query(const QMap<QString, QVariant> &, QList<uint> *) override
+    {
+        return true;
+    }
+    bool attributes(const QList<uint> &, QMap<uint, QMap<QString, QString>> *) override
+    {
+        return true;
+    }
+    bool cancel(const QList<uint> &) override
+    {
+        return true;
+    }
+    bool add(const EventList &events, QList<uint> *cookies) override
+    {
+        for (int i = 0; i < events.count(); i++) {
+            cookies->append(i + 1);
+        }
+        return true;
+    }
+};
+
+class tst_bench: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchOpen_data();
+    void benchOpen();
+    void benchLoadRange_data();
+    void benchLoadRange();
+    void benchLoadUid_data();
+    void benchLoadUid();
+    void benchLoadNotebook_data();
+    void benchLoadNotebook();
+    void benchSearch_data();
+    void benchSearch();
+    void benchInsert_data();
+    void benchInsert();
+    void benchUpdate_data();
+    void benchUpdate();
+    void benchUpdateStatus_data();
+    void benchUpdateStatus();
+    void benchDelete_data();
+    void benchDelete();
+    void benchDeletedIncidences_data();
+    void benchDeletedIncidences();
+    void benchPurgeDeleted_data();
+    void benchPurgeDeleted();
+    void benchPurgeTombstones();
+
+private:
+    void addDatasetRows();
+    Dataset dataset() const;
+    QString database(const Dataset &dataset);
+    QString scratch(const Dataset &dataset);
+    ExtendedStorage::Ptr openStorage(const QString &databaseName) const;
+
+    QTemporaryDir mDir;
+    QList<int> mScales;
+    QList<Dataset::Profile> mProfiles;
+    quint32 mSeed = 1;
+    NullAlarmBackend mAlarms;
+};
+
+void tst_bench::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+    AlarmBackend::setInstance(&mAlarms);
+
+    const QByteArray scales = qgetenv("MKCAL_BENCH_SCALES");
+    for (const QByteArray &scale : (scales.isEmpty() ? QByteArray("1000") : scales).split(',')) {
+        bool ok = false;
+        mScales.append(scale.trimmed().toInt(&ok));
+        QVERIFY2(ok && mScales.last() > 0, "invalid MKCAL_BENCH_SCALES");
+    }
+
+    const QByteArray profiles = qgetenv("MKCAL_BENCH_PROFILES");
+    if (profiles.isEmpty()) {
+        mProfiles = Dataset::profiles();
+    } else {
+        for (const QByteArray &name : profiles.split(',')) {
+            Dataset::Profile profile;
+            QVERIFY2(Dataset::profileFromName(QString::fromLatin1(name.trimmed()), &profile),
+                     "invalid MKCAL_BENCH_PROFILES");
+            mProfiles.append(profile);
+        }
+    }
+
+    const QByteArray seed = qgetenv("MKCAL_BENCH_SEED");
+    if (!seed.isEmpty()) {
+        mSeed = seed.toUInt();
+    }
+}
+
+void tst_bench::cleanupTestCase()
+{
+    AlarmBackend::setInstance(nullptr);
+}
+
+void tst_bench::addDatasetRows()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<int>("size");
+
+    for (Dataset::Profile profile : mProfiles) {
+        for (int size : mScales) {
+            const QByteArray name = QString::fromLatin1("%1 %2")
+                .arg(Dataset::profileName(profile)).arg(size).toLatin1();
+            QTest::newRow(name.constData()) << int(profile) << size;
+        }
+    }
+}
+
+Dataset tst_bench::dataset() const
+{
+    QFETCH(int, profile);
+    QFETCH(int, size);
+    return Dataset(Dataset::Profile(profile), size, mSeed);
+}
+
+ExtendedStorage::Ptr tst_bench::openStorage(const QString &databaseName) const
+{
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    ExtendedStorage::Ptr storage(new SqliteStorage(calendar, databaseName, true));
+    return storage->open() ? storage : ExtendedStorage::Ptr();
+}
+
+// The generated databases are shared by all benchmarks
+// and should not be modified.
+QString tst_bench::database(const Dataset &dataset)
+{
+    const QString path = mDir.filePath(QString::fromLatin1("%1-%2-%3.db")
+                                       .arg(Dataset::profileName(dataset.profile()))
+                                       .arg(dataset.size()).arg(dataset.seed()));
+    if (QFile::exists(path)) {
+        return path;
+    }
+
+    return dataset.write(path) ? path : QString();
+}
+
+// A copy of a generated database, for benchmarks modifying it.
+QString tst_bench::scratch(const Dataset &dataset)
+{
+    const QString source = database(dataset);
+    const QString path = mDir.filePath(QString::fromLatin1("scratch.db"));
+    QFile::remove(path);
+    QFile::remove(path + QString::fromLatin1(".changed"));
+    return !source.isEmpty() && QFile::copy(source, path) ? path : QString();
+}
+
+void tst_bench::benchOpen_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchOpen()
+{
+    const QString path = database(dataset());
+    QVERIFY(!path.isEmpty());
+
+    QBENCHMARK {
+        ExtendedStorage::Ptr storage = openStorage(path);
+        QVERIFY(storage);
+        storage->close();
+    }
+}
+
+void tst_bench::benchLoadRange_data()
+{
+    addDatasetRows();
+}
+
+// Loading a range twice in the same storage is a no-op,
+// so each iteration opens the database, see benchOpen.
+void tst_bench::benchLoadRange()
+{
+    const Dataset data = dataset();
+    const QString path = database(data);
+    QVERIFY(!path.isEmpty());
+
+    const QDate from = data.referenceDate().date();
+    QBENCHMARK {
+        ExtendedStorage::Ptr storage = openStorage(path);
+        QVERIFY(storage);
+        QVERIFY(storage->load(from, from.addDays(30)));
+    }
+}
+
+void tst_bench::benchLoadUid_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchLoadUid()
+{
+    const Dataset data = dataset();
+    const QString path = database(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    const QString uid = data.series(data.seriesCount() / 2, nullptr).first()->uid();
+    QBENCHMARK {
+        QVERIFY(storage->load(uid));
+    }
+    QVERIFY(storage->calendar()->incidence(uid));
+}
+
+void tst_bench::benchLoadNotebook_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchLoadNotebook()
+{
+    const Dataset data = dataset();
+    const QString path = database(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    const QString notebookUid = data.notebook(0)->uid();
+    QBENCHMARK {
+        QVERIFY(storage->loadNotebookIncidences(notebookUid));
+    }
+    QVERIFY(!storage->calendar()->incidences(notebookUid).isEmpty());
+}
+
+void tst_bench::benchSearch_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchSearch()
+{
+    const Dataset data = dataset();
+    const QString path = database(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    QStringList identifiers;
+    QBENCHMARK {
+        identifiers.clear();
+        QVERIFY(storage->search(data.searchKey(), &identifiers, 50));
+    }
+    QVERIFY(!identifiers.isEmpty());
+}
+
+void tst_bench::benchInsert_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchInsert()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    QList<QPair<QString, Incidence::Ptr>> extras;
+    for (int i = 0; i < qMax(1, data.size() / 10); i++) {
+        QString notebookUid;
+        const Incidence::Ptr incidence = data.extra(i, &notebookUid);
+        extras.append(QPair<QString, Incidence::Ptr>(notebookUid, incidence));
+    }
+
+    QBENCHMARK_ONCE {
+        for (const QPair<QString, Incidence::Ptr> &extra : extras) {
+            storage->calendar()->addIncidence(extra.second, extra.first);
+        }
+        QVERIFY(storage->save());
+    }
+}
+
+void tst_bench::benchUpdate_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchUpdate()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+    QVERIFY(storage->load());
+
+    const Incidence::List list = storage->calendar()->incidences();
+    for (int i = 0; i < list.count(); i += 10) {
+        list[i]->setSummary(list[i]->summary() + QString::fromLatin1(" (updated)"));
+    }
+
+    QBENCHMARK_ONCE {
+        QVERIFY(storage->save());
+    }
+}
+
+void tst_bench::benchUpdateStatus_data()
+{
+    addDatasetRows();
+}
+
+// Only the status changes, the long descriptions are not
+// written again. Compare with benchUpdate().
+void tst_bench::benchUpdateStatus()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+    QVERIFY(storage->load());
+
+    const QString description = QString::fromLatin1("a long description, ").repeated(200);
+    const Incidence::List list = storage->calendar()->incidences();
+    for (int i = 0; i < list.count(); i += 10) {
+        list[i]->setDescription(description);
+    }
+    QVERIFY(storage->save());
+    for (int i = 0; i < list.count(); i += 10) {
+        list[i]->setStatus(Incidence::StatusCanceled);
+    }
+
+    QBENCHMARK_ONCE {
+        QVERIFY(storage->save());
+    }
+}
+
+void tst_bench::benchDelete_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchDelete()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+    QVERIFY(storage->load());
+
+    for (int i = 0; i < data.seriesCount(); i += 10) {
+        const Incidence::Ptr incidence = storage->calendar()->incidence(data.series(i, nullptr).first()->uid());
+        QVERIFY(incidence);
+        QVERIFY(storage->calendar()->deleteIncidence(incidence));
+    }
+
+    QBENCHMARK_ONCE {
+        QVERIFY(storage->save());
+    }
+}
+
+void tst_bench::benchDeletedIncidences_data()
+{
+    addDatasetRows();
+}
+
+void tst_bench::benchDeletedIncidences()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+    QVERIFY(storage->load());
+    for (int i = 0; i < data.seriesCount(); i += 10) {
+        const Incidence::Ptr incidence = storage->calendar()->incidence(data.series(i, nullptr).first()->uid());
+        QVERIFY(incidence);
+        QVERIFY(storage->calendar()->deleteIncidence(incidence));
+    }
+    QVERIFY(storage->save());
+
+    Incidence::List deleted;
+    QBENCHMARK {
+        deleted.clear();
+        QVERIFY(storage->deletedIncidences(&deleted));
+    }
+    QVERIFY(!deleted.isEmpty());
+}
+
+void tst_bench::benchPurgeDeleted_data()
+{
+    addDatasetRows();
+}
+
+// Purges the tombstones of the data set, as a sync plugin would
+// after having sent the deletions.
+void tst_bench::benchPurgeDeleted()
+{
+    const Dataset data = dataset();
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    QList<QPair<QString, Incidence::List>> deletions;
+    for (const Notebook::Ptr &notebook : storage->notebooks()) {
+        Incidence::List deleted;
+        QVERIFY(storage->deletedIncidences(&deleted, QDateTime(), notebook->uid()));
+        deletions.append(QPair<QString, Incidence::List>(notebook->uid(), deleted));
+    }
+
+    QBENCHMARK_ONCE {
+        for (const QPair<QString, Incidence::List> &deletion : deletions) {
+            QVERIFY(storage->purgeDeletedIncidences(deletion.second, deletion.first));
+        }
+    }
+}
+
+void tst_bench::benchPurgeTombstones()
+{
+    bool ok = false;
+    int count = qEnvironmentVariableIntValue("MKCAL_BENCH_TOMBSTONES", &ok);
+    if (!ok || count <= 0) {
+        count = 10000;
+    }
+    const Dataset data(Dataset::Meetings, mScales.first(), mSeed);
+    const QString path = scratch(data);
+    QVERIFY(!path.isEmpty());
+    ExtendedStorage::Ptr storage = openStorage(path);
+    QVERIFY(storage);
+
+    QHash<QString, Incidence::List> tombstones;
+    for (int i = 0; i < count; i++) {
+        QString notebookUid;
+        const Incidence::Ptr incidence = data.extra(i, &notebookUid);
+        QVERIFY(storage->calendar()->addIncidence(incidence, notebookUid));
+        tombstones[notebookUid].append(incidence);
+    }
+    QVERIFY(storage->save());
+    for (const Incidence::List &list : tombstones) {
+        for (const Incidence::Ptr &incidence : list) {
+            QVERIFY(storage->calendar()->deleteIncidence(incidence));
+        }
+    }
+    QVERIFY(storage->save());
+
+    QBENCHMARK_ONCE {
+        for (QHash<QString, Incidence::List>::ConstIterator it = tombstones.constBegin();
+             it != tombstones.constEnd(); it++) {
+            QVERIFY(storage->purgeDeletedIncidences(*it, it.key()));
+        }
+    }
+
+    QSet<QString> uids;
+    for (const Incidence::List &list : tombstones) {
+        for (const Incidence::Ptr &incidence : list) {
+            uids.insert(incidence->uid());
+        }
+    }
+    Incidence::List deleted;
+    QVERIFY(storage->deletedIncidences(&deleted));
+    for (const Incidence::Ptr &incidence : deleted) {
+        QVERIFY(!uids.contains(incidence->uid()));
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_bench)
+#include "tst_bench.moc"
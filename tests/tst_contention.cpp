@@ -0,0 +1,447 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+/*
+  Several processes accessing the same database.
+
+  The test spawns itself as writer and reader processes, running
+  a workload mix against a database generated from the meetings
+  data set profile. Each worker reports the latency of its
+  operations and the time it received change notifications, then
+  the test prints throughput, latency percentiles, errors and
+  notification delays.
+
+  The default scenarios can be replaced by a single one with:
+  MKCAL_CONTENTION_WRITERS, MKCAL_CONTENTION_READERS (number of processes),
+  MKCAL_CONTENTION_OPERATIONS (per process, default 50),
+  MKCAL_CONTENTION_SIZE (database size, default 1000),
+  MKCAL_CONTENTION_WRITE_MIX (default "insert=6,update=3,delete=1"),
+  MKCAL_CONTENTION_READ_MIX (default "range=2,uid=1,search=1") and
+  MKCAL_CONTENTION_THINK_MS (pause between operations, default 5).
+*/
+
+#include <QObject>
+#include <QTest>
+#include <QDebug>
+#include <QProcess>
+#include <QSocketNotifier>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "extendedcalendar.h"
+#include "extendedstorageobserver.h"
+#include "sqlitestorage.h"
+#include "alarmbackend_p.h"
+#include "dataset.h"
+
+using namespace mKCal;
+using namespace KCalendarCore;
+
+static const char *Writer = "writer";
+static const char *Reader = "reader";
+
+// Monotonic clock, comparable between processes.
+static qint64 now()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer.nsecsSinceReference() / 1000;
+}
+
+static void report(const QByteArray &line)
+{
+    fprintf(stdout, "%s\n", line.constData());
+    fflush(stdout);
+}
+
+// Parses "name=weight,name=weight" into a list where each name
+// appears weight times, to be picked at random.
+static QList<QByteArray> parseMix(const QByteArray &mix)
+{
+    QList<QByteArray> choices;
+    for (const QByteArray &item : mix.split(',')) {
+        const QList<QByteArray> pair = item.trimmed().split('=');
+        const int weight = pair.count() == 2 ? pair[1].toInt() : 1;
+        for (int i = 0; i < weight; i++) {
+            choices.append(pair[0]);
+        }
+    }
+    return choices;
+}
+
+class Worker: public QObject, public ExtendedStorageObserver
+{
+    Q_OBJECT
+
+public:
+    Worker(const QStringList &arguments);
+
+    int run();
+
+    void storageModified(ExtendedStorage *storage, const QString &info) override;
+    void storageFinished(ExtendedStorage *storage, bool error, const QString &info) override;
+    void storageUpdated(ExtendedStorage *storage,
+                        const Incidence::List &added,
+                        const Incidence::List &modified,
+                        const Incidence::List &deleted) override;
+
+private:
+    bool write(const QByteArray &operation, int step);
+    bool read(const QByteArray &operation);
+    Incidence::Ptr loadSeries();
+
+    QByteArray mRole;
+    QString mDatabaseName;
+    int mIndex;
+    int mWorkers;
+    int mOperations;
+    QList<QByteArray> mMix;
+    int mThink;
+    Dataset mDataset;
+    quint64 mRandom;
+    ExtendedCalendar::Ptr mCalendar;
+    SqliteStorage::Ptr mStorage;
+};
+
+Worker::Worker(const QStringList &arguments)
+    : mRole(arguments.value(2).toLatin1())
+    , mDatabaseName(arguments.value(3))
+    , mIndex(arguments.value(4).toInt())
+    , mWorkers(qMax(1, arguments.value(5).toInt()))
+    , mOperations(arguments.value(6).toInt())
+    , mMix(parseMix(arguments.value(7).toLatin1()))
+    , mThink(arguments.value(8).toInt())
+    , mDataset(Dataset::Meetings, arguments.value(9).toInt())
+    , mRandom(quint64(mIndex) * 2654435761u + (mRole == Writer ? 1 : 2))
+{
+}
+
+void Worker::storageModified(ExtendedStorage *storage, const QString &info)
+{
+    Q_UNUSED(storage);
+    Q_UNUSED(info);
+    report("notified " + QByteArray::number(now()));
+}
+
+void Worker::storageFinished(ExtendedStorage *storage, bool error, const QString &info)
+{
+    Q_UNUSED(storage);
+    Q_UNUSED(error);
+    Q_UNUSED(info);
+}
+
+void Worker::storageUpdated(ExtendedStorage *storage,
+                            const Incidence::List &added,
+                            const Incidence::List &modified,
+                            const Incidence::List &deleted)
+{
+    Q_UNUSED(storage);
+    Q_UNUSED(added);
+    Q_UNUSED(modified);
+    Q_UNUSED(deleted);
+}
+
+// Writers only touch their own share of the series, so that
+// failures are locking problems, not concurrent deletions.
+Incidence::Ptr Worker::loadSeries()
+{
+    const int count = mDataset.seriesCount() / mWorkers;
+    const int index = (mRole == Writer)
+        ? mIndex + mWorkers * int((mRandom >> 17) % quint64(qMax(1, count)))
+        : int((mRandom >> 17) % quint64(mDataset.seriesCount()));
+    const QString uid = mDataset.series(index, nullptr).first()->uid();
+    if (!mStorage->load(uid)) {
+        return Incidence::Ptr();
+    }
+    return mCalendar->incidence(uid);
+}
+
+bool Worker::write(const QByteArray &operation, int step)
+{
+    if (operation == "insert") {
+        QString notebookUid;
+        const Incidence::Ptr incidence = mDataset.extra(mIndex * mOperations + step, &notebookUid);
+        if (!mCalendar->addIncidence(incidence, notebookUid)) {
+            return false;
+        }
+    } else {
+        const Incidence::Ptr incidence = loadSeries();
+        if (!incidence) {
+            // Already deleted by a previous operation.
+            return true;
+        }
+        if (operation == "update") {
+            incidence->setSummary(incidence->summary() + QString::fromLatin1(" (%1)").arg(step));
+        } else if (!mCalendar->deleteIncidence(incidence)) {
+            return false;
+        }
+    }
+    const bool success = mStorage->save();
+    report("saved " + QByteArray::number(now()));
+    return success;
+}
+
+bool Worker::read(const QByteArray &operation)
+{
+    if (operation == "range") {
+        const QDate from = mDataset.referenceDate().date().addDays(int((mRandom >> 17) % 700) - 350);
+        return mStorage->load(from, from.addDays(7));
+    } else if (operation == "uid") {
+        return loadSeries() != nullptr;
+    } else {
+        QStringList identifiers;
+        return mStorage->search(mDataset.searchKey(), &identifiers, 20);
+    }
+}
+
+int Worker::run()
+{
+    mCalendar = ExtendedCalendar::Ptr(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mStorage = SqliteStorage::Ptr(new SqliteStorage(mCalendar, mDatabaseName));
+    if (mMix.isEmpty() || !mStorage->open()) {
+        return 1;
+    }
+    mStorage->registerObserver(this);
+
+    for (int step = 0; step < mOperations; step++) {
+        mRandom = mRandom * 6364136223846793005ULL + 1442695040888963407ULL;
+        const QByteArray operation = mMix[int((mRandom >> 33) % quint64(mMix.count()))];
+        const qint64 start = now();
+        const bool success = (mRole == Writer) ? write(operation, step) : read(operation);
+        report("op " + operation + ' ' + QByteArray::number(now() - start)
+               + ' ' + (success ? '1' : '0'));
+        // Let the file watcher deliver the notifications.
+        QTest::qWait(mThink);
+    }
+
+    if (mRole == Reader) {
+        // Keep receiving notifications until all writers are done.
+        QSocketNotifier quit(fileno(stdin), QSocketNotifier::Read);
+        QEventLoop loop;
+        connect(&quit, &QSocketNotifier::activated, &loop, &QEventLoop::quit);
+        QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    mStorage->unregisterObserver(this);
+    mStorage->close();
+    return 0;
+}
+
+class tst_contention: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void contention_data();
+    void contention();
+
+private:
+    QTemporaryDir mDir;
+    int mSize = 1000;
+    int mOperations = 50;
+    int mThink = 5;
+    QString mWriteMix = QString::fromLatin1("insert=6,update=3,delete=1");
+    QString mReadMix = QString::fromLatin1("range=2,uid=1,search=1");
+};
+
+void tst_contention::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+
+    bool ok = false;
+    int value = qEnvironmentVariableIntValue("MKCAL_CONTENTION_SIZE", &ok);
+    if (ok && value > 0) {
+        mSize = value;
+    }
+    value = qEnvironmentVariableIntValue("MKCAL_CONTENTION_OPERATIONS", &ok);
+    if (ok && value > 0) {
+        mOperations = value;
+    }
+    value = qEnvironmentVariableIntValue("MKCAL_CONTENTION_THINK_MS", &ok);
+    if (ok && value >= 0) {
+        mThink = value;
+    }
+    if (qEnvironmentVariableIsSet("MKCAL_CONTENTION_WRITE_MIX")) {
+        mWriteMix = qEnvironmentVariable("MKCAL_CONTENTION_WRITE_MIX");
+    }
+    if (qEnvironmentVariableIsSet("MKCAL_CONTENTION_READ_MIX")) {
+        mReadMix = qEnvironmentVariable("MKCAL_CONTENTION_READ_MIX");
+    }
+}
+
+void tst_contention::contention_data()
+{
+    QTest::addColumn<int>("writers");
+    QTest::addColumn<int>("readers");
+
+    if (qEnvironmentVariableIsSet("MKCAL_CONTENTION_WRITERS")
+        || qEnvironmentVariableIsSet("MKCAL_CONTENTION_READERS")) {
+        const int writers = qEnvironmentVariableIntValue("MKCAL_CONTENTION_WRITERS");
+        const int readers = qEnvironmentVariableIntValue("MKCAL_CONTENTION_READERS");
+        const QByteArray name = QString::fromLatin1("%1 writers, %2 readers")
+            .arg(writers).arg(readers).toLatin1();
+        QTest::newRow(name.constData()) << writers << readers;
+    } else {
+        QTest::newRow("1 writer, 2 readers") << 1 << 2;
+        QTest::newRow("4 writers, 4 readers") << 4 << 4;
+    }
+}
+
+static qint64 percentile(QList<qint64> values, int percent)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[qMin(values.count() - 1, (values.count() * percent) / 100)];
+}
+
+void tst_contention::contention()
+{
+    QFETCH(int, writers);
+    QFETCH(int, readers);
+
+    const QString path = mDir.filePath(QString::fromLatin1("%1-%2.db")
+                                       .arg(writers).arg(readers));
+    QVERIFY(Dataset(Dataset::Meetings, mSize).write(path));
+
+    QList<QProcess*> processes;
+    QList<QByteArray> roles;
+    const qint64 start = now();
+    for (int i = 0; i < readers + writers; i++) {
+        const bool isWriter = i >= readers;
+        QProcess *process = new QProcess(this);
+        process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process->start(QCoreApplication::applicationFilePath(), QStringList()
+                       << QString::fromLatin1("--worker")
+                       << QString::fromLatin1(isWriter ? Writer : Reader)
+                       << path
+                       << QString::number(isWriter ? i - readers : i)
+                       << QString::number(isWriter ? writers : readers)
+                       << QString::number(mOperations)
+                       << (isWriter ? mWriteMix : mReadMix)
+                       << QString::number(mThink)
+                       << QString::number(mSize));
+        QVERIFY(process->waitForStarted());
+        processes.append(process);
+        roles.append(isWriter ? Writer : Reader);
+    }
+
+    for (int i = readers; i < processes.count(); i++) {
+        QVERIFY(processes[i]->waitForFinished(300000));
+    }
+    const qint64 duration = now() - start;
+    // Let the last notifications arrive, then stop the readers.
+    QTest::qWait(500);
+    for (int i = 0; i < readers; i++) {
+        processes[i]->write("quit\n");
+        processes[i]->closeWriteChannel();
+        QVERIFY(processes[i]->waitForFinished(60000));
+    }
+
+    QMap<QByteArray, QList<qint64>> latencies;
+    QMap<QByteArray, int> errors;
+    QList<qint64> saves;
+    QList<QList<qint64>> notifications;
+    for (int i = 0; i < processes.count(); i++) {
+        QCOMPARE(processes[i]->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(processes[i]->exitCode(), 0);
+        QList<qint64> notified;
+        for (const QByteArray &line : processes[i]->readAllStandardOutput().split('\n')) {
+            const QList<QByteArray> fields = line.split(' ');
+            if (fields.count() == 4 && fields[0] == "op") {
+                const QByteArray key = roles[i] + ' ' + fields[1];
+                latencies[key].append(fields[2].toLongLong());
+                errors[key] += (fields[3] == "1") ? 0 : 1;
+            } else if (fields.count() == 2 && fields[0] == "saved") {
+                saves.append(fields[1].toLongLong());
+            } else if (fields.count() == 2 && fields[0] == "notified") {
+                notified.append(fields[1].toLongLong());
+            }
+        }
+        if (roles[i] == Reader) {
+            notifications.append(notified);
+        }
+    }
+
+    qInfo().noquote() << QString::fromLatin1("%1 writers, %2 readers, %3 operations each, %4 ms")
+        .arg(writers).arg(readers).arg(mOperations).arg(duration / 1000);
+    int totalErrors = 0;
+    for (QMap<QByteArray, QList<qint64>>::ConstIterator it = latencies.constBegin();
+         it != latencies.constEnd(); it++) {
+        qInfo().noquote() << QString::fromLatin1("%1: %2 ops, %3 ops/s, p50 %4 us, p99 %5 us, %6 errors")
+            .arg(QString::fromLatin1(it.key()), -16).arg(it->count())
+            .arg(qreal(it->count()) * 1e6 / qMax(qint64(1), duration), 0, 'f', 1)
+            .arg(percentile(*it, 50)).arg(percentile(*it, 99))
+            .arg(errors.value(it.key()));
+        totalErrors += errors.value(it.key());
+    }
+
+    // Delay between a save and the next notification of each reader.
+    QList<qint64> delays;
+    for (QList<qint64> notified : notifications) {
+        std::sort(notified.begin(), notified.end());
+        for (qint64 save : saves) {
+            QList<qint64>::ConstIterator it = std::lower_bound(notified.constBegin(), notified.constEnd(), save);
+            if (it != notified.constEnd()) {
+                delays.append(*it - save);
+            }
+        }
+    }
+    qInfo().noquote() << QString::fromLatin1("notifications: %1 saves, %2 delays, p50 %3 us, p99 %4 us")
+        .arg(saves.count()).arg(delays.count())
+        .arg(percentile(delays, 50)).arg(percentile(delays, 99));
+
+    QCOMPARE(totalErrors, 0);
+    if (!saves.isEmpty()) {
+        for (const QList<qint64> &notified : notifications) {
+            QVERIFY(!notified.isEmpty());
+        }
+    }
+
+    qDeleteAll(processes);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    if (argc > 1 && QByteArray(argv[1]) == "--worker") {
+        // Workers should not flood the system alarm service.
+        RecordingAlarmBackend alarms;
+        AlarmBackend::setInstance(&alarms);
+        Worker worker(app.arguments());
+        const int result = worker.run();
+        AlarmBackend::setInstance(nullptr);
+        return result;
+    }
+
+    tst_contention test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_contention.moc"
@@ -43,6 +43,7 @@ private slots:
     void testRange();
     void testRange_data();
     void testSearch();
+    void testEviction();
 
 private:
     ExtendedStorage::Ptr mStorage;
@@ -437,5 +438,61 @@ void tst_load::testSearch()
     QVERIFY(mStorage->save(ExtendedStorage::PurgeDeleted));
 }
 
+void tst_load::testEviction()
+{
+    const QDate jan(1990, 1, 15);
+    const QDate mar(1990, 3, 15);
+    const QDate may(1990, 5, 15);
+
+    KCalendarCore::Event::Ptr event1(new KCalendarCore::Event);
+    event1->setDtStart(QDateTime(jan, QTime(10, 0), QDATETIME_CTOR_UTC_TZ));
+    QVERIFY(mStorage->calendar()->addEvent(event1));
+    KCalendarCore::Event::Ptr event2(new KCalendarCore::Event);
+    event2->setDtStart(QDateTime(mar, QTime(10, 0), QDATETIME_CTOR_UTC_TZ));
+    QVERIFY(mStorage->calendar()->addEvent(event2));
+    KCalendarCore::Event::Ptr event3(new KCalendarCore::Event);
+    event3->setDtStart(QDateTime(may, QTime(10, 0), QDATETIME_CTOR_UTC_TZ));
+    QVERIFY(mStorage->calendar()->addEvent(event3));
+    QVERIFY(mStorage->save());
+
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::utc()));
+    ExtendedStorage::Ptr storage = ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+
+    QVERIFY(storage->load(jan));
+    QVERIFY(calendar->incidence(event1->uid()));
+    storage->setIncidenceBudget(calendar->rawIncidences().count() + 1);
+    QCOMPARE(storage->incidenceBudget(), calendar->rawIncidences().count() + 1);
+
+    QVERIFY(storage->load(mar));
+    QVERIFY(calendar->incidence(event1->uid()));
+    QVERIFY(calendar->incidence(event2->uid()));
+
+    // Loading may exceed the budget, the least recently used range is evicted.
+    QVERIFY(storage->load(may));
+    QVERIFY(!calendar->incidence(event1->uid()));
+    QVERIFY(calendar->incidence(event2->uid()));
+    QVERIFY(calendar->incidence(event3->uid()));
+
+    // Incidences with local changes are never evicted, so the
+    // next least recently used range is evicted as well, while
+    // the range with local changes stays loaded.
+    calendar->incidence(event2->uid())->setSummary(QString::fromLatin1("modified"));
+    QVERIFY(storage->load(jan));
+    QVERIFY(calendar->incidence(event1->uid()));
+    QVERIFY(calendar->incidence(event2->uid()));
+    QVERIFY(!calendar->incidence(event3->uid()));
+
+    QDateTime start, end;
+    QVERIFY(!storage->getLoadDates(mar, mar.addDays(1), &start, &end));
+    QVERIFY(storage->getLoadDates(may, may.addDays(1), &start, &end));
+    QVERIFY(!storage->getLoadDates(jan, jan.addDays(1), &start, &end));
+
+    QVERIFY(mStorage->calendar()->deleteIncidence(event3));
+    QVERIFY(mStorage->calendar()->deleteIncidence(event2));
+    QVERIFY(mStorage->calendar()->deleteIncidence(event1));
+    QVERIFY(mStorage->save(ExtendedStorage::PurgeDeleted));
+}
+
 #include "tst_load.moc"
 QTEST_MAIN(tst_load)
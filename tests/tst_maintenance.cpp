@@ -0,0 +1,188 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QTest>
+#include <QTemporaryDir>
+
+#include <KCalendarCore/Event>
+
+#include <sqlite3.h>
+
+#include "extendedcalendar.h"
+#include "sqlitestorage.h"
+#include "maintenance.h"
+
+using namespace mKCal;
+using namespace KCalendarCore;
+
+class tst_maintenance: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testVacuum();
+    void testVacuumFull();
+    void testAnalyze();
+    void testIntegrityCheck();
+    void testStats();
+
+private:
+    int pragma(const QString &path, const char *name);
+
+    QTemporaryDir mDir;
+    QString mPath;
+};
+
+void tst_maintenance::initTestCase()
+{
+    qputenv("MKCAL_MAINTENANCE_PAUSE_MS", "0");
+    QVERIFY(mDir.isValid());
+    mPath = mDir.filePath(QString::fromLatin1("maintenance.db"));
+
+    // Leave free pages behind, with incidences added then purged.
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::utc()));
+    SqliteStorage::Ptr storage(new SqliteStorage(calendar, mPath));
+    QVERIFY(storage->open());
+    Notebook::Ptr notebook = storage->createDefaultNotebook(QString::fromLatin1("Maintained"));
+    QVERIFY(notebook);
+    Incidence::List list;
+    for (int i = 0; i < 200; i++) {
+        Event::Ptr event(new Event);
+        event->setDtStart(QDateTime(QDate(2023, 1, 1).addDays(i), QTime(10, 0), QTimeZone::utc()));
+        event->setSummary(QString::fromLatin1("Event %1").arg(i));
+        event->setDescription(QString(2000, QLatin1Char('x')));
+        QVERIFY(calendar->addEvent(event, notebook->uid()));
+        list.append(event);
+    }
+    QVERIFY(storage->save());
+    for (int i = 0; i < list.count() - 1; i++) {
+        QVERIFY(calendar->deleteIncidence(list[i]));
+    }
+    QVERIFY(storage->save(ExtendedStorage::PurgeDeleted));
+    storage->close();
+}
+
+int tst_maintenance::pragma(const QString &path, const char *name)
+{
+    sqlite3 *database = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    int value = -1;
+    if (sqlite3_open_v2(path.toUtf8().constData(), &database,
+                        SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK
+        && sqlite3_prepare_v2(database, QByteArray("PRAGMA ") + name, -1,
+                              &stmt, nullptr) == SQLITE_OK
+        && sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(database);
+    return value;
+}
+
+void tst_maintenance::testVacuum()
+{
+    // New databases are created in incremental auto vacuum mode.
+    QCOMPARE(pragma(mPath, "auto_vacuum"), 2);
+    QVERIFY(pragma(mPath, "freelist_count") > 8);
+
+    Maintenance maintenance(mPath);
+    QVERIFY(maintenance.open());
+    QString output;
+    QTextStream out(&output);
+    QVERIFY(maintenance.vacuum(out, 8));
+    out.flush();
+    QVERIFY(output.contains(QString::fromLatin1("free pages left: 0")));
+    QCOMPARE(pragma(mPath, "freelist_count"), 0);
+
+    // Nothing left to release is not an error.
+    output.clear();
+    QVERIFY(maintenance.vacuum(out, 8));
+}
+
+void tst_maintenance::testVacuumFull()
+{
+    const QString path = mDir.filePath(QString::fromLatin1("legacy.db"));
+    sqlite3 *database = nullptr;
+    QCOMPARE(sqlite3_open(path.toUtf8().constData(), &database), SQLITE_OK);
+    QCOMPARE(sqlite3_exec(database, "CREATE TABLE Legacy (Data BLOB);"
+                          "WITH RECURSIVE Counter(i) AS "
+                          "(SELECT 1 UNION ALL SELECT i + 1 FROM Counter WHERE i < 100) "
+                          "INSERT INTO Legacy SELECT randomblob(2000) FROM Counter;"
+                          "DELETE FROM Legacy;", nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(database);
+    QCOMPARE(pragma(path, "auto_vacuum"), 0);
+    const int free = pragma(path, "freelist_count");
+    QVERIFY(free > 0);
+
+    Maintenance maintenance(path);
+    QVERIFY(maintenance.open());
+    QString output;
+    QTextStream out(&output);
+    // The full vacuum locks the database for long, it must be asked for.
+    QVERIFY(!maintenance.vacuum(out, 8));
+    QCOMPARE(pragma(path, "auto_vacuum"), 0);
+    QCOMPARE(pragma(path, "freelist_count"), free);
+
+    QVERIFY(maintenance.vacuum(out, 8, true));
+    QCOMPARE(pragma(path, "auto_vacuum"), 2);
+    QCOMPARE(pragma(path, "freelist_count"), 0);
+}
+
+void tst_maintenance::testAnalyze()
+{
+    Maintenance maintenance(mPath);
+    QVERIFY(maintenance.open());
+    QString output;
+    QTextStream out(&output);
+    QVERIFY(maintenance.analyze(out));
+    out.flush();
+    QVERIFY(output.contains(QString::fromLatin1("Components: analyzed")));
+    QVERIFY(!output.contains(QString::fromLatin1("failed")));
+}
+
+void tst_maintenance::testIntegrityCheck()
+{
+    Maintenance maintenance(mPath);
+    QVERIFY(maintenance.open());
+    QString output;
+    QTextStream out(&output);
+    QVERIFY(maintenance.integrityCheck(out));
+    out.flush();
+    QVERIFY(output.contains(QString::fromLatin1("ok")));
+}
+
+void tst_maintenance::testStats()
+{
+    Maintenance maintenance(mPath);
+    QVERIFY(maintenance.open());
+    QString output;
+    QTextStream out(&output);
+    QVERIFY(maintenance.stats(out));
+    out.flush();
+    QVERIFY(output.contains(QString::fromLatin1("tables:")));
+    QVERIFY(output.contains(QString::fromLatin1("Components: 1 rows")));
+    QVERIFY(output.contains(QString::fromLatin1("Maintained")));
+    QVERIFY(output.contains(QString::fromLatin1("1 incidences")));
+}
+
+#include "tst_maintenance.moc"
+QTEST_GUILESS_MAIN(tst_maintenance)
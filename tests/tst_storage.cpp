@@ -22,11 +22,14 @@
 #include <QDebug>
 #include <QTimeZone>
 #include <QSignalSpy>
+#include <QRegularExpression>
+#include <QTemporaryDir>
 
 #include <KCalendarCore/ICalFormat>
 #include <KCalendarCore/OccurrenceIterator>
 
 #include <sqlite3.h>
+#include <unistd.h>
 
 #include "dummystorage.h" // Not used, but tests API compilation
 
@@ -34,6 +37,8 @@
 #include "tst_storage.h"
 #include "sqlitestorage.h"
 #include "sqliteformat.h"
+#include "alarmbackend_p.h"
+#include "semaphore_p.h"
 
 #ifdef TIMED_SUPPORT
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
@@ -1767,6 +1772,7 @@ void tst_storage::tst_alarms()
     QVERIFY(m_storage->save());
 
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     QMap<QString, QVariant> map;
     map["APPLICATION"] = "libextendedkcal";
     map["notebook"] = uid;
@@ -1782,6 +1788,7 @@ void tst_storage::tst_alarms()
     QVERIFY(m_storage->save());
 
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     reply = timed.query_sync(map);
     QVERIFY(reply.isValid());
     QCOMPARE(reply.value().size(), 0);
@@ -1796,6 +1803,7 @@ void tst_storage::tst_alarms()
     QVERIFY(m_calendar->addEvent(ev, uid));
     QVERIFY(m_storage->save());
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     reply = timed.query_sync(map);
     QVERIFY(reply.isValid());
     QCOMPARE(reply.value().size(), 0);
@@ -1809,6 +1817,7 @@ void tst_storage::tst_alarms()
     notebook->setIsVisible(true);
     QVERIFY(m_storage->updateNotebook(notebook));
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     reply = timed.query_sync(map);
     QVERIFY(reply.isValid());
     QCOMPARE(reply.value().size(), 1);
@@ -1818,6 +1827,7 @@ void tst_storage::tst_alarms()
     notebook->setIsVisible(false);
     QVERIFY(m_storage->updateNotebook(notebook));
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     reply = timed.query_sync(map);
     QVERIFY(reply.isValid());
     QCOMPARE(reply.value().size(), 0);
@@ -1827,6 +1837,7 @@ void tst_storage::tst_alarms()
 void tst_storage::checkAlarms(const QSet<QDateTime> &alarms, const QString &uid) const
 {
 #if defined(TIMED_SUPPORT)
+    m_storage->flushAlarms();
     QMap<QString, QVariant> map;
     map["APPLICATION"] = "libextendedkcal";
     map["notebook"] = uid;
@@ -1927,6 +1938,120 @@ void tst_storage::tst_recurringAlarms()
     QVERIFY(m_storage->deleteNotebook(m_storage->notebook(uid)));
 }
 
+void tst_storage::tst_alarmIndex()
+{
+    Notebook::Ptr notebook = Notebook::Ptr(new Notebook(QStringLiteral("Notebook for alarm index"), QString()));
+    QVERIFY(m_storage->addNotebook(notebook));
+    const QString uid = notebook->uid();
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    KCalendarCore::Event::Ptr past(new KCalendarCore::Event);
+    past->setDtStart(now.addDays(-2));
+    KCalendarCore::Alarm::Ptr alarm = past->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Past alarm"));
+    alarm->setStartOffset(KCalendarCore::Duration(-600));
+    alarm->setEnabled(true);
+    QVERIFY(m_calendar->addEvent(past, uid));
+
+    KCalendarCore::Event::Ptr future(new KCalendarCore::Event);
+    future->setDtStart(now.addDays(2));
+    alarm = future->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Future alarm"));
+    alarm->setStartOffset(KCalendarCore::Duration(-600));
+    alarm->setEnabled(true);
+    QVERIFY(m_calendar->addEvent(future, uid));
+
+    KCalendarCore::Event::Ptr noAlarm(new KCalendarCore::Event);
+    noAlarm->setDtStart(now.addDays(2));
+    QVERIFY(m_calendar->addEvent(noAlarm, uid));
+
+    KCalendarCore::Event::Ptr recurring(new KCalendarCore::Event);
+    recurring->setDtStart(now.addDays(-30));
+    recurring->recurrence()->setDaily(1);
+    alarm = recurring->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Recurring alarm"));
+    alarm->setStartOffset(KCalendarCore::Duration(-600));
+    alarm->setEnabled(true);
+    QVERIFY(m_calendar->addEvent(recurring, uid));
+    KCalendarCore::Incidence::Ptr exception = m_calendar->createException(recurring, recurring->dtStart().addDays(1));
+    exception->clearAlarms();
+    QVERIFY(m_calendar->addIncidence(exception, uid));
+
+    KCalendarCore::Event::Ptr ended(new KCalendarCore::Event);
+    ended->setDtStart(now.addDays(-30));
+    ended->recurrence()->setDaily(1);
+    ended->recurrence()->setDuration(5);
+    alarm = ended->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Ended alarm"));
+    alarm->setStartOffset(KCalendarCore::Duration(-600));
+    alarm->setEnabled(true);
+    QVERIFY(m_calendar->addEvent(ended, uid));
+    QVERIFY(m_storage->save());
+
+    KCalendarCore::Incidence::List list;
+    QVERIFY(m_storage->alarmIncidences(&list, uid, now));
+    QSet<QString> identifiers;
+    for (const KCalendarCore::Incidence::Ptr &incidence : list) {
+        identifiers.insert(incidence->instanceIdentifier());
+    }
+    QCOMPARE(identifiers, QSet<QString>() << future->instanceIdentifier()
+             << recurring->instanceIdentifier() << exception->instanceIdentifier());
+
+    future->alarms().first()->setEnabled(false);
+    future->setRevision(future->revision() + 1);
+    QVERIFY(m_calendar->deleteIncidence(recurring));
+    QVERIFY(m_storage->save());
+
+    list.clear();
+    QVERIFY(m_storage->alarmIncidences(&list, uid, now));
+    QVERIFY(list.isEmpty());
+
+    QVERIFY(m_storage->deleteNotebook(m_storage->notebook(uid)));
+}
+
+void tst_storage::tst_alarmsCoalesced()
+{
+    RecordingAlarmBackend backend;
+    AlarmBackend::setInstance(&backend);
+
+    Notebook::Ptr notebook = Notebook::Ptr(new Notebook(QStringLiteral("Notebook for coalesced alarms"), QString()));
+    QVERIFY(m_storage->addNotebook(notebook));
+    const QString uid = notebook->uid();
+
+    const QDateTime dt = QDateTime::currentDateTime().addDays(1);
+    KCalendarCore::Event::List events;
+    for (int i = 0; i < 3; i++) {
+        KCalendarCore::Event::Ptr ev(new KCalendarCore::Event);
+        ev->setDtStart(dt.addSecs(3600 * i));
+        KCalendarCore::Alarm::Ptr alarm = ev->newAlarm();
+        alarm->setDisplayAlarm(QLatin1String("Coalesced alarm"));
+        alarm->setStartOffset(KCalendarCore::Duration(-600));
+        alarm->setEnabled(true);
+        QVERIFY(m_calendar->addEvent(ev, uid));
+        QVERIFY(m_storage->save());
+        events.append(ev);
+    }
+    // Alarms are scheduled at once, later, from the event loop.
+    QCOMPARE(backend.addCount(), 0);
+    QTRY_COMPARE(backend.addCount(), 1);
+    QCOMPARE(backend.events().count(), 3);
+
+    events[0]->setSummary(QLatin1String("Modified"));
+    QVERIFY(m_storage->save());
+    QVERIFY(m_calendar->deleteIncidence(events[1]));
+    QVERIFY(m_storage->save());
+    m_storage->flushAlarms();
+    QCOMPARE(backend.addCount(), 2);
+    QCOMPARE(backend.cancelCount(), 1);
+    QCOMPARE(backend.events().count(), 2);
+
+    QVERIFY(m_storage->deleteNotebook(m_storage->notebook(uid)));
+    m_storage->flushAlarms();
+    QVERIFY(backend.events().isEmpty());
+
+    AlarmBackend::setInstance(nullptr);
+}
+
 void tst_storage::tst_url_data()
 {
     QTest::addColumn<QUrl>("url");
@@ -2145,6 +2270,349 @@ void tst_storage::tst_attendees()
     QCOMPARE(refetched->attendees(), fetched->attendees());
 }
 
+void tst_storage::tst_metrics()
+{
+    QVERIFY(!m_storage->metricsEnabled());
+    QCOMPARE(m_storage->metrics().count(StorageMetrics::Save), quint64(0));
+
+    m_storage->setMetricsEnabled(true);
+    QVERIFY(m_storage->metricsEnabled());
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setDtStart(QDateTime(QDate(2023, 3, 12), QTime(10, 0)));
+    event->setSummary(QStringLiteral("Metrics"));
+    KCalendarCore::Alarm::Ptr alarm = event->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Metrics alarm"));
+    alarm->setEnabled(true);
+    QVERIFY(m_calendar->addEvent(event, NotebookId));
+    QVERIFY(m_storage->save());
+
+    StorageMetrics metrics = m_storage->metrics();
+    QCOMPARE(metrics.count(StorageMetrics::Save), quint64(1));
+    QCOMPARE(metrics.count(StorageMetrics::SaveInsert), quint64(1));
+    QCOMPARE(metrics.count(StorageMetrics::SaveUpdate), quint64(0));
+    QVERIFY(metrics.counter(StorageMetrics::ChildStatements) > 0);
+    QVERIFY(metrics.count(StorageMetrics::LockWait) > 0);
+    QCOMPARE(metrics.count(StorageMetrics::LockHold), metrics.count(StorageMetrics::LockWait));
+
+    m_storage->resetMetrics();
+    QCOMPARE(m_storage->metrics().count(StorageMetrics::Save), quint64(0));
+
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    ExtendedStorage::Ptr storage = calendar->defaultStorage(calendar);
+    storage->setMetricsEnabled(true);
+    QVERIFY(storage->open());
+    QVERIFY(storage->load(event->uid()));
+    QVERIFY(calendar->incidence(event->uid()));
+
+    metrics = storage->metrics();
+    QCOMPARE(metrics.count(StorageMetrics::Open), quint64(1));
+    QCOMPARE(metrics.count(StorageMetrics::LoadUid), quint64(1));
+    QCOMPARE(metrics.counter(StorageMetrics::IncidencesDecoded), quint64(1));
+    QVERIFY(metrics.counter(StorageMetrics::RowsStepped) >= 1);
+    QVERIFY(metrics.counter(StorageMetrics::StatementsPrepared) > 0);
+    QVERIFY(metrics.percentile(StorageMetrics::Open, 100)
+            >= metrics.percentile(StorageMetrics::Open, 50));
+    QVERIFY(!metrics.toString().isEmpty());
+
+    storage->setMetricsEnabled(false);
+    QVERIFY(!storage->metricsEnabled());
+    QCOMPARE(storage->metrics().counter(StorageMetrics::IncidencesDecoded), quint64(0));
+
+    m_storage->setMetricsEnabled(false);
+    QVERIFY(m_calendar->deleteIncidence(event));
+    QVERIFY(m_storage->save());
+}
+
+void tst_storage::tst_queryTrace()
+{
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setDtStart(QDateTime(QDate(2023, 3, 12), QTime(10, 0)));
+    event->setSummary(QStringLiteral("Traced"));
+    QVERIFY(m_calendar->addEvent(event, NotebookId));
+    QVERIFY(m_storage->save());
+
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    SqliteStorage::Ptr storage(new SqliteStorage(calendar, m_storage.staticCast<SqliteStorage>()->databaseName()));
+    QCOMPARE(storage->slowQueryThreshold(), -1);
+    QVERIFY(!storage->explainQueries());
+    QVERIFY(storage->open());
+
+    storage->setSlowQueryThreshold(0);
+    QTest::ignoreMessage(QtWarningMsg,
+                         QRegularExpression(QStringLiteral("^slow query, \\d+ us: select \\* from Components where UID='%1'")
+                                            .arg(event->uid())));
+    QVERIFY(storage->load(event->uid()));
+    QVERIFY(calendar->incidence(event->uid()));
+    storage->setSlowQueryThreshold(-1);
+
+    storage->setExplainQueries(true);
+    QTest::ignoreMessage(QtWarningMsg,
+                         QRegularExpression(QStringLiteral("^full scan of Components,.* in: select \\* from Components where DateDeleted=0$")));
+    QVERIFY(storage->load());
+    storage->setExplainQueries(false);
+
+    QVERIFY(m_calendar->deleteIncidence(event));
+    QVERIFY(m_storage->save());
+}
+
+void tst_storage::tst_lockStatus()
+{
+    const QString databaseName = m_storage.staticCast<SqliteStorage>()->databaseName();
+
+    ProcessMutex::Status status = ProcessMutex::status(databaseName);
+    QVERIFY(status.valid);
+    QVERIFY(status.connections > 0);
+    QVERIFY(!status.locked);
+    QCOMPARE(status.waiters, 0);
+
+    ProcessMutex mutex(databaseName);
+    QVERIFY(mutex.acquire());
+    status = ProcessMutex::status(databaseName);
+    QVERIFY(status.locked);
+    QCOMPARE(status.holder, qint64(::getpid()));
+    QVERIFY(status.heldUs >= 0);
+    QVERIFY(status.operation.isEmpty());
+    QVERIFY(mutex.release());
+
+    QVERIFY(!ProcessMutex::status(databaseName).locked);
+}
+
+void tst_storage::tst_memoryUsage()
+{
+    const MemoryUsage empty = m_storage.staticCast<SqliteStorage>()->memoryUsage();
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setDtStart(QDateTime(QDate(2023, 3, 14), QTime(10, 0)));
+    event->setSummary(QStringLiteral("Memory usage"));
+    event->setDescription(QStringLiteral("An event with some parts to account for."));
+    event->addAttendee(KCalendarCore::Attendee(QStringLiteral("Alice"),
+                                               QStringLiteral("alice@example.org")));
+    KCalendarCore::Alarm::Ptr alarm = event->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Memory alarm"));
+    alarm->setEnabled(true);
+    event->setNonKDECustomProperty("X-MEMORY", QStringLiteral("usage"));
+    event->recurrence()->setDaily(1);
+    QVERIFY(m_calendar->addEvent(event, NotebookId));
+
+    MemoryUsage usage = m_storage.staticCast<SqliteStorage>()->memoryUsage();
+    QCOMPARE(usage.count(MemoryUsage::Incidences), empty.count(MemoryUsage::Incidences) + 1);
+    QCOMPARE(usage.count(MemoryUsage::Events), empty.count(MemoryUsage::Events) + 1);
+    QCOMPARE(usage.count(MemoryUsage::Attendees), empty.count(MemoryUsage::Attendees) + 1);
+    QCOMPARE(usage.count(MemoryUsage::Alarms), empty.count(MemoryUsage::Alarms) + 1);
+    QVERIFY(usage.count(MemoryUsage::CustomProperties) > empty.count(MemoryUsage::CustomProperties));
+    QCOMPARE(usage.count(MemoryUsage::Recurrences), empty.count(MemoryUsage::Recurrences) + 1);
+    QVERIFY(usage.size(MemoryUsage::StringBytes) > empty.size(MemoryUsage::StringBytes));
+    QVERIFY(usage.notebookUids().contains(QString::fromLatin1(NotebookId)));
+    QCOMPARE(usage.count(QString::fromLatin1(NotebookId)),
+             empty.count(QString::fromLatin1(NotebookId)) + 1);
+    QCOMPARE(usage.count(MemoryUsage::PendingInserts), quint64(1));
+    QVERIFY(usage.bytes(MemoryUsage::Incidences)
+            > usage.size(MemoryUsage::StringBytes) - empty.size(MemoryUsage::StringBytes));
+    QVERIFY(usage.totalBytes() > empty.totalBytes());
+
+    QVERIFY(m_storage->save());
+    usage = m_storage.staticCast<SqliteStorage>()->memoryUsage();
+    QCOMPARE(usage.count(MemoryUsage::PendingInserts), quint64(0));
+    QVERIFY(usage.count(MemoryUsage::Statements) > 0);
+    QVERIFY(usage.bytes(MemoryUsage::Statements) > 0);
+    QVERIFY(usage.size(MemoryUsage::PageCacheBytes) > 0);
+    QVERIFY(!usage.toString().isEmpty());
+}
+
+static int execute(const QString &databaseName, const char *query, const QString &notebookUid)
+{
+    sqlite3 *database = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    const QByteArray id(notebookUid.toUtf8());
+    int result = -1;
+    if (sqlite3_open(databaseName.toUtf8(), &database) == SQLITE_OK
+        && sqlite3_prepare_v2(database, query, -1, &stmt, nullptr) == SQLITE_OK
+        && (id.isEmpty() || sqlite3_bind_text(stmt, 1, id.constData(), id.length(), SQLITE_STATIC) == SQLITE_OK)) {
+        const int rv = sqlite3_step(stmt);
+        result = rv == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : (rv == SQLITE_DONE ? 0 : -1);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(database);
+    return result;
+}
+
+void tst_storage::tst_purgeExpiredTombstones()
+{
+    SqliteStorage::Ptr storage = m_storage.staticCast<SqliteStorage>();
+    Notebook::Ptr notebook(new Notebook(QStringLiteral("Notebook with tombstones"), QString()));
+    QCOMPARE(notebook->tombstoneRetentionDays(), 30);
+    QVERIFY(m_storage->addNotebook(notebook));
+    Notebook::Ptr kept(new Notebook(QStringLiteral("Notebook keeping tombstones"), QString()));
+    kept->setTombstoneRetentionDays(-1);
+    QVERIFY(m_storage->addNotebook(kept));
+
+    KCalendarCore::Incidence::List list;
+    for (int i = 0; i < 4; i++) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setDtStart(QDateTime(QDate(2023, 3, 15), QTime(10 + i, 0)));
+        event->setSummary(QStringLiteral("Tombstone %1").arg(i));
+        event->addAttendee(KCalendarCore::Attendee(QStringLiteral("Alice"),
+                                                   QStringLiteral("alice@example.org")));
+        QVERIFY(m_calendar->addEvent(event, i < 3 ? notebook->uid() : kept->uid()));
+        list.append(event);
+    }
+    QVERIFY(m_storage->save());
+    for (const KCalendarCore::Incidence::Ptr &incidence : list) {
+        QVERIFY(m_calendar->deleteIncidence(incidence));
+    }
+    QVERIFY(m_storage->save());
+
+    // Recent tombstones are kept.
+    QCOMPARE(storage->purgeExpiredTombstones(), 0);
+
+    const char *age = "update Components set DateDeleted=DateDeleted-31*86400 "
+        "where DateDeleted<>0 and Notebook=?";
+    QCOMPARE(execute(storage->databaseName(), age, notebook->uid()), 0);
+    QCOMPARE(execute(storage->databaseName(), age, kept->uid()), 0);
+
+    // Purges are announced to other processes with a new transaction id.
+    const char *transaction = "select transactionId from Metadata where rowid=1";
+    const int transactionId = execute(storage->databaseName(), transaction, QString());
+    QCOMPARE(storage->purgeExpiredTombstones(2), 2);
+    QCOMPARE(execute(storage->databaseName(), transaction, QString()), transactionId + 1);
+    QCOMPARE(storage->purgeExpiredTombstones(2), 1);
+    QCOMPARE(storage->purgeExpiredTombstones(2), 0);
+    QCOMPARE(execute(storage->databaseName(), transaction, QString()), transactionId + 2);
+
+    KCalendarCore::Incidence::List deleted;
+    QVERIFY(m_storage->deletedIncidences(&deleted, QDateTime(), notebook->uid()));
+    QVERIFY(deleted.isEmpty());
+    QVERIFY(m_storage->deletedIncidences(&deleted, QDateTime(), kept->uid()));
+    QCOMPARE(deleted.count(), 1);
+    QCOMPARE(execute(storage->databaseName(), "select count(*) from Attendee "
+                     "where ComponentId not in (select ComponentId from Components)",
+                     QString()), 0);
+
+    QCOMPARE(storage->tombstoneCollectionInterval(), 0);
+    storage->setTombstoneCollectionInterval(1000);
+    QCOMPARE(storage->tombstoneCollectionInterval(), 1000);
+    storage->setTombstoneCollectionInterval(0);
+    QCOMPARE(storage->tombstoneCollectionInterval(), 0);
+
+    QVERIFY(m_storage->deleteNotebook(notebook));
+    QVERIFY(m_storage->deleteNotebook(kept));
+}
+
+void tst_storage::tst_purgeExpiredTombstonesSynced()
+{
+    SqliteStorage::Ptr storage = m_storage.staticCast<SqliteStorage>();
+    Notebook::Ptr synced(new Notebook(QStringLiteral("Synchronized notebook"), QString()));
+    synced->setPluginName(QStringLiteral("caldav"));
+    synced->setAccount(QStringLiteral("42"));
+    synced->setSyncDate(QDateTime::currentDateTimeUtc().addDays(-40));
+    QVERIFY(m_storage->addNotebook(synced));
+
+    KCalendarCore::Incidence::List list;
+    for (int i = 0; i < 2; i++) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setDtStart(QDateTime(QDate(2023, 3, 16), QTime(10 + i, 0)));
+        event->setSummary(QStringLiteral("Synced tombstone %1").arg(i));
+        QVERIFY(m_calendar->addEvent(event, synced->uid()));
+        list.append(event);
+    }
+    QVERIFY(m_storage->save());
+    for (const KCalendarCore::Incidence::Ptr &incidence : list) {
+        QVERIFY(m_calendar->deleteIncidence(incidence));
+    }
+    QVERIFY(m_storage->save());
+
+    // Deleted 35 days ago, after the last synchronization: not synced yet.
+    QCOMPARE(execute(storage->databaseName(),
+                     "update Components set DateDeleted=DateDeleted-35*86400 "
+                     "where DateDeleted<>0 and Notebook=?", synced->uid()), 0);
+    QCOMPARE(storage->purgeExpiredTombstones(), 0);
+
+    // Deleted 75 days ago, more than 30 days before the last synchronization.
+    const QByteArray older = "update Components set DateDeleted=DateDeleted-40*86400 "
+        "where DateDeleted<>0 and Notebook=? and UID='" + list[0]->uid().toUtf8() + "'";
+    QCOMPARE(execute(storage->databaseName(), older.constData(), synced->uid()), 0);
+    QCOMPARE(storage->purgeExpiredTombstones(), 1);
+
+    KCalendarCore::Incidence::List deleted;
+    QVERIFY(m_storage->deletedIncidences(&deleted, QDateTime(), synced->uid()));
+    QCOMPARE(deleted.count(), 1);
+    QCOMPARE(deleted[0]->uid(), list[1]->uid());
+
+    QVERIFY(m_storage->deleteNotebook(synced));
+}
+
+void tst_storage::tst_changesSince()
+{
+    Notebook::Ptr notebook(new Notebook(QStringLiteral("Notebook for changes"), QString()));
+    QVERIFY(m_storage->addNotebook(notebook));
+
+    int start = -1;
+    QVERIFY(m_storage->changesSince(-1, notebook->uid(), nullptr, nullptr, nullptr, &start));
+    QVERIFY(start >= 0);
+
+    KCalendarCore::Event::Ptr first(new KCalendarCore::Event);
+    first->setDtStart(QDateTime(QDate(2023, 3, 16), QTime(10, 0)));
+    first->setSummary(QStringLiteral("First change"));
+    QVERIFY(m_calendar->addEvent(first, notebook->uid()));
+    // Changes in other notebooks are not listed.
+    KCalendarCore::Event::Ptr other(new KCalendarCore::Event);
+    other->setDtStart(QDateTime(QDate(2023, 3, 16), QTime(11, 0)));
+    QVERIFY(m_calendar->addEvent(other, NotebookId));
+    QVERIFY(m_storage->save());
+
+    KCalendarCore::Incidence::List added, modified, deleted;
+    int latest = -1;
+    QVERIFY(m_storage->changesSince(start, notebook->uid(), &added, &modified, &deleted, &latest));
+    QVERIFY(latest > start);
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(added[0]->uid(), first->uid());
+    QVERIFY(modified.isEmpty());
+    QVERIFY(deleted.isEmpty());
+
+    int previous = latest;
+    first->setSummary(QStringLiteral("First change, modified"));
+    KCalendarCore::Event::Ptr second(new KCalendarCore::Event);
+    second->setDtStart(QDateTime(QDate(2023, 3, 16), QTime(12, 0)));
+    QVERIFY(m_calendar->addEvent(second, notebook->uid()));
+    QVERIFY(m_storage->save());
+    added.clear();
+    QVERIFY(m_storage->changesSince(previous, notebook->uid(), &added, &modified, &deleted, &latest));
+    QVERIFY(latest > previous);
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(added[0]->uid(), second->uid());
+    QCOMPARE(modified.count(), 1);
+    QCOMPARE(modified[0]->summary(), first->summary());
+    QVERIFY(deleted.isEmpty());
+
+    previous = latest;
+    QVERIFY(m_calendar->deleteIncidence(first));
+    QVERIFY(m_storage->save());
+    // Created and deleted in between two calls.
+    KCalendarCore::Event::Ptr third(new KCalendarCore::Event);
+    third->setDtStart(QDateTime(QDate(2023, 3, 16), QTime(13, 0)));
+    QVERIFY(m_calendar->addEvent(third, notebook->uid()));
+    QVERIFY(m_storage->save());
+    QVERIFY(m_calendar->deleteIncidence(third));
+    QVERIFY(m_storage->save());
+    added.clear();
+    modified.clear();
+    QVERIFY(m_storage->changesSince(previous, QString(), &added, &modified, &deleted, &latest));
+    QVERIFY(added.isEmpty());
+    QVERIFY(modified.isEmpty());
+    QCOMPARE(deleted.count(), 1);
+    QCOMPARE(deleted[0]->uid(), first->uid());
+
+    deleted.clear();
+    QVERIFY(m_storage->changesSince(latest, QString(), &added, &modified, &deleted, &previous));
+    QCOMPARE(previous, latest);
+    QVERIFY(added.isEmpty() && modified.isEmpty() && deleted.isEmpty());
+
+    QVERIFY(m_calendar->deleteIncidence(m_calendar->incidence(other->uid())));
+    QVERIFY(m_storage->save());
+    QVERIFY(m_storage->deleteNotebook(notebook));
+}
+
 void tst_storage::openDb(bool clear)
 {
     m_calendar = ExtendedCalendar::Ptr(new ExtendedCalendar(QTimeZone::systemTimeZone()));
@@ -2325,6 +2793,551 @@ void tst_storage::tst_storageObserver()
     QVERIFY(updated.isEmpty());
 }
 
+class NotebookStorageObserver: public QObject, public ExtendedStorageObserver2
+{
+    Q_OBJECT
+public:
+    NotebookStorageObserver(ExtendedStorage::Ptr storage, const QStringList &notebookUids)
+        : mStorage(storage)
+    {
+        mStorage->registerObserver(this, notebookUids);
+    }
+    ~NotebookStorageObserver()
+    {
+        mStorage->unregisterObserver(this);
+    }
+
+    void storageNotebooksModified(ExtendedStorage *storage, const QString &info,
+                                  const QStringList &notebookUids)
+    {
+        emit modified(notebookUids);
+    }
+
+signals:
+    void modified(const QStringList &notebookUids);
+
+private:
+    ExtendedStorage::Ptr mStorage;
+};
+
+void tst_storage::tst_notebookObserver()
+{
+    mKCal::Notebook::Ptr watched(new mKCal::Notebook(QString::fromLatin1("watched"),
+                                                     QString()));
+    QVERIFY(m_storage->addNotebook(watched));
+    mKCal::Notebook::Ptr other(new mKCal::Notebook(QString::fromLatin1("other"),
+                                                   QString()));
+    QVERIFY(m_storage->addNotebook(other));
+
+    NotebookStorageObserver observer(m_storage, QStringList() << watched->uid());
+    QSignalSpy modified(&observer, &NotebookStorageObserver::modified);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+
+    // Modifications in other notebooks are not notified.
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setDtStart(QDateTime(QDate(2023, 5, 11), QTime(10, 0)));
+    QVERIFY(calendar->addEvent(event, other->uid()));
+    QVERIFY(storage->save());
+    QVERIFY(!modified.wait(500));
+
+    Notebook::Ptr external = storage->notebook(other->uid());
+    QVERIFY(external);
+    external->setName(QString::fromLatin1("renamed"));
+    QVERIFY(storage->updateNotebook(external));
+    QVERIFY(!modified.wait(500));
+    // But the notebook properties are refreshed.
+    QVERIFY(m_storage->notebook(other->uid()));
+    QCOMPARE(m_storage->notebook(other->uid())->name(), QString::fromLatin1("renamed"));
+
+    // Modifications in the watched notebook are notified.
+    KCalendarCore::Event::Ptr event2(new KCalendarCore::Event);
+    event2->setDtStart(QDateTime(QDate(2023, 5, 12), QTime(10, 0)));
+    QVERIFY(calendar->addEvent(event2, watched->uid()));
+    QVERIFY(storage->save());
+    QVERIFY(modified.wait());
+    QCOMPARE(modified.count(), 1);
+    QCOMPARE(modified.takeFirst()[0].toStringList(), QStringList() << watched->uid());
+
+    // Notebook properties are modifications of the notebook.
+    external = storage->notebook(watched->uid());
+    QVERIFY(external);
+    external->setName(QString::fromLatin1("renamed watched"));
+    QVERIFY(storage->updateNotebook(external));
+    QVERIFY(modified.wait());
+    QCOMPARE(modified.takeFirst()[0].toStringList(), QStringList() << watched->uid());
+
+    QVERIFY(storage->deleteNotebook(storage->notebook(other->uid())));
+    QVERIFY(m_storage->deleteNotebook(m_storage->notebook(watched->uid())));
+}
+
+class ChangeStorageObserver: public QObject, public ExtendedStorageObserver2
+{
+    Q_OBJECT
+public:
+    ChangeStorageObserver(ExtendedStorage::Ptr storage): mStorage(storage)
+    {
+        mStorage->registerObserver(this);
+    }
+    ~ChangeStorageObserver()
+    {
+        mStorage->unregisterObserver(this);
+    }
+
+    void storageModified(ExtendedStorage *storage, const QString &info)
+    {
+        emit modified();
+    }
+
+    void storageChanged(ExtendedStorage *storage, const QString &info,
+                        const StorageChange::List &changes)
+    {
+        mChanges = changes;
+        emit changed();
+    }
+
+    StorageChange::List mChanges;
+
+signals:
+    void modified();
+    void changed();
+
+private:
+    ExtendedStorage::Ptr mStorage;
+};
+
+void tst_storage::tst_storageChanges()
+{
+    m_storage->load(QDate(2023, 6, 1), QDate(2023, 7, 1));
+    ChangeStorageObserver observer(m_storage);
+    QSignalSpy changed(&observer, &ChangeStorageObserver::changed);
+    QSignalSpy modified(&observer, &ChangeStorageObserver::modified);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QString::fromLatin1("added externally"));
+    event->setDtStart(QDateTime(QDate(2023, 6, 12), QTime(10, 0)));
+    QVERIFY(calendar->addEvent(event, storage->defaultNotebook()->uid()));
+    QVERIFY(storage->save());
+    QVERIFY(changed.wait());
+    QVERIFY(modified.isEmpty());
+    QCOMPARE(observer.mChanges.count(), 1);
+    QCOMPARE(observer.mChanges[0].notebookUid, storage->defaultNotebook()->uid());
+    QCOMPARE(observer.mChanges[0].instanceIdentifier, event->instanceIdentifier());
+    QCOMPARE(observer.mChanges[0].operation, StorageChange::Added);
+    // The calendar is updated in place.
+    QVERIFY(m_calendar->incidence(event->uid()));
+    QCOMPARE(m_calendar->incidence(event->uid())->summary(), event->summary());
+
+    event->setSummary(QString::fromLatin1("modified externally"));
+    QVERIFY(storage->save());
+    QVERIFY(changed.wait());
+    QCOMPARE(observer.mChanges.count(), 1);
+    QCOMPARE(observer.mChanges[0].operation, StorageChange::Modified);
+    QVERIFY(m_calendar->incidence(event->uid()));
+    QCOMPARE(m_calendar->incidence(event->uid())->summary(), event->summary());
+
+    QVERIFY(calendar->deleteIncidence(event));
+    QVERIFY(storage->save());
+    QVERIFY(changed.wait());
+    QCOMPARE(observer.mChanges.count(), 1);
+    QCOMPARE(observer.mChanges[0].operation, StorageChange::Deleted);
+    QVERIFY(!m_calendar->incidence(event->uid()));
+    QVERIFY(modified.isEmpty());
+
+    // Deleting a notebook resets the calendar.
+    mKCal::Notebook::Ptr notebook(new mKCal::Notebook(QString::fromLatin1("changes"),
+                                                      QString()));
+    QVERIFY(storage->addNotebook(notebook));
+    QVERIFY(changed.wait());
+    QCOMPARE(observer.mChanges.count(), 1);
+    QCOMPARE(observer.mChanges[0].notebookUid, notebook->uid());
+    QVERIFY(observer.mChanges[0].instanceIdentifier.isEmpty());
+    QCOMPARE(observer.mChanges[0].operation, StorageChange::Added);
+    QVERIFY(m_storage->notebook(notebook->uid()));
+    QVERIFY(storage->deleteNotebook(notebook));
+    QVERIFY(modified.wait());
+    QVERIFY(!m_storage->notebook(notebook->uid()));
+}
+
+void tst_storage::tst_storageChangesNotebookLoaded()
+{
+    mKCal::Notebook::Ptr notebook(new mKCal::Notebook(QString::fromLatin1("loaded notebook"),
+                                                      QString()));
+    QVERIFY(m_storage->addNotebook(notebook));
+
+    // Only loaded by notebook, there is no loaded range.
+    mKCal::ExtendedCalendar::Ptr loaded(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr loadedStorage = mKCal::ExtendedCalendar::defaultStorage(loaded);
+    QVERIFY(loadedStorage->open());
+    QVERIFY(loadedStorage->loadNotebookIncidences(notebook->uid()));
+    ChangeStorageObserver observer(loadedStorage);
+    QSignalSpy changed(&observer, &ChangeStorageObserver::changed);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::ExtendedStorage::Ptr storage = mKCal::ExtendedCalendar::defaultStorage(calendar);
+    QVERIFY(storage->open());
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QString::fromLatin1("added to a loaded notebook"));
+    event->setDtStart(QDateTime(QDate(2031, 2, 3), QTime(10, 0)));
+    QVERIFY(calendar->addEvent(event, notebook->uid()));
+    QVERIFY(storage->save());
+    QVERIFY(changed.wait());
+    QCOMPARE(observer.mChanges.count(), 1);
+    QCOMPARE(observer.mChanges[0].operation, StorageChange::Added);
+    // The addition is loaded, as the rest of the notebook.
+    QVERIFY(loaded->incidence(event->uid()));
+    QCOMPARE(loaded->notebook(event->uid()), notebook->uid());
+
+    QVERIFY(m_storage->deleteNotebook(m_storage->notebook(notebook->uid())));
+}
+
+void tst_storage::tst_batchNotifications()
+{
+    TestStorageObserver observer(m_storage);
+    QSignalSpy modified(&observer, &TestStorageObserver::modified);
+
+    mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    SqliteStorage::Ptr storage(new SqliteStorage(calendar, m_storage.staticCast<SqliteStorage>()->databaseName()));
+    QVERIFY(storage->open());
+
+    // Saves within a batch are notified once, at the end.
+    storage->beginBatch();
+    for (int i = 0; i < 3; i++) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setDtStart(QDateTime(QDate(2023, 7, 3 + i), QTime(9, 0)));
+        QVERIFY(calendar->addEvent(event, storage->defaultNotebook()->uid()));
+        QVERIFY(storage->save());
+    }
+    QVERIFY(!modified.wait(300));
+    storage->endBatch();
+    QVERIFY(modified.wait());
+    QVERIFY(!modified.wait(300));
+    QCOMPARE(modified.count(), 1);
+    modified.clear();
+
+    // Saves within the notification delay are notified once.
+    storage->setNotificationDelay(200);
+    QCOMPARE(storage->notificationDelay(), 200);
+    for (int i = 0; i < 3; i++) {
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setDtStart(QDateTime(QDate(2023, 7, 10 + i), QTime(9, 0)));
+        QVERIFY(calendar->addEvent(event, storage->defaultNotebook()->uid()));
+        QVERIFY(storage->save());
+    }
+    QVERIFY(modified.wait());
+    QVERIFY(!modified.wait(400));
+    QCOMPARE(modified.count(), 1);
+    storage->setNotificationDelay(0);
+}
+
+void tst_storage::tst_writeBehind()
+{
+    SqliteStorage::Ptr storage = m_storage.staticCast<SqliteStorage>();
+    TestStorageObserver observer(m_storage);
+    QSignalSpy updated(&observer, &TestStorageObserver::updated);
+
+    storage->setWriteBehind(true);
+    QVERIFY(storage->writeBehind());
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QString::fromLatin1("saved in the background"));
+    event->setDtStart(QDateTime(QDate(2023, 8, 7), QTime(14, 0)));
+    QVERIFY(m_calendar->addEvent(event, NotebookId));
+    QVERIFY(storage->save());
+    // Notifications are delivered from the event loop, or by flush().
+    QVERIFY(updated.isEmpty());
+    QVERIFY(storage->flush());
+    QCOMPARE(updated.count(), 1);
+    QCOMPARE(updated.takeFirst()[0].value<KCalendarCore::Incidence::List>().count(), 1);
+
+    // Modifying the incidence while it is saved has no effect on the save.
+    event->setSummary(QString::fromLatin1("modified in the background"));
+    QVERIFY(storage->save());
+    event->setSummary(QString::fromLatin1("modified after save"));
+    // Reads see the saved modifications, without being notified.
+    KCalendarCore::Incidence::List list;
+    QVERIFY(storage->allIncidences(&list, NotebookId));
+    bool found = false;
+    for (const KCalendarCore::Incidence::Ptr &incidence : list) {
+        if (incidence->uid() == event->uid()) {
+            QCOMPARE(incidence->summary(), QString::fromLatin1("modified in the background"));
+            found = true;
+        }
+    }
+    QVERIFY(found);
+    QVERIFY(updated.isEmpty());
+    QVERIFY(updated.wait());
+    QCOMPARE(updated.count(), 1);
+    updated.clear();
+
+    QVERIFY(m_calendar->deleteIncidence(event));
+    QVERIFY(storage->save());
+    QVERIFY(updated.wait());
+    QCOMPARE(updated.takeFirst()[2].value<KCalendarCore::Incidence::List>().count(), 1);
+
+    storage->setWriteBehind(false);
+    QVERIFY(!storage->writeBehind());
+
+    reloadDb();
+    QVERIFY(m_storage->load(event->uid()));
+    QVERIFY(!m_calendar->incidence(event->uid()));
+}
+
+void tst_storage::tst_updateChangedColumns()
+{
+    KCalendarCore::Todo::Ptr todo(new KCalendarCore::Todo);
+    todo->setSummary(QString::fromLatin1("partially updated"));
+    todo->setDescription(QString::fromLatin1("a long description").repeated(100));
+    todo->setDtStart(QDateTime(QDate(2023, 8, 14), QTime(9, 0)));
+    QVERIFY(m_calendar->addTodo(todo, NotebookId));
+    QVERIFY(m_storage->save());
+
+    // The stored values are known from the load.
+    const QString uid = todo->uid();
+    reloadDb();
+    QVERIFY(m_storage->load(uid));
+    todo = m_calendar->todo(uid);
+    QVERIFY(todo);
+    SqliteStorage::Ptr storage = m_storage.staticCast<SqliteStorage>();
+
+    // Record the columns actually written on update.
+    const char *count = "select count(*) from ColumnWrites where Name=?";
+    QCOMPARE(execute(storage->databaseName(), "create table ColumnWrites(Name TEXT)", QString()), 0);
+    QCOMPARE(execute(storage->databaseName(),
+                     "create trigger DescriptionWritten after update of Description on Components "
+                     "begin insert into ColumnWrites values ('Description'); end", QString()), 0);
+    QCOMPARE(execute(storage->databaseName(),
+                     "create trigger StatusWritten after update of Status on Components "
+                     "begin insert into ColumnWrites values ('Status'); end", QString()), 0);
+
+    todo->setCompleted(true);
+    QVERIFY(m_storage->save());
+    QCOMPARE(execute(storage->databaseName(), count, QString::fromLatin1("Status")), 1);
+    QCOMPARE(execute(storage->databaseName(), count, QString::fromLatin1("Description")), 0);
+
+    // And from the previous save.
+    todo->setDescription(QString::fromLatin1("a short description"));
+    QVERIFY(m_storage->save());
+    QCOMPARE(execute(storage->databaseName(), count, QString::fromLatin1("Status")), 1);
+    QCOMPARE(execute(storage->databaseName(), count, QString::fromLatin1("Description")), 1);
+
+    QCOMPARE(execute(storage->databaseName(), "drop trigger DescriptionWritten", QString()), 0);
+    QCOMPARE(execute(storage->databaseName(), "drop trigger StatusWritten", QString()), 0);
+    QCOMPARE(execute(storage->databaseName(), "drop table ColumnWrites", QString()), 0);
+
+    reloadDb();
+    QVERIFY(m_storage->load(uid));
+    KCalendarCore::Todo::Ptr fetched = m_calendar->todo(uid);
+    QVERIFY(fetched);
+    QVERIFY(fetched->isCompleted());
+    QCOMPARE(fetched->summary(), QString::fromLatin1("partially updated"));
+    QCOMPARE(fetched->description(), QString::fromLatin1("a short description"));
+    QCOMPARE(fetched->dtStart(), QDateTime(QDate(2023, 8, 14), QTime(9, 0)));
+}
+
+void tst_storage::tst_upsertIncidences()
+{
+    SqliteStorage::Ptr storage = m_storage.staticCast<SqliteStorage>();
+
+    KCalendarCore::Event::Ptr stored(new KCalendarCore::Event);
+    stored->setSummary(QString::fromLatin1("stored"));
+    stored->setDtStart(QDateTime(QDate(2023, 8, 21), QTime(10, 0)));
+    const QDateTime created(QDate(2023, 8, 1), QTime(8, 0), Qt::UTC);
+    stored->setCreated(created);
+    stored->addAttendee(KCalendarCore::Attendee(QStringLiteral("Alice"),
+                                                QStringLiteral("alice@example.org")));
+    QVERIFY(m_calendar->addEvent(stored, NotebookId));
+    QVERIFY(m_storage->save());
+
+    // Neither incidence is in the calendar.
+    KCalendarCore::Event::Ptr update(stored->clone());
+    update->setSummary(QString::fromLatin1("upserted"));
+    update->clearAttendees();
+    // The stored creation date is kept.
+    update->setCreated(QDateTime());
+    KCalendarCore::Event::Ptr insert(new KCalendarCore::Event);
+    insert->setSummary(QString::fromLatin1("inserted"));
+    insert->setDtStart(QDateTime(QDate(2023, 8, 22), QTime(10, 0)));
+
+    TestStorageObserver observer(m_storage);
+    QSignalSpy updated(&observer, &TestStorageObserver::updated);
+    QVERIFY(storage->upsertIncidences(KCalendarCore::Incidence::List() << update << insert,
+                                      NotebookId));
+    QCOMPARE(updated.count(), 1);
+    const QList<QVariant> args = updated.takeFirst();
+    const KCalendarCore::Incidence::List added = args[0].value<KCalendarCore::Incidence::List>();
+    const KCalendarCore::Incidence::List modified = args[1].value<KCalendarCore::Incidence::List>();
+    QCOMPARE(added.count(), 1);
+    QCOMPARE(added[0]->uid(), insert->uid());
+    QCOMPARE(modified.count(), 1);
+    QCOMPARE(modified[0]->uid(), stored->uid());
+
+    // Upserting again only updates.
+    QVERIFY(storage->upsertIncidences(KCalendarCore::Incidence::List() << insert, NotebookId));
+    QCOMPARE(updated.count(), 1);
+    QVERIFY(updated.takeFirst()[0].value<KCalendarCore::Incidence::List>().isEmpty());
+
+    // Incidences of other notebooks are not moved.
+    Notebook::Ptr other(new Notebook(QStringLiteral("Other notebook"), QString()));
+    QVERIFY(m_storage->addNotebook(other));
+    QVERIFY(!storage->upsertIncidences(KCalendarCore::Incidence::List() << insert, other->uid()));
+
+    reloadDb();
+    QVERIFY(m_storage->load(stored->uid()));
+    QVERIFY(m_storage->load(insert->uid()));
+    KCalendarCore::Event::Ptr fetched = m_calendar->event(stored->uid());
+    QVERIFY(fetched);
+    QCOMPARE(fetched->summary(), QString::fromLatin1("upserted"));
+    QCOMPARE(fetched->created(), created);
+    QVERIFY(fetched->attendees().isEmpty());
+    QCOMPARE(m_calendar->notebook(fetched), QString::fromLatin1(NotebookId));
+    fetched = m_calendar->event(insert->uid());
+    QVERIFY(fetched);
+    QCOMPARE(fetched->summary(), QString::fromLatin1("inserted"));
+    QCOMPARE(m_calendar->notebook(fetched), QString::fromLatin1(NotebookId));
+
+    QVERIFY(m_storage->deleteNotebook(m_storage->notebook(other->uid())));
+
+    // Alarms are scheduled from the upserted incidences,
+    // that are not in the calendar.
+    RecordingAlarmBackend backend;
+    AlarmBackend::setInstance(&backend);
+    storage = m_storage.staticCast<SqliteStorage>();
+    const QDateTime dt(QDate::currentDate().addDays(1), QTime(10, 0));
+    KCalendarCore::Event::Ptr alarmed(new KCalendarCore::Event);
+    alarmed->setSummary(QString::fromLatin1("upserted alarm"));
+    alarmed->setDtStart(dt);
+    KCalendarCore::Alarm::Ptr alarm = alarmed->newAlarm();
+    alarm->setDisplayAlarm(QLatin1String("Upserted alarm"));
+    alarm->setStartOffset(KCalendarCore::Duration(-600));
+    alarm->setEnabled(true);
+    QVERIFY(storage->upsertIncidences(KCalendarCore::Incidence::List() << alarmed, NotebookId));
+    m_storage->flushAlarms();
+    QCOMPARE(backend.events().count(), 1);
+    QCOMPARE(backend.events().constBegin()->ticker, dt.addSecs(-600));
+    QCOMPARE(backend.events().constBegin()->attributes.value(QString::fromLatin1("uid")),
+             alarmed->uid());
+
+    KCalendarCore::Event::Ptr moved(alarmed->clone());
+    moved->setDtStart(dt.addSecs(3600));
+    QVERIFY(storage->upsertIncidences(KCalendarCore::Incidence::List() << moved, NotebookId));
+    m_storage->flushAlarms();
+    QCOMPARE(backend.events().count(), 1);
+    QCOMPARE(backend.events().constBegin()->ticker, dt.addSecs(3000));
+
+    AlarmBackend::setInstance(nullptr);
+}
+
+void tst_storage::tst_lazyNotebooks()
+{
+    Notebook::Ptr notebook = m_storage->notebook(QString::fromLatin1(NotebookId));
+    QVERIFY(notebook);
+    notebook->setCustomProperty("lazy-key", QString::fromLatin1("lazy value"));
+    QVERIFY(m_storage->updateNotebook(notebook));
+
+    KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+    event->setSummary(QString::fromLatin1("loaded lazily"));
+    event->setDtStart(QDateTime(QDate(2023, 8, 28), QTime(10, 0)));
+    QVERIFY(m_calendar->addEvent(event, NotebookId));
+    QVERIFY(m_storage->save());
+
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    SqliteStorage::Ptr storage(new SqliteStorage(calendar, m_storage.staticCast<SqliteStorage>()->databaseName()));
+    storage->setLazyNotebooks(true);
+    QVERIFY(storage->lazyNotebooks());
+    QVERIFY(storage->open());
+    QVERIFY(!calendar->hasValidNotebook(QString::fromLatin1(NotebookId)));
+
+    // Loading incidences loads the notebooks first.
+    QVERIFY(storage->load(event->uid()));
+    QVERIFY(calendar->hasValidNotebook(QString::fromLatin1(NotebookId)));
+    QVERIFY(calendar->event(event->uid()));
+
+    // Custom properties are read for all notebooks at once.
+    Notebook::Ptr lazy = storage->notebook(QString::fromLatin1(NotebookId));
+    QVERIFY(lazy);
+    QCOMPARE(lazy->customProperty("lazy-key"), QString::fromLatin1("lazy value"));
+    QVERIFY(storage->defaultNotebook());
+    QCOMPARE(storage->notebooks().count(), m_storage->notebooks().count());
+    storage->close();
+
+    // Notebooks are loaded on first use of the storage.
+    QVERIFY(storage->open());
+    QVERIFY(storage->notebook(QString::fromLatin1(NotebookId)));
+    QVERIFY(calendar->hasValidNotebook(QString::fromLatin1(NotebookId)));
+    storage->close();
+
+    // The default notebook of a new database is created and
+    // stored by the first load, without locking twice.
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QString::fromLatin1("lazy.db"));
+    ExtendedCalendar::Ptr empty(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    SqliteStorage::Ptr lazyStorage(new SqliteStorage(empty, path));
+    lazyStorage->setLazyNotebooks(true);
+    QVERIFY(lazyStorage->open());
+    QVERIFY(lazyStorage->load(QDate(2023, 8, 1), QDate(2023, 9, 1)));
+    Notebook::Ptr created = lazyStorage->defaultNotebook();
+    QVERIFY(created);
+    lazyStorage->close();
+
+    SqliteStorage::Ptr reopened(new SqliteStorage(empty, path));
+    QVERIFY(reopened->open());
+    QVERIFY(reopened->defaultNotebook());
+    QCOMPARE(reopened->defaultNotebook()->uid(), created->uid());
+    reopened->close();
+}
+
+void tst_storage::tst_interruptedMigration()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QString::fromLatin1("migrated.db"));
+    ExtendedCalendar::Ptr calendar(new ExtendedCalendar(QTimeZone::systemTimeZone()));
+    SqliteStorage::Ptr storage(new SqliteStorage(calendar, path));
+    QVERIFY(storage->open());
+    storage->close();
+
+    // A migration to version 5 stopped before the indexes and
+    // triggers used by the current schema were created.
+    const char *exists = "select count(*) from sqlite_master where name in "
+        "('IDX_CHANGELOG', 'IDX_COMPONENT_CHANGE', 'ComponentChanged')";
+    QCOMPARE(execute(path, exists, QString()), 3);
+    QCOMPARE(execute(path, "drop index IDX_CHANGELOG", QString()), 0);
+    QCOMPARE(execute(path, "drop index IDX_COMPONENT_CHANGE", QString()), 0);
+    QCOMPARE(execute(path, "drop trigger ComponentChanged", QString()), 0);
+    QCOMPARE(execute(path, "PRAGMA user_version = 5", QString()), 0);
+
+    QVERIFY(storage->open());
+    storage->close();
+    QCOMPARE(execute(path, "PRAGMA user_version", QString()), 7);
+    QCOMPARE(execute(path, exists, QString()), 3);
+
+    // A version 6 database, with a trigger writing again the updated rows.
+    const char *updating = "select count(*) from sqlite_master where type='trigger' "
+        "and sql like '%update Components%'";
+    QCOMPARE(execute(path, updating, QString()), 0);
+    QCOMPARE(execute(path, "drop trigger ComponentChanged", QString()), 0);
+    QCOMPARE(execute(path, "create trigger ComponentChanged after update on Components begin "
+                     "update Components set ChangeSeq=0 where ComponentId=new.ComponentId; end",
+                     QString()), 0);
+    QCOMPARE(execute(path, "PRAGMA user_version = 6", QString()), 0);
+    QCOMPARE(execute(path, updating, QString()), 1);
+
+    QVERIFY(storage->open());
+    storage->close();
+    QCOMPARE(execute(path, "PRAGMA user_version", QString()), 7);
+    QCOMPARE(execute(path, exists, QString()), 3);
+    QCOMPARE(execute(path, updating, QString()), 0);
+}
+
 #include "tst_storage.moc"
 
 QTEST_GUILESS_MAIN(tst_storage)
@@ -70,6 +70,15 @@ private slots:
     void tst_calendarProperties();
     void tst_alarms();
     void tst_recurringAlarms();
+    void tst_alarmIndex();
+    void tst_alarmsCoalesced();
+    void tst_metrics();
+    void tst_queryTrace();
+    void tst_lockStatus();
+    void tst_memoryUsage();
+    void tst_purgeExpiredTombstones();
+    void tst_purgeExpiredTombstonesSynced();
+    void tst_changesSince();
     void tst_url_data();
     void tst_url();
     void tst_thisAndFuture();
@@ -79,6 +88,15 @@ private slots:
     void tst_populateFromIcsData();
     void tst_attendees();
     void tst_storageObserver();
+    void tst_notebookObserver();
+    void tst_storageChanges();
+    void tst_storageChangesNotebookLoaded();
+    void tst_batchNotifications();
+    void tst_writeBehind();
+    void tst_updateChangedColumns();
+    void tst_upsertIncidences();
+    void tst_lazyNotebooks();
+    void tst_interruptedMigration();
 
 private:
     void openDb(bool clear = false);
@@ -0,0 +1,176 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include <QObject>
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tracer_p.h"
+
+using namespace mKCal;
+
+class tst_tracer: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void testSpan();
+    void testEscaping();
+    void testFork();
+
+private:
+    bool readEvents(QList<QJsonObject> *events);
+    QJsonObject find(const QList<QJsonObject> &events,
+                     const QString &name, qint64 pid);
+
+    QTemporaryDir mDir;
+    QString mPath;
+};
+
+void tst_tracer::initTestCase()
+{
+    QVERIFY(mDir.isValid());
+    mPath = mDir.filePath(QString::fromLatin1("trace.json"));
+    // Read once, on first use of the tracer.
+    qputenv("MKCAL_TRACE", mPath.toUtf8());
+    QVERIFY(Tracer::isEnabled());
+}
+
+// The file is a JSON array, with one event per line
+// and without the optional closing bracket.
+bool tst_tracer::readEvents(QList<QJsonObject> *events)
+{
+    QFile file(mPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "cannot open" << mPath;
+        return false;
+    }
+    if (file.readLine() != "[\n") {
+        qWarning() << "trace file does not start a JSON array";
+        return false;
+    }
+    events->clear();
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        if (!line.endsWith(",\n")) {
+            qWarning() << "unterminated event" << line;
+            return false;
+        }
+        line.chop(2);
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            qWarning() << "invalid event" << line << error.errorString();
+            return false;
+        }
+        events->append(document.object());
+    }
+    return true;
+}
+
+QJsonObject tst_tracer::find(const QList<QJsonObject> &events,
+                             const QString &name, qint64 pid)
+{
+    for (const QJsonObject &event : events) {
+        if (event.value(QLatin1String("name")).toString() == name
+            && qint64(event.value(QLatin1String("pid")).toDouble()) == pid) {
+            return event;
+        }
+    }
+    return QJsonObject();
+}
+
+void tst_tracer::testSpan()
+{
+    const qint64 start = Tracer::now();
+    {
+        TraceSpan span("test", "span");
+        QVERIFY(span.isEnabled());
+        span.setDetail(QString::fromLatin1("some detail"));
+    }
+    const qint64 end = Tracer::now();
+
+    QList<QJsonObject> events;
+    QVERIFY(readEvents(&events));
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    const QJsonObject process = find(events, QString::fromLatin1("process_name"), pid);
+    QCOMPARE(process.value(QLatin1String("ph")).toString(), QString::fromLatin1("M"));
+    QVERIFY(process.value(QLatin1String("args")).toObject().contains(QLatin1String("name")));
+
+    const QJsonObject event = find(events, QString::fromLatin1("span"), pid);
+    QCOMPARE(event.value(QLatin1String("cat")).toString(), QString::fromLatin1("test"));
+    QCOMPARE(event.value(QLatin1String("ph")).toString(), QString::fromLatin1("X"));
+    const qint64 ts = qint64(event.value(QLatin1String("ts")).toDouble());
+    const qint64 dur = qint64(event.value(QLatin1String("dur")).toDouble());
+    QVERIFY(ts >= start);
+    QVERIFY(dur >= 0);
+    QVERIFY(ts + dur <= end);
+    QVERIFY(event.value(QLatin1String("tid")).isDouble());
+    QCOMPARE(event.value(QLatin1String("args")).toObject()
+             .value(QLatin1String("detail")).toString(),
+             QString::fromLatin1("some detail"));
+}
+
+void tst_tracer::testEscaping()
+{
+    const QString detail = QString::fromUtf8("quote \" backslash \\ newline \n"
+                                             " tab \t bell \x07 unicode \xc3\xa9\xe2\x82\xac");
+    Tracer::complete("test", "escaping", Tracer::now(), detail);
+
+    QList<QJsonObject> events;
+    QVERIFY(readEvents(&events));
+    const QJsonObject event = find(events, QString::fromLatin1("escaping"),
+                                   QCoreApplication::applicationPid());
+    QCOMPARE(event.value(QLatin1String("args")).toObject()
+             .value(QLatin1String("detail")).toString(), detail);
+}
+
+void tst_tracer::testFork()
+{
+    const pid_t child = ::fork();
+    QVERIFY(child >= 0);
+    if (child == 0) {
+        Tracer::complete("test", "child", Tracer::now());
+        ::_exit(0);
+    }
+    int status = 0;
+    QCOMPARE(::waitpid(child, &status, 0), child);
+    QVERIFY(WIFEXITED(status));
+
+    QList<QJsonObject> events;
+    QVERIFY(readEvents(&events));
+    // Events of the child carry its own pid, not the cached one of its parent.
+    QVERIFY(!find(events, QString::fromLatin1("child"), child).isEmpty());
+    QVERIFY(find(events, QString::fromLatin1("child"),
+                 QCoreApplication::applicationPid()).isEmpty());
+    QVERIFY(!find(events, QString::fromLatin1("process_name"), child).isEmpty());
+}
+
+#include "tst_tracer.moc"
+QTEST_GUILESS_MAIN(tst_tracer)
@@ -0,0 +1,164 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+#include "alarmservice.h"
+#include "mkcaltool.h"
+
+#include <QtCore/QDebug>
+
+static const QLatin1String SERVICE_NAME("mkcal-alarm-service");
+// Recurring alarms tend to fire at the same time, like at the
+// beginning of an hour, wait a bit to process them together.
+static const int BATCH_DELAY_MS = 500;
+static const int CONNECT_TIMEOUT_MS = 500;
+static const int ACKNOWLEDGE_TIMEOUT_MS = 5000;
+static const QByteArray REPLY_OK("ok\n");
+static const QByteArray REPLY_ERROR("error\n");
+
+AlarmService::AlarmService(QObject *parent)
+    : QObject(parent)
+{
+    mBatchTimer.setSingleShot(true);
+    mBatchTimer.setInterval(BATCH_DELAY_MS);
+    connect(&mBatchTimer, &QTimer::timeout, this, &AlarmService::process);
+    connect(&mServer, &QLocalServer::newConnection, this, &AlarmService::onNewConnection);
+}
+
+AlarmService::~AlarmService()
+{
+    process();
+}
+
+bool AlarmService::start()
+{
+    mServer.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!mServer.listen(SERVICE_NAME)) {
+        // A previous instance may have left its socket behind,
+        // but don't take it away from a running one.
+        QLocalSocket socket;
+        socket.connectToServer(SERVICE_NAME);
+        if (socket.waitForConnected(CONNECT_TIMEOUT_MS)) {
+            socket.disconnectFromServer();
+            qWarning() << "Another instance is already listening on" << SERVICE_NAME;
+            return false;
+        }
+        if (socket.error() != QLocalSocket::ConnectionRefusedError) {
+            qWarning() << "Unable to listen on" << SERVICE_NAME << mServer.errorString();
+            return false;
+        }
+        QLocalServer::removeServer(SERVICE_NAME);
+        if (!mServer.listen(SERVICE_NAME)) {
+            qWarning() << "Unable to listen on" << SERVICE_NAME << mServer.errorString();
+            return false;
+        }
+    }
+
+    mCalendar = mKCal::ExtendedCalendar::Ptr(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mStorage = mCalendar->defaultStorage(mCalendar);
+    if (!mStorage->open()) {
+        qWarning() << "Unable to open calendar database";
+        mServer.close();
+        return false;
+    }
+    return true;
+}
+
+bool AlarmService::request(const QString &notebookUid, const QString &eventUid)
+{
+    QLocalSocket socket;
+    socket.connectToServer(SERVICE_NAME);
+    if (!socket.waitForConnected(CONNECT_TIMEOUT_MS)) {
+        return false;
+    }
+    socket.write(notebookUid.toUtf8() + '\t' + eventUid.toUtf8() + '\n');
+    if (!socket.waitForBytesWritten(CONNECT_TIMEOUT_MS)) {
+        qWarning() << "Unable to send request to" << SERVICE_NAME << socket.errorString();
+        return false;
+    }
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(ACKNOWLEDGE_TIMEOUT_MS)) {
+            qWarning() << "No acknowledgement from" << SERVICE_NAME << socket.errorString();
+            return false;
+        }
+    }
+    const QByteArray reply = socket.readLine();
+    socket.disconnectFromServer();
+    if (reply != REPLY_OK) {
+        qWarning() << "Request failed in" << SERVICE_NAME << reply.trimmed();
+        return false;
+    }
+    return true;
+}
+
+void AlarmService::onNewConnection()
+{
+    while (QLocalSocket *socket = mServer.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, &AlarmService::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        if (socket->bytesAvailable()) {
+            onReadyRead();
+        }
+    }
+}
+
+void AlarmService::onReadyRead()
+{
+    for (QLocalSocket *socket : mServer.findChildren<QLocalSocket*>()) {
+        while (socket->canReadLine()) {
+            const QList<QByteArray> request = socket->readLine().trimmed().split('\t');
+            if (request.count() != 2 || request[1].isEmpty()) {
+                qWarning() << "Invalid request" << request;
+                socket->write(REPLY_ERROR);
+                continue;
+            }
+            mPending.insert(QPair<QString, QString>(QString::fromUtf8(request[0]),
+                                                    QString::fromUtf8(request[1])));
+            if (!mWaiting.contains(socket)) {
+                mWaiting.append(socket);
+            }
+        }
+    }
+    if (!mPending.isEmpty() && !mBatchTimer.isActive()) {
+        mBatchTimer.start();
+    }
+}
+
+void AlarmService::process()
+{
+    mBatchTimer.stop();
+    if (mPending.isEmpty() || !mStorage) {
+        return;
+    }
+
+    MkcalTool tool;
+    const bool success = (tool.resetAlarms(mStorage, mPending) == 0);
+    mPending.clear();
+
+    // The alarms are scheduled, the series are not needed anymore,
+    // they are loaded again on next request to catch modifications.
+    mStorage->unloadIncidences(mCalendar->rawIncidences());
+
+    for (const QPointer<QLocalSocket> &socket : mWaiting) {
+        if (socket) {
+            socket->write(success ? REPLY_OK : REPLY_ERROR);
+        }
+    }
+    mWaiting.clear();
+}
@@ -0,0 +1,77 @@
+/*
+  This file is part of the mkcal library.
+
+  Copyright (c) 2026 agent <agent@local>
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef ALARMSERVICE_H
+#define ALARMSERVICE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+// mkcal
+#include <extendedcalendar.h>
+#include <extendedstorage.h>
+
+/**
+  A resident process keeping the calendar database open and
+  resetting alarms of series on request, received from
+  mkcaltool --reset-alarms over a local socket.
+
+  Requests received within a short delay are processed together,
+  each request is acknowledged once its alarms have been reset.
+*/
+class AlarmService : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AlarmService(QObject *parent = nullptr);
+    ~AlarmService();
+
+    bool start();
+
+    /**
+      Forward a reset request to a running service and wait
+      for the alarms to be reset.
+
+      @returns false if no service is running or if it did not
+               acknowledge the request.
+    */
+    static bool request(const QString &notebookUid, const QString &eventUid);
+
+private:
+    void onNewConnection();
+    void onReadyRead();
+    void process();
+
+    QLocalServer mServer;
+    QTimer mBatchTimer;
+    QSet<QPair<QString, QString>> mPending;
+    // Clients waiting for the acknowledgement of their requests.
+    QList<QPointer<QLocalSocket>> mWaiting;
+    mKCal::ExtendedCalendar::Ptr mCalendar;
+    mKCal::ExtendedStorage::Ptr mStorage;
+};
+
+#endif // ALARMSERVICE_H
@@ -0,0 +1,477 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "dataset.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QUuid>
+
+#include <KCalendarCore/Calendar>
+#include <KCalendarCore/Event>
+#include <KCalendarCore/Todo>
+
+// mkcal
+#include <extendedcalendar.h>
+#include <sqlitestorage.h>
+#include <sqliteformat.h>
+
+using namespace KCalendarCore;
+
+namespace {
+
+// A small and portable generator (splitmix64), so a seed
+// gives the same data on every platform and Qt version.
+class Random
+{
+public:
+    explicit Random(quint64 state)
+        : mState(state)
+    {
+    }
+
+    quint64 next()
+    {
+        quint64 z = (mState += Q_UINT64_C(0x9E3779B97F4A7C15));
+        z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+        return z ^ (z >> 31);
+    }
+
+    // In [low, high[.
+    int bounded(int low, int high)
+    {
+        return high > low ? low + int(next() % quint64(high - low)) : low;
+    }
+
+    bool chance(int percent)
+    {
+        return bounded(0, 100) < percent;
+    }
+
+private:
+    quint64 mState;
+};
+
+const char *const WORDS[] = {
+    "project", "review", "weekly", "planning", "budget", "design", "team",
+    "lunch", "call", "customer", "release", "sprint", "retrospective", "demo",
+    "training", "interview", "dentist", "school", "football", "concert",
+    "flight", "hotel", "report", "meeting", "workshop", "status", "update",
+    "quarterly", "board", "launch", "party", "birthday"
+};
+const int N_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+const char *const NAMES[] = {
+    "Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi",
+    "Ivan", "Judy", "Mallory", "Niaj", "Olivia", "Peggy", "Rupert", "Sybil",
+    "Trent", "Victor", "Walter", "Yvonne"
+};
+const int N_NAMES = sizeof(NAMES) / sizeof(NAMES[0]);
+
+QString sentence(Random *rng, int low, int high)
+{
+    QStringList words;
+    for (int i = rng->bounded(low, high); i > 0; i--) {
+        words.append(QString::fromLatin1(WORDS[rng->bounded(0, N_WORDS)]));
+    }
+    if (!words.isEmpty()) {
+        words[0][0] = words[0][0].toUpper();
+    }
+    return words.join(QLatin1Char(' '));
+}
+
+Person person(Random *rng, int index)
+{
+    const QString name = QString::fromLatin1(NAMES[rng->bounded(0, N_NAMES)]);
+    return Person(QString::fromLatin1("%1 %2").arg(name).arg(index),
+                  QString::fromLatin1("%1.%2@example.org").arg(name.toLower()).arg(index));
+}
+
+void addAttendees(Incidence *incidence, Random *rng, int count)
+{
+    incidence->setOrganizer(person(rng, 0));
+    for (int i = 1; i <= count; i++) {
+        const Person who = person(rng, i);
+        incidence->addAttendee(Attendee(who.name(), who.email(), rng->chance(80),
+                                        Attendee::PartStat(rng->bounded(Attendee::NeedsAction,
+                                                                        Attendee::Delegated + 1)),
+                                        rng->chance(20) ? Attendee::OptParticipant
+                                                        : Attendee::ReqParticipant));
+    }
+}
+
+void addAlarm(Incidence *incidence, Random *rng)
+{
+    Alarm::Ptr alarm = incidence->newAlarm();
+    alarm->setDisplayAlarm(incidence->summary());
+    alarm->setStartOffset(Duration(-60 * 5 * rng->bounded(1, 13)));
+    alarm->setEnabled(true);
+}
+
+}
+
+QList<Dataset::Profile> Dataset::profiles()
+{
+    return QList<Profile>() << Meetings << Recurrences << Attachments
+                            << Todos << SyncAccounts;
+}
+
+QString Dataset::profileName(Profile profile)
+{
+    switch (profile) {
+    case Meetings:
+        return QString::fromLatin1("meetings");
+    case Recurrences:
+        return QString::fromLatin1("recurrences");
+    case Attachments:
+        return QString::fromLatin1("attachments");
+    case Todos:
+        return QString::fromLatin1("todos");
+    case SyncAccounts:
+        return QString::fromLatin1("sync");
+    }
+    return QString();
+}
+
+bool Dataset::profileFromName(const QString &name, Profile *profile)
+{
+    for (Profile candidate : profiles()) {
+        if (profileName(candidate) == name) {
+            *profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Dataset::Dataset(Profile profile, int size, quint32 seed)
+    : mProfile(profile)
+    , mSize(size)
+    , mSeed(seed)
+{
+}
+
+Dataset::Profile Dataset::profile() const
+{
+    return mProfile;
+}
+
+int Dataset::size() const
+{
+    return mSize;
+}
+
+quint32 Dataset::seed() const
+{
+    return mSeed;
+}
+
+QDateTime Dataset::referenceDate() const
+{
+    return QDateTime(QDate(2023, 6, 1), QTime(0, 0), QTimeZone::utc());
+}
+
+QString Dataset::searchKey() const
+{
+    return QString::fromLatin1("review");
+}
+
+int Dataset::notebookCount() const
+{
+    return mProfile == SyncAccounts ? 8 : 1;
+}
+
+mKCal::Notebook::Ptr Dataset::notebook(int index) const
+{
+    const QString name = QString::fromLatin1("%1 %2").arg(profileName(mProfile)).arg(index);
+    const QUuid uid = QUuid::createUuidV5(QUuid(), QString::fromLatin1("%1-%2").arg(name).arg(mSeed));
+    mKCal::Notebook::Ptr notebook(new mKCal::Notebook(uid.toString().mid(1, 36), name,
+                                                      QString(), QString::fromLatin1("#%1")
+                                                      .arg(0x204080 * (index + 1) % 0xFFFFFF, 6, 16, QLatin1Char('0')),
+                                                      false, true, false, false, true));
+    if (mProfile == SyncAccounts) {
+        notebook->setIsSynchronized(true);
+        notebook->setPluginName(index % 2 ? QString::fromLatin1("caldav")
+                                          : QString::fromLatin1("activesync"));
+        notebook->setAccount(QString::number(index / 2 + 1));
+        notebook->setSyncProfile(QString::fromLatin1("%1-%2").arg(notebook->pluginName()).arg(index));
+        notebook->setSyncDate(referenceDate());
+        notebook->setCustomProperty("remoteCalendarPath",
+                                    QString::fromLatin1("/calendars/%1/").arg(index));
+    }
+    return notebook;
+}
+
+bool Dataset::isDeleted(int index) const
+{
+    // Synchronised notebooks keep more tombstones, waiting
+    // for the deletion to be sent to the server.
+    Random rng(~quint64(index) ^ (quint64(mSeed) << 32));
+    return rng.chance(mProfile == SyncAccounts ? 10 : 2);
+}
+
+int Dataset::seriesCount() const
+{
+    // Recurring series have around ten exceptions each.
+    return mProfile == Recurrences ? qMax(1, mSize / 10) : mSize;
+}
+
+Incidence::List Dataset::series(int index, QString *notebookUid) const
+{
+    const QString uid = QString::fromLatin1("%1-%2-%3@mkcal.dataset")
+        .arg(profileName(mProfile)).arg(mSeed).arg(index);
+    return generate(uid, (quint64(mSeed) << 32) | quint32(index), notebookUid);
+}
+
+Incidence::Ptr Dataset::extra(int index, QString *notebookUid) const
+{
+    const QString uid = QString::fromLatin1("%1-%2-extra-%3@mkcal.dataset")
+        .arg(profileName(mProfile)).arg(mSeed).arg(index);
+    const Incidence::List list = generate(uid, ~((quint64(mSeed) << 32) | quint32(index)), notebookUid);
+    // Only the parent, exceptions cannot be inserted on their own.
+    return list.first();
+}
+
+Incidence::List Dataset::generate(const QString &uid, quint64 key, QString *notebookUid) const
+{
+    Random rng(key);
+    const QDateTime start = referenceDate().addDays(rng.bounded(-365, 365))
+        .addSecs(3600 * rng.bounded(7, 20) + 900 * rng.bounded(0, 4));
+    const int notebookIndex = rng.bounded(0, notebookCount());
+    if (notebookUid) {
+        *notebookUid = notebook(notebookIndex)->uid();
+    }
+
+    Incidence::List list;
+    Incidence::Ptr incidence;
+    if (mProfile == Todos) {
+        Todo::Ptr todo(new Todo);
+        todo->setDtDue(start, true);
+        todo->setPriority(rng.bounded(0, 10));
+        if (rng.chance(40)) {
+            todo->setCompleted(start.addDays(-rng.bounded(0, 10)));
+        } else {
+            todo->setPercentComplete(10 * rng.bounded(0, 10));
+        }
+        // Lists of up to five items.
+        if (rng.chance(80)) {
+            todo->setRelatedTo(QString::fromLatin1("%1-%2-list-%3@mkcal.dataset")
+                               .arg(profileName(mProfile)).arg(mSeed).arg(rng.bounded(0, qMax(1, mSize / 5))));
+        }
+        incidence = todo;
+    } else {
+        Event::Ptr event(new Event);
+        if (mProfile == SyncAccounts && rng.chance(15)) {
+            event->setDtStart(QDateTime(start.date(), QTime(0, 0), QTimeZone::utc()));
+            event->setAllDay(true);
+        } else {
+            event->setDtStart(start);
+            event->setDtEnd(start.addSecs(1800 * rng.bounded(1, 5)));
+        }
+        incidence = event;
+    }
+    incidence->setUid(uid);
+    incidence->setCreated(referenceDate().addDays(-400));
+    incidence->setLastModified(referenceDate().addDays(-rng.bounded(0, 400)));
+    incidence->setSummary(sentence(&rng, 1, 6));
+    if (rng.chance(50)) {
+        incidence->setDescription(sentence(&rng, 10, 60));
+    }
+    if (rng.chance(30)) {
+        incidence->setLocation(QString::fromLatin1("Room %1").arg(rng.bounded(1, 500)));
+    }
+    if (rng.chance(20)) {
+        incidence->setCategories(QStringList() << sentence(&rng, 1, 2));
+    }
+
+    switch (mProfile) {
+    case Meetings:
+        addAttendees(incidence.data(), &rng, rng.bounded(5, 51));
+        if (rng.chance(60)) {
+            addAlarm(incidence.data(), &rng);
+        }
+        break;
+    case Recurrences: {
+        Recurrence *recurrence = incidence->recurrence();
+        switch (rng.bounded(0, 3)) {
+        case 0:
+            recurrence->setDaily(rng.bounded(1, 4));
+            break;
+        case 1: {
+            QBitArray days(7);
+            days.setBit(start.date().dayOfWeek() - 1);
+            days.setBit(rng.bounded(0, 7));
+            recurrence->setWeekly(1, days);
+            break;
+        }
+        default:
+            recurrence->setMonthly(1);
+            recurrence->addMonthlyDate(start.date().day());
+            break;
+        }
+        if (rng.chance(40)) {
+            recurrence->setDuration(rng.bounded(10, 60));
+        } else if (rng.chance(50)) {
+            recurrence->setEndDateTime(start.addDays(rng.bounded(30, 365)));
+        }
+        for (int i = rng.bounded(0, 5); i > 0; i--) {
+            recurrence->addExDateTime(start.addDays(7 * rng.bounded(1, 20)));
+        }
+        if (rng.chance(20)) {
+            for (int i = rng.bounded(1, 4); i > 0; i--) {
+                recurrence->addRDateTime(start.addDays(rng.bounded(1, 60)).addSecs(3600));
+            }
+        }
+        if (rng.chance(50)) {
+            addAlarm(incidence.data(), &rng);
+        }
+        list.append(incidence);
+
+        // Exceptions on some of the first occurrences.
+        int exceptions = rng.bounded(3, 16);
+        QDateTime occurrence = start;
+        for (int i = 0; i < 60 && exceptions > 0 && occurrence.isValid(); i++) {
+            occurrence = recurrence->getNextDateTime(occurrence);
+            if (occurrence.isValid() && rng.chance(30)) {
+                Incidence::Ptr exception = Calendar::createException(incidence, occurrence);
+                exception->setDtStart(occurrence.addSecs(900 * rng.bounded(-4, 5)));
+                exception->setSummary(sentence(&rng, 1, 6));
+                exception->setLastModified(incidence->lastModified());
+                list.append(exception);
+                exceptions -= 1;
+            }
+        }
+        return list;
+    }
+    case Attachments:
+        for (int i = rng.bounded(1, 6); i > 0; i--) {
+            if (rng.chance(50)) {
+                incidence->addAttachment(Attachment(QString::fromLatin1("https://files.example.org/%1/%2.pdf")
+                                                    .arg(uid).arg(i),
+                                                    QString::fromLatin1("application/pdf")));
+            } else {
+                QByteArray data(rng.bounded(1024, 16384), '\0');
+                for (int j = 0; j < data.size(); j++) {
+                    data[j] = char(rng.next());
+                }
+                Attachment attachment(data.toBase64(), QString::fromLatin1("image/jpeg"));
+                attachment.setLabel(QString::fromLatin1("picture-%1.jpg").arg(i));
+                incidence->addAttachment(attachment);
+            }
+        }
+        break;
+    case Todos:
+        if (rng.chance(30)) {
+            addAlarm(incidence.data(), &rng);
+        }
+        break;
+    case SyncAccounts:
+        if (rng.chance(20) && !incidence->allDay()) {
+            incidence->recurrence()->setWeekly(1);
+        }
+        if (rng.chance(50)) {
+            addAttendees(incidence.data(), &rng, rng.bounded(1, 6));
+        }
+        if (rng.chance(50)) {
+            addAlarm(incidence.data(), &rng);
+        }
+        incidence->setNonKDECustomProperty("X-EAS-SERVERID",
+                                           QString::fromLatin1("%1:%2").arg(rng.bounded(1, 20)).arg(rng.next() % 100000));
+        incidence->setNonKDECustomProperty("X-CALDAV-ETAG",
+                                           QString::number(rng.next(), 16));
+        incidence->setCustomProperty("VOLATILE", "SYNC-REMOTE-ID",
+                                     QString::fromLatin1("/calendars/%1.ics").arg(uid));
+        break;
+    }
+    list.append(incidence);
+    return list;
+}
+
+bool Dataset::write(const QString &databaseName) const
+{
+    // Let the storage create the schema and the notebooks.
+    {
+        mKCal::ExtendedCalendar::Ptr calendar(new mKCal::ExtendedCalendar(QTimeZone::utc()));
+        mKCal::SqliteStorage storage(calendar, databaseName, false);
+        if (!storage.open()) {
+            qWarning() << "cannot create database" << databaseName;
+            return false;
+        }
+        for (int i = 0; i < notebookCount(); i++) {
+            if (!storage.addNotebook(notebook(i))) {
+                qWarning() << "cannot add notebook" << i;
+                return false;
+            }
+        }
+        storage.close();
+    }
+
+    sqlite3 *database = nullptr;
+    if (sqlite3_open_v2(databaseName.toUtf8().constData(), &database,
+                        SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        qWarning() << "cannot open database" << databaseName << sqlite3_errmsg(database);
+        sqlite3_close(database);
+        return false;
+    }
+
+    bool success = sqlite3_exec(database, "PRAGMA foreign_keys = ON", nullptr, nullptr, nullptr) == SQLITE_OK
+        && sqlite3_exec(database, "BEGIN IMMEDIATE TRANSACTION", nullptr, nullptr, nullptr) == SQLITE_OK;
+    {
+        mKCal::SqliteFormat format(database);
+        for (int i = 0; success && i < seriesCount(); i++) {
+            QString notebookUid;
+            const Incidence::List list = series(i, &notebookUid);
+            for (const Incidence::Ptr &incidence : list) {
+                success = success && format.modifyComponents(*incidence, notebookUid, mKCal::DBInsert);
+            }
+            if (isDeleted(i)) {
+                for (const Incidence::Ptr &incidence : list) {
+                    success = success && format.modifyComponents(*incidence, notebookUid, mKCal::DBMarkDeleted);
+                }
+            }
+            // Keep transactions of a reasonable size.
+            if (success && i % 10000 == 9999) {
+                success = sqlite3_exec(database, "COMMIT TRANSACTION", nullptr, nullptr, nullptr) == SQLITE_OK
+                    && sqlite3_exec(database, "BEGIN IMMEDIATE TRANSACTION", nullptr, nullptr, nullptr) == SQLITE_OK;
+            }
+        }
+
+        // Tombstones are marked with the current time, spread them
+        // over two months before the reference date instead.
+        sqlite3_stmt *stmt = nullptr;
+        success = success
+            && sqlite3_prepare_v2(database, "update Components set DateDeleted=? - (ComponentId % 60) * 86400 "
+                                  "where DateDeleted<>0", -1, &stmt, nullptr) == SQLITE_OK
+            && sqlite3_bind_int64(stmt, 1, mKCal::SqliteFormat::toOriginTime(referenceDate())) == SQLITE_OK
+            && sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+
+        int transactionId;
+        success = success && format.incrementTransactionId(&transactionId);
+    }
+    if (success) {
+        success = sqlite3_exec(database, "COMMIT TRANSACTION", nullptr, nullptr, nullptr) == SQLITE_OK;
+    } else {
+        qWarning() << "cannot write data set" << sqlite3_errmsg(database);
+        sqlite3_exec(database, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+    }
+    sqlite3_close(database);
+
+    return success;
+}
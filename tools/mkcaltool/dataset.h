@@ -0,0 +1,123 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MKCAL_DATASET_H
+#define MKCAL_DATASET_H
+
+#include <KCalendarCore/Incidence>
+
+#include "notebook.h"
+
+/**
+  Generates synthetic calendar data, according to a profile,
+  a size and a seed. The same profile, size and seed always
+  produce the same data, regardless of the current date or
+  of the platform, so a database can be referred to as
+  "profile X, seed Y, N incidences".
+*/
+class Dataset
+{
+public:
+    enum Profile {
+        // Events with many attendees.
+        Meetings,
+        // Recurring events with exceptions, exdates and rdates.
+        Recurrences,
+        // Events with URI and inline attachments.
+        Attachments,
+        // Todo lists with due dates, completion and relations.
+        Todos,
+        // Events from several synchronised notebooks, with
+        // custom properties from sync plugins.
+        SyncAccounts
+    };
+
+    static QList<Profile> profiles();
+    static QString profileName(Profile profile);
+    static bool profileFromName(const QString &name, Profile *profile);
+
+    /**
+      @param size the approximate number of incidences, exceptions included.
+    */
+    Dataset(Profile profile, int size, quint32 seed = 1);
+
+    Profile profile() const;
+    int size() const;
+    quint32 seed() const;
+
+    /**
+      A date in the middle of the generated data. Incidences
+      are spread around it, one year before and one after.
+    */
+    QDateTime referenceDate() const;
+
+    /**
+      A key matching some incidences, when using ExtendedStorage::search().
+    */
+    QString searchKey() const;
+
+    int notebookCount() const;
+    mKCal::Notebook::Ptr notebook(int index) const;
+
+    /**
+      Series are independent from each other and can be
+      generated in any order.
+    */
+    int seriesCount() const;
+
+    /**
+      Generates one series, a single incidence or a recurring
+      incidence with its exceptions.
+
+      @param index the series number, in [0, seriesCount()[
+      @param notebookUid the uid of the notebook the series belongs to
+    */
+    KCalendarCore::Incidence::List series(int index, QString *notebookUid) const;
+
+    /**
+      An incidence not part of the data set, but looking like
+      the ones from it, for insertion.
+    */
+    KCalendarCore::Incidence::Ptr extra(int index, QString *notebookUid) const;
+
+    /**
+      Some series are stored as deleted, to be purged later.
+    */
+    bool isDeleted(int index) const;
+
+    /**
+      Creates a database with the generated data. Incidences are
+      written directly through SqliteFormat, bypassing the calendar
+      and the storage, to be able to generate large data sets.
+
+      @param databaseName the path of a database not in use
+      @return true on success
+    */
+    bool write(const QString &databaseName) const;
+
+private:
+    KCalendarCore::Incidence::List generate(const QString &uid, quint64 key,
+                                            QString *notebookUid) const;
+
+    Profile mProfile;
+    int mSize;
+    quint32 mSeed;
+};
+
+#endif
@@ -34,6 +34,39 @@ int main(int argc, char *argv[])
         QString eventUid = argv[3];
         MkcalTool mkcalTool;
         exit(mkcalTool.resetAlarms(notebookUid, eventUid));
+    } else if ((argc == 5 || argc == 6) && 0 == ::strcmp(argv[1], "--generate")) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.generate(QString::fromLocal8Bit(argv[2]), QString::fromLatin1(argv[3]),
+                                QString::fromLatin1(argv[4]).toInt(),
+                                argc == 6 ? QString::fromLatin1(argv[5]).toUInt() : 1));
+    } else if ((argc == 2 || argc == 3) && 0 == ::strcmp(argv[1], "--lock-status")) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.lockStatus(argc == 3 ? QString::fromLocal8Bit(argv[2]) : QString()));
+    } else if ((argc == 3 || argc == 4) && 0 == ::strcmp(argv[1], "--memory")) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.memoryUsage(QString::fromLocal8Bit(argv[2]),
+                                   argc == 4 ? QString::fromLocal8Bit(argv[3]) : QString()));
+    } else if ((argc == 2 || argc == 3)
+               && (0 == ::strcmp(argv[1], "--analyze")
+                   || 0 == ::strcmp(argv[1], "--integrity-check")
+                   || 0 == ::strcmp(argv[1], "--stats"))) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.maintenance(QString::fromLatin1(argv[1] + 2),
+                                   argc == 3 ? QString::fromLocal8Bit(argv[2]) : QString()));
+    } else if ((argc >= 2 && argc <= 4)
+               && (0 == ::strcmp(argv[1], "--vacuum")
+                   || 0 == ::strcmp(argv[1], "--vacuum-full"))) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.maintenance(QString::fromLatin1(argv[1] + 2),
+                                   argc >= 3 ? QString::fromLocal8Bit(argv[2]) : QString(),
+                                   argc == 4 ? QString::fromLatin1(argv[3]).toInt() : 64));
+    } else if ((argc >= 2 && argc <= 4) && 0 == ::strcmp(argv[1], "--purge-tombstones")) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.purgeTombstones(argc >= 3 ? QString::fromLocal8Bit(argv[2]) : QString(),
+                                       argc == 4 ? QString::fromLatin1(argv[3]).toInt() : 100));
+    } else if (argc == 2 && 0 == ::strcmp(argv[1], "--alarm-service")) {
+        MkcalTool mkcalTool;
+        exit(mkcalTool.runAlarmService());
     }
     exit(0);
 }
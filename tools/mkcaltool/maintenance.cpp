@@ -0,0 +1,271 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#include "maintenance.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QThread>
+
+static QByteArray quoted(const QString &name)
+{
+    return '"' + name.toUtf8().replace('"', "\"\"") + '"';
+}
+
+static QByteArray literal(const QString &value)
+{
+    return '\'' + value.toUtf8().replace('\'', "''") + '\'';
+}
+
+Maintenance::Maintenance(const QString &databaseName)
+    : mDatabaseName(databaseName)
+    , mMutex(databaseName)
+{
+    bool ok = false;
+    const int pause = qEnvironmentVariableIntValue("MKCAL_MAINTENANCE_PAUSE_MS", &ok);
+    if (ok && pause >= 0) {
+        mPause = pause;
+    }
+}
+
+Maintenance::~Maintenance()
+{
+    sqlite3_close(mDatabase);
+}
+
+bool Maintenance::open()
+{
+    if (sqlite3_open_v2(mDatabaseName.toUtf8().constData(), &mDatabase,
+                        SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        qWarning() << "cannot open database" << mDatabaseName << sqlite3_errmsg(mDatabase);
+        sqlite3_close(mDatabase);
+        mDatabase = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(mDatabase, 1500);
+    return true;
+}
+
+// Runs one statement to completion while holding the lock,
+// then lets other processes run.
+bool Maintenance::run(const QByteArray &sql, Rows *rows, bool warn)
+{
+    if (!mMutex.acquire()) {
+        qWarning() << "cannot lock" << mDatabaseName << mMutex.errorString();
+        return false;
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    int rv = sqlite3_prepare_v2(mDatabase, sql.constData(), -1, &stmt, nullptr);
+    while (rv == SQLITE_OK && (rv = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (rows) {
+            QStringList row;
+            for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+                row.append(QString::fromUtf8((const char *)sqlite3_column_text(stmt, i)));
+            }
+            rows->append(row);
+        }
+        rv = SQLITE_OK;
+    }
+    if (rv != SQLITE_DONE && warn) {
+        qWarning() << "cannot run" << sql << sqlite3_errmsg(mDatabase);
+    }
+    sqlite3_finalize(stmt);
+
+    mMutex.release();
+    QThread::msleep(mPause);
+
+    return rv == SQLITE_DONE;
+}
+
+QStringList Maintenance::names(const char *type)
+{
+    Rows rows;
+    QStringList list;
+    if (run(QByteArray("SELECT name FROM sqlite_master WHERE type = '") + type
+            + "' AND name NOT LIKE 'sqlite_%' ORDER BY name", &rows)) {
+        for (const QStringList &row : rows) {
+            list.append(row.value(0));
+        }
+    }
+    return list;
+}
+
+bool Maintenance::analyze(QTextStream &out)
+{
+    const QStringList tables = names("table");
+    if (tables.isEmpty()) {
+        return false;
+    }
+    bool success = true;
+    for (const QString &table : tables) {
+        const bool done = run("ANALYZE " + quoted(table));
+        out << table << ": " << (done ? "analyzed" : "failed") << "\n";
+        success = success && done;
+    }
+    return success;
+}
+
+bool Maintenance::vacuum(QTextStream &out, int pages, bool full)
+{
+    Rows rows;
+    if (!run("PRAGMA auto_vacuum", &rows) || rows.isEmpty()) {
+        return false;
+    }
+    // 2 is INCREMENTAL, the mode change is only applied by a full VACUUM.
+    if (rows[0].value(0).toInt() != 2) {
+        if (!full) {
+            out << "the database is not in incremental auto vacuum mode, switching to it "
+                "requires a full vacuum that locks the database until it completes, "
+                "use --vacuum-full to run it\n";
+            return false;
+        }
+        out << "switching to incremental auto vacuum\n";
+        out.flush();
+        if (!run("PRAGMA auto_vacuum = INCREMENTAL") || !run("VACUUM")) {
+            return false;
+        }
+    }
+
+    rows.clear();
+    if (!run("PRAGMA freelist_count", &rows) || rows.isEmpty()) {
+        return false;
+    }
+    const int free = rows[0].value(0).toInt();
+    out << "free pages: " << free << "\n";
+    out.flush();
+
+    // Pages freed meanwhile by other processes are left to the next run.
+    pages = qMax(1, pages);
+    for (int released = 0; released < free; released += pages) {
+        if (!run("PRAGMA incremental_vacuum(" + QByteArray::number(pages) + ")")) {
+            return false;
+        }
+    }
+
+    rows.clear();
+    if (!run("PRAGMA freelist_count", &rows) || rows.isEmpty()) {
+        return false;
+    }
+    out << "free pages left: " << rows[0].value(0).toInt() << "\n";
+    return true;
+}
+
+bool Maintenance::integrityCheck(QTextStream &out)
+{
+    const QStringList tables = names("table");
+    if (tables.isEmpty()) {
+        return false;
+    }
+    bool success = true;
+    for (const QString &table : tables) {
+        Rows rows;
+        // Checking a single table needs sqlite 3.33, older versions
+        // check the whole database at once.
+        if (!run("PRAGMA quick_check(" + quoted(table) + ")", &rows, false)) {
+            rows.clear();
+            if (!run("PRAGMA quick_check", &rows)) {
+                return false;
+            }
+            for (const QStringList &row : rows) {
+                out << row.value(0) << "\n";
+                success = success && row.value(0) == QLatin1String("ok");
+            }
+            return success;
+        }
+        for (const QStringList &row : rows) {
+            out << table << ": " << row.value(0) << "\n";
+            success = success && row.value(0) == QLatin1String("ok");
+        }
+    }
+    return success;
+}
+
+bool Maintenance::stats(QTextStream &out)
+{
+    const QStringList tables = names("table");
+    if (tables.isEmpty()) {
+        return false;
+    }
+
+    // Page sizes are only available when sqlite is built with dbstat.
+    Rows rows;
+    QHash<QString, qint64> sizes;
+    const bool hasSizes = run("SELECT name, SUM(pgsize) FROM dbstat GROUP BY name", &rows, false);
+    for (const QStringList &row : rows) {
+        sizes.insert(row.value(0), row.value(1).toLongLong());
+    }
+
+    out << "tables:\n";
+    for (const QString &table : tables) {
+        rows.clear();
+        if (!run("SELECT COUNT(*) FROM " + quoted(table), &rows) || rows.isEmpty()) {
+            return false;
+        }
+        out << "  " << table << ": " << rows[0].value(0) << " rows";
+        if (hasSizes) {
+            out << ", " << sizes.value(table) << " bytes";
+        }
+        out << "\n";
+    }
+    out << "indexes:\n";
+    for (const QString &index : names("index")) {
+        out << "  " << index;
+        if (hasSizes) {
+            out << ": " << sizes.value(index) << " bytes";
+        }
+        out << "\n";
+    }
+    if (!hasSizes) {
+        out << "  (sizes need sqlite built with SQLITE_ENABLE_DBSTAT_VTAB)\n";
+    }
+
+    // One bounded query per notebook and per child table, each
+    // in its own slice, instead of one scan of all the components.
+    rows.clear();
+    if (!run("SELECT CalendarId, Name FROM Calendars ORDER BY Name", &rows)) {
+        return false;
+    }
+    out << "notebooks:\n";
+    for (const QStringList &notebook : rows) {
+        const QByteArray components = "FROM Components WHERE Notebook = " + literal(notebook.value(0));
+        const QByteArray children = " WHERE ComponentId IN (SELECT ComponentId " + components + ")";
+        Rows counts;
+        Rows attendees;
+        Rows alarms;
+        Rows attachments;
+        if (!run("SELECT COUNT(*), SUM(DateDeleted <> 0) " + components, &counts)
+            || !run("SELECT COUNT(*) FROM Attendee" + children, &attendees)
+            || !run("SELECT COUNT(*) FROM Alarm" + children, &alarms)
+            || !run("SELECT COUNT(*), SUM(LENGTH(Data)) FROM Attachments" + children, &attachments)
+            || counts.isEmpty() || attendees.isEmpty() || alarms.isEmpty() || attachments.isEmpty()) {
+            return false;
+        }
+        out << "  " << notebook.value(1) << " (" << notebook.value(0) << "): "
+            << counts[0].value(0) << " incidences, "
+            << counts[0].value(1).toLongLong() << " deleted, "
+            << attendees[0].value(0).toLongLong() << " attendees, "
+            << alarms[0].value(0).toLongLong() << " alarms, "
+            << attachments[0].value(0).toLongLong() << " attachments, "
+            << attachments[0].value(1).toLongLong() << " bytes of attachment data\n";
+        out.flush();
+    }
+
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2026 agent <agent@local>.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public License
+  along with this library; see the file COPYING.LIB.  If not, write to
+  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA 02110-1301, USA.
+*/
+
+#ifndef MKCAL_MAINTENANCE_H
+#define MKCAL_MAINTENANCE_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <semaphore_p.h>
+
+#include <sqlite3.h>
+
+/**
+  Maintenance operations on a database that may be in use
+  by other processes. Every statement is run in its own slice,
+  holding the inter-process lock only for its duration and
+  pausing between slices, so that applications can still
+  access the database in between.
+*/
+class Maintenance
+{
+public:
+    explicit Maintenance(const QString &databaseName);
+    ~Maintenance();
+
+    bool open();
+
+    /**
+      Runs ANALYZE table by table.
+    */
+    bool analyze(QTextStream &out);
+
+    /**
+      Releases the free pages of a database in incremental auto
+      vacuum mode, by steps of @p pages.
+
+      Databases created before this mode was the default need
+      one full VACUUM to switch to it, which keeps the database
+      locked until it completes. It is only done when @p full
+      is true.
+    */
+    bool vacuum(QTextStream &out, int pages, bool full = false);
+
+    /**
+      Runs a quick integrity check, table by table.
+    */
+    bool integrityCheck(QTextStream &out);
+
+    /**
+      Prints the row count and size of tables and indexes,
+      and the content of each notebook.
+    */
+    bool stats(QTextStream &out);
+
+private:
+    typedef QList<QStringList> Rows;
+
+    bool run(const QByteArray &sql, Rows *rows = nullptr, bool warn = true);
+    QStringList names(const char *type);
+
+    QString mDatabaseName;
+    ProcessMutex mMutex;
+    sqlite3 *mDatabase = nullptr;
+    int mPause = 50;
+};
+
+#endif
@@ -22,11 +22,21 @@
 */
 #include "mkcaltool.h"
 
+#include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+
+#include "alarmservice.h"
+#include "dataset.h"
+#include "maintenance.h"
 
 // mkcal
 #include <extendedcalendar.h>
 #include <extendedstorage.h>
+#include <sqlitestorage.h>
+#include <semaphore_p.h>
 
 MkcalTool::MkcalTool()
 {
@@ -34,20 +44,212 @@ MkcalTool::MkcalTool()
 
 int MkcalTool::resetAlarms(const QString &notebookUid, const QString &eventUid)
 {
+    if (AlarmService::request(notebookUid, eventUid)) {
+        return 0;
+    }
+
     mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
     mKCal::ExtendedStorage::Ptr storage = cal->defaultStorage(cal);
     storage->open();
-    if (!storage->load(eventUid)) {
-        qWarning() << "Unable to load event" << eventUid << "from notebook" << notebookUid;
+    QSet<QPair<QString, QString>> uids;
+    uids.insert(QPair<QString, QString>(notebookUid, eventUid));
+    return resetAlarms(storage, uids);
+}
+
+int MkcalTool::resetAlarms(const mKCal::ExtendedStorage::Ptr &storage,
+                           const QSet<QPair<QString, QString>> &uids)
+{
+    int result = 0;
+    KCalendarCore::Incidence::List modified;
+    for (const QPair<QString, QString> &id : uids) {
+        if (!storage->load(id.second)) {
+            qWarning() << "Unable to load event" << id.second << "from notebook" << id.first;
+            result = 1;
+            continue;
+        }
+        KCalendarCore::Event::Ptr event = storage->calendar()->event(id.second);
+        if (!event) {
+            qWarning() << "Unable to fetch event" << id.second << "from notebook" << id.first;
+            result = 1;
+            continue;
+        }
+        modified.append(event);
+    }
+
+    storage->emitStorageUpdated(KCalendarCore::Incidence::List(),
+                                modified, KCalendarCore::Incidence::List());
+    storage->flushAlarms();
+    // Other processes may still know the alarms replaced here.
+    mKCal::SqliteStorage::Ptr sqlite = storage.dynamicCast<mKCal::SqliteStorage>();
+    if (sqlite) {
+        sqlite->notifyAlarmsChanged();
+    }
+    return result;
+}
+
+int MkcalTool::runAlarmService()
+{
+    AlarmService service;
+    if (!service.start()) {
         return 1;
     }
-    KCalendarCore::Event::Ptr event = cal->event(eventUid);
-    if (!event) {
-        qWarning() << "Unable to fetch event" << eventUid << "from notebook" << notebookUid;
+    return QCoreApplication::exec();
+}
+
+int MkcalTool::generate(const QString &databaseName, const QString &profile,
+                        int size, quint32 seed)
+{
+    Dataset::Profile value;
+    if (!Dataset::profileFromName(profile, &value)) {
+        QStringList names;
+        for (Dataset::Profile candidate : Dataset::profiles()) {
+            names.append(Dataset::profileName(candidate));
+        }
+        qWarning() << "Unknown profile" << profile << ", available profiles are" << names;
+        return 1;
+    }
+    if (size <= 0) {
+        qWarning() << "Invalid size" << size;
+        return 1;
+    }
+    if (QFile::exists(databaseName)) {
+        qWarning() << "Database" << databaseName << "already exists";
         return 1;
     }
 
-    storage->emitStorageUpdated(KCalendarCore::Incidence::List(),
-                                KCalendarCore::Incidence::List() << event, KCalendarCore::Incidence::List());
+    return Dataset(value, size, seed).write(databaseName) ? 0 : 1;
+}
+
+int MkcalTool::lockStatus(const QString &databaseName)
+{
+    const QString path = databaseName.isEmpty()
+        ? mKCal::SqliteStorage::defaultDatabaseName() : databaseName;
+    const ProcessMutex::Status status = ProcessMutex::status(path);
+
+    QTextStream out(stdout);
+    out << "database: " << path << "\n";
+    if (!status.valid) {
+        out << "no process is using the database\n";
+        return 0;
+    }
+    out << "connections: " << status.connections << "\n";
+    if (!status.locked) {
+        out << "lock: free\n";
+    } else {
+        QFile comm(QString::fromLatin1("/proc/%1/comm").arg(status.holder));
+        const QString name = comm.open(QIODevice::ReadOnly)
+            ? QString::fromLocal8Bit(comm.readAll()).trimmed() : QString::fromLatin1("?");
+        out << "lock: held by pid " << status.holder << " (" << name << ")";
+        if (status.heldUs >= 0) {
+            out << " for " << status.heldUs / 1000 << " ms";
+            if (!status.operation.isEmpty()) {
+                out << " in " << status.operation;
+            }
+        }
+        out << "\n";
+    }
+    out << "waiting: " << status.waiters << "\n";
+
+    return 0;
+}
+
+// Loads incidences according to pattern, one of "none", "all",
+// "uid:<uid>", "notebook:<uid>" or "range:<yyyy-mm-dd>:<yyyy-mm-dd>",
+// and prints the memory held by the calendar and the storage.
+int MkcalTool::memoryUsage(const QString &pattern, const QString &databaseName)
+{
+    const QString path = databaseName.isEmpty()
+        ? mKCal::SqliteStorage::defaultDatabaseName() : databaseName;
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::SqliteStorage::Ptr storage(new mKCal::SqliteStorage(cal, path));
+    if (!storage->open()) {
+        qWarning() << "Unable to open" << path;
+        return 1;
+    }
+
+    const QStringList args = pattern.split(QLatin1Char(':'));
+    bool success = true;
+    if (pattern == QLatin1String("all")) {
+        success = storage->load();
+    } else if (args.count() == 2 && args[0] == QLatin1String("uid")) {
+        success = storage->load(args[1]);
+    } else if (args.count() == 2 && args[0] == QLatin1String("notebook")) {
+        success = storage->loadNotebookIncidences(args[1]);
+    } else if (args.count() == 3 && args[0] == QLatin1String("range")) {
+        const QDate from = QDate::fromString(args[1], Qt::ISODate);
+        const QDate to = QDate::fromString(args[2], Qt::ISODate);
+        success = from.isValid() && to.isValid() && storage->load(from, to);
+    } else if (pattern != QLatin1String("none")) {
+        qWarning() << "Unknown load pattern" << pattern
+                   << "use none, all, uid:<uid>, notebook:<uid> or range:<from>:<to>";
+        return 1;
+    }
+    if (!success) {
+        qWarning() << "Unable to load" << pattern << "from" << path;
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "database: " << path << "\n";
+    out << "pattern: " << pattern << "\n";
+    out << storage->memoryUsage().toString() << "\n";
+
+    storage->close();
     return 0;
 }
+
+// Runs one of the analyze, vacuum, vacuum-full, integrity-check
+// or stats commands, see Maintenance.
+int MkcalTool::maintenance(const QString &command, const QString &databaseName,
+                           int vacuumPages)
+{
+    const QString path = databaseName.isEmpty()
+        ? mKCal::SqliteStorage::defaultDatabaseName() : databaseName;
+    Maintenance maintenance(path);
+    if (!maintenance.open()) {
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "database: " << path << "\n";
+    bool success = false;
+    if (command == QLatin1String("analyze")) {
+        success = maintenance.analyze(out);
+    } else if (command == QLatin1String("vacuum")) {
+        success = maintenance.vacuum(out, vacuumPages);
+    } else if (command == QLatin1String("vacuum-full")) {
+        success = maintenance.vacuum(out, vacuumPages, true);
+    } else if (command == QLatin1String("integrity-check")) {
+        success = maintenance.integrityCheck(out);
+    } else if (command == QLatin1String("stats")) {
+        success = maintenance.stats(out);
+    }
+    return success ? 0 : 1;
+}
+
+// Removes the expired deleted incidences by batches, releasing
+// the database between batches.
+int MkcalTool::purgeTombstones(const QString &databaseName, int batchSize)
+{
+    const QString path = databaseName.isEmpty()
+        ? mKCal::SqliteStorage::defaultDatabaseName() : databaseName;
+    mKCal::ExtendedCalendar::Ptr cal(new mKCal::ExtendedCalendar(QTimeZone::systemTimeZone()));
+    mKCal::SqliteStorage::Ptr storage(new mKCal::SqliteStorage(cal, path));
+    if (!storage->open()) {
+        qWarning() << "Unable to open" << path;
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "database: " << path << "\n";
+    int total = 0;
+    int purged;
+    while ((purged = storage->purgeExpiredTombstones(batchSize)) > 0) {
+        total += purged;
+        QThread::msleep(50);
+    }
+    out << "purged: " << total << "\n";
+
+    storage->close();
+    return purged < 0 ? 1 : 0;
+}
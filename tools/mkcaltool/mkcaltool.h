@@ -25,6 +25,11 @@
 #define MKCALTOOL_H
 
 #include <QtCore/QString>
+#include <QtCore/QSet>
+#include <QtCore/QPair>
+
+// mkcal
+#include <extendedstorage.h>
 
 class MkcalTool
 {
@@ -33,6 +38,16 @@ public:
     explicit MkcalTool();
 
     int resetAlarms(const QString &notebookUid, const QString &eventUid);
+    int resetAlarms(const mKCal::ExtendedStorage::Ptr &storage,
+                    const QSet<QPair<QString, QString>> &uids);
+    int runAlarmService();
+    int generate(const QString &databaseName, const QString &profile,
+                 int size, quint32 seed);
+    int lockStatus(const QString &databaseName);
+    int memoryUsage(const QString &pattern, const QString &databaseName);
+    int maintenance(const QString &command, const QString &databaseName,
+                    int vacuumPages = 64);
+    int purgeTombstones(const QString &databaseName, int batchSize);
 };
 
 #endif // MKCALTOOL_H